@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include "basdata.h"
+#include "bbcutil.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The items of each DATA statement are split as READ splits them: at
+ * commas, with leading spaces skipped and a quoted item taken up to its
+ * closing quote, a doubled quote standing for one.  A quoted item is a
+ * string.  An unquoted one that is a decimal integer in range or a hex
+ * number is an integer, one that is any other number a float and
+ * anything else a string.  Items are written as they are found, so a
+ * table of any size is converted in one pass over the program. */
+
+#define TOK_DATA    0xdc
+#define TOK_READ    0xf3
+#define TOK_RESTORE 0xf7
+
+#define OUT_BUFFER 65536
+
+struct counts {
+    unsigned statements;
+    unsigned strings;
+    unsigned integers;
+    unsigned floats;
+};
+
+static inline bool digit(int ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static bool parse_int(const unsigned char *ptr, const unsigned char *end, int_least32_t *value)
+{
+    if (ptr < end && *ptr == '&') {
+        uint_least32_t num = 0;
+        if (++ptr == end || end - ptr > 8)
+            return false;
+        while (ptr < end) {
+            int ch = *ptr++;
+            if (digit(ch))
+                num = (num << 4) | (ch - '0');
+            else if (ch >= 'A' && ch <= 'F')
+                num = (num << 4) | (ch - 'A' + 10);
+            else
+                return false;
+        }
+        *value = (int_least32_t)num;
+        return true;
+    }
+    bool neg = false;
+    if (ptr < end && (*ptr == '-' || *ptr == '+'))
+        neg = *ptr++ == '-';
+    if (ptr == end)
+        return false;
+    int64_t num = 0;
+    while (ptr < end) {
+        if (!digit(*ptr) || (num = num * 10 + *ptr++ - '0') > 2147483648LL)
+            return false;
+    }
+    if (neg)
+        num = -num;
+    if (num > 2147483647LL)
+        return false;
+    *value = num;
+    return true;
+}
+
+static bool parse_float(const unsigned char *ptr, const unsigned char *end, double *value)
+{
+    char buf[256];
+    const unsigned char *start = ptr;
+    bool digits = false;
+    if (ptr < end && (*ptr == '-' || *ptr == '+'))
+        ptr++;
+    while (ptr < end && digit(*ptr)) {
+        ptr++;
+        digits = true;
+    }
+    if (ptr < end && *ptr == '.')
+        while (++ptr < end && digit(*ptr))
+            digits = true;
+    if (!digits)
+        return false;
+    if (ptr < end && (*ptr == 'E' || *ptr == 'e')) {
+        if (++ptr < end && (*ptr == '-' || *ptr == '+'))
+            ptr++;
+        if (ptr == end)
+            return false;
+        while (ptr < end && digit(*ptr))
+            ptr++;
+    }
+    if (ptr != end)
+        return false;
+    memcpy(buf, start, end - start);
+    buf[end - start] = 0;
+    *value = strtod(buf, NULL);
+    return true;
+}
+
+static basdata_res write_item(const unsigned char *ptr, const unsigned char *end, bool floats,
+                              struct counts *counts, FILE *ofp)
+{
+    const unsigned char *last = end;
+    while (last > ptr && last[-1] == ' ')
+        last--;
+    int_least32_t ivalue;
+    double fvalue;
+    if (parse_int(ptr, last, &ivalue)) {
+        if (!floats) {
+            counts->integers++;
+            return basdata_writei(ivalue, ofp);
+        }
+        counts->floats++;
+        return basdata_writef(ivalue, ofp);
+    }
+    if (parse_float(ptr, last, &fvalue)) {
+        counts->floats++;
+        return basdata_writef(fvalue, ofp);
+    }
+    counts->strings++;
+    return basdata_writes((const char *)ptr, end - ptr, ofp);
+}
+
+static basdata_res write_data(const unsigned char *ptr, const unsigned char *end, bool floats,
+                              struct counts *counts, FILE *ofp)
+{
+    basdata_res res;
+    counts->statements++;
+    for (;;) {
+        while (ptr < end && *ptr == ' ')
+            ptr++;
+        if (ptr < end && *ptr == '"') {
+            char str[256];
+            int len = 0;
+            while (++ptr < end) {
+                if (*ptr == '"') {
+                    if (ptr + 1 < end && ptr[1] == '"')
+                        ptr++;
+                    else {
+                        ptr++;
+                        break;
+                    }
+                }
+                str[len++] = *ptr;
+            }
+            while (ptr < end && *ptr != ',')
+                ptr++;
+            counts->strings++;
+            res = basdata_writes(str, len, ofp);
+        }
+        else {
+            const unsigned char *start = ptr;
+            while (ptr < end && *ptr != ',')
+                ptr++;
+            res = write_item(start, ptr, floats, counts, ofp);
+        }
+        if (res != BASDATA_OK || ptr >= end)
+            return res;
+        ptr++;
+    }
+}
+
+/* BBC BASIC's READ only finds DATA as the first statement of a line, so
+ * a DATA token anywhere else is never read.  Returns the start of the
+ * items or NULL if the line does not begin with DATA. */
+
+static const unsigned char *line_data(const bbcutil_line *line)
+{
+    const unsigned char *ptr = line->text;
+    while (ptr < line->text_end && *ptr == ' ')
+        ptr++;
+    return ptr < line->text_end && *ptr == TOK_DATA ? ptr + 1 : NULL;
+}
+
+/* Lines which are left empty once their DATA is removed are dropped
+ * unless they are referred to, as by RESTORE. */
+
+static size_t strip_data(const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind,
+                         const uint8_t *refs, bool known, unsigned char *out)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned char *optr = out;
+    unsigned hdr = kind == BBCUTIL_RUSSELL ? 3 : 4;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        size_t len = line.text_end - line.text;
+        if (line_data(&line)) {
+            if (known && !(refs[line.lineno >> 3] & (1 << (line.lineno & 7))))
+                continue;
+            len = 0;
+        }
+        memcpy(optr, line.start, hdr);
+        memcpy(optr + hdr, line.text, len);
+        if (kind == BBCUTIL_RUSSELL) {
+            optr[0] = len + 4;
+            optr[hdr + len] = 0x0d;
+        }
+        else
+            optr[3] = len + 4;
+        optr += len + 4;
+    }
+    return optr - out;
+}
+
+static int convert(const char *fn, const unsigned char *file, const unsigned char *file_end, const char *out_fn,
+                   bool floats, bool strip)
+{
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, file_end - file, &fmt);
+    if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+        fprintf(stderr, "bas2data: %s is not a BBC BASIC program or is corrupt\n", fn);
+        return 3;
+    }
+    FILE *ofp = fopen(out_fn, "wb");
+    if (!ofp) {
+        fprintf(stderr, "bas2data: unable to open '%s' for writing: %s\n", out_fn, strerror(errno));
+        return 2;
+    }
+    setvbuf(ofp, NULL, _IOFBF, OUT_BUFFER);
+    struct counts counts = { 0, 0, 0, 0 };
+    basdata_res res = BASDATA_OK;
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bbcutil_lines_init(&lines, file, file + fmt.prog_len, kind);
+    while (res == BASDATA_OK && bbcutil_lines_next(&lines, &line)) {
+        const unsigned char *data = line_data(&line);
+        if (data) {
+            if ((res = write_data(data, line.text_end, floats, &counts, ofp)) != BASDATA_OK)
+                fprintf(stderr, "bas2data: %s: line %u: %s\n", fn, line.lineno, basdata_rmsg(res));
+            continue;
+        }
+        if (!strip)
+            continue;
+        bbcutil_toks it;
+        bbcutil_tok tok;
+        bbcutil_toks_init(&it, &line, kind);
+        while (bbcutil_toks_next(&it, &tok))
+            if (tok.type == BBCUTIL_TOK_KEYWORD && (tok.tok == TOK_READ || tok.tok == TOK_RESTORE))
+                printf("%s: line %u still uses %s\n", fn, line.lineno, tok.tok == TOK_READ ? "READ" : "RESTORE");
+    }
+    if (fclose(ofp) && res == BASDATA_OK) {
+        fprintf(stderr, "bas2data: unable to write '%s': %s\n", out_fn, strerror(errno));
+        res = BASDATA_IOERR;
+    }
+    if (res != BASDATA_OK) {
+        remove(out_fn);
+        return res == BASDATA_RANGE ? 3 : 2;
+    }
+    printf("%s: %u items from %u DATA statements, %u strings, %u integers and %u floats, written to %s\n", fn,
+           counts.strings + counts.integers + counts.floats, counts.statements, counts.strings, counts.integers,
+           counts.floats, out_fn);
+    if (!strip || !counts.statements)
+        return 0;
+
+    uint8_t *refs = malloc(BBCUTIL_REFS_SIZE);
+    unsigned char *out = malloc(file_end - file);
+    int status;
+    if (!refs || !out) {
+        fputs("bas2data: out of memory\n", stderr);
+        status = 2;
+    }
+    else {
+        bool known = bbcutil_line_targets(file, file + fmt.prog_len, kind, refs);
+        size_t size = strip_data(file, file + fmt.prog_len, kind, refs, known, out);
+        size_t rest = file_end - file - fmt.prog_len;
+        memcpy(out + size, file + fmt.prog_len, rest);
+        status = bbcutil_save("bas2data", fn, out, size + rest) ? 0 : 2;
+    }
+    free(out);
+    free(refs);
+    return status;
+}
+
+#define BATCH_DEPTH 32
+
+static const char usage[] = "Usage: bas2data [-f] [-s] [-o <data-out>] <bas-in> [ ... ]\n";
+
+int main(int argc, char **argv)
+{
+    bool floats = false;
+    bool strip = false;
+    const char *out_fn = NULL;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 'f':
+                floats = true;
+                break;
+            case 's':
+                strip = true;
+                break;
+            case 'o':
+                if (arg[2])
+                    out_fn = arg + 2;
+                else if (argc > 1) {
+                    out_fn = *++argv;
+                    --argc;
+                }
+                else {
+                    fprintf(stderr, "bas2data: missing value for 'o'\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 0:
+                fprintf(stderr, "bas2data: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "bas2data: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc == 0 || (out_fn && argc > 1)) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    bbcutil_batch *batch = bbcutil_batch_open("bas2data", argv, argc, BATCH_DEPTH);
+    if (!batch) {
+        fputs("bas2data: out of memory\n", stderr);
+        return 2;
+    }
+    int status = 0;
+    while (argc--) {
+        const char *fn;
+        unsigned char *file_end;
+        unsigned char *file = bbcutil_batch_next(batch, &fn, &file_end);
+        if (file) {
+            char *data_fn = NULL;
+            int cstat;
+            if (!out_fn && asprintf(&data_fn, "%s.dat", fn) < 0) {
+                fputs("bas2data: out of memory\n", stderr);
+                cstat = 2;
+            }
+            else
+                cstat = convert(fn, file, file_end, out_fn ? out_fn : data_fn, floats, strip);
+            if (cstat)
+                status = cstat;
+            free(data_fn);
+            free(file);
+        }
+        else
+            status = 2;
+    }
+    bbcutil_batch_close(batch);
+    return status;
+}
@@ -1,455 +1,1120 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-struct token {
-    char text[9];
-    uint8_t flags;
-};
+/* A range of lines to list, selected through a line index. */
 
-#define SPC_BEFORE 0x01
-#define SPC_AFTER  0x02
-#define INC_INDENT 0x04
-#define DEC_INDENT 0x08
-#define SKIP_EOL   0x10
-
-static const char low_tokens[8][9] = {
-    "Missing",
-    "No such",
-    "Bad",
-    "range",
-    "variable",
-    "Out of",
-    "No",
-    "space"
+struct range {
+    unsigned first;
+    unsigned last;
 };
 
-static const struct token high_tokens[] = {
-    /* Operators */
-    { "AND",      SPC_BEFORE|SPC_AFTER }, // 80
-    { "DIV",      SPC_BEFORE|SPC_AFTER }, // 81
-    { "EOR",      SPC_BEFORE|SPC_AFTER }, // 82
-    { "MOD",      SPC_BEFORE|SPC_AFTER }, // 83
-    { "OR",       SPC_BEFORE|SPC_AFTER }, // 84
-    /* Auxilliary tokens */
-    { "ERROR",    SPC_AFTER            }, // 85
-    { "LINE",     SPC_AFTER            }, // 86
-    { "OFF",      SPC_AFTER            }, // 87
-    { "STEP",     SPC_BEFORE|SPC_AFTER }, // 88
-    { "SPC",      SPC_AFTER            }, // 89
-    { "TAB(",     0                    }, // 8A
-    { "ELSE",     SPC_BEFORE|SPC_AFTER }, // 8B
-    { "THEN",     SPC_BEFORE|SPC_AFTER }, // 8C
-    /* Line number token */
-    { "",         SPC_BEFORE|SPC_AFTER }, // 8D
-    /* Oddly placed as added with BASIC 2 */
-    { "OPENIN",   SPC_AFTER            }, // 8E
-    /* Pseudo variable functions */
-    { "PTR",      0                    }, // 8F
-    { "PAGE",     0                    }, // 90
-    { "TIME",     0                    }, // 91
-    { "LOMEM",    0                    }, // 92
-    { "HIMEM",    0                    }, // 93
-    /* Numeric valued functions */
-    { "ABS",      0                    }, // 94
-    { "ACS",      0                    }, // 95
-    { "ADVAL",    0                    }, // 96
-    { "ASC",      0                    }, // 97
-    { "ASN",      0                    }, // 98
-    { "ATN",      0                    }, // 99
-    { "BGET",     0                    }, // 9A
-    { "COS",      0                    }, // 9B
-    { "COUNT",    0                    }, // 9C
-    { "DEG",      0                    }, // 9D
-    { "ERL",      0                    }, // 9E
-    { "ERR",      0                    }, // 9F
-    { "EVAL",     0                    }, // A0
-    { "EXP",      0                    }, // A1
-    { "EXT",      0                    }, // A2
-    { "FALSE",    0                    }, // A3
-    { "FN",       0                    }, // A4
-    { "GET",      0                    }, // A5
-    { "INKEY",    0                    }, // A6
-    { "INSTR(",   0                    }, // A7
-    { "INT",      0                    }, // A8
-    { "LEN",      0                    }, // A9
-    { "LN",       0                    }, // AA
-    { "LOG",      0                    }, // AB
-    { "NOT",      0                    }, // AC
-    { "OPENUP",   0                    }, // AD
-    { "OPENOUT",  0                    }, // AE
-    { "PI",       0                    }, // AF
-    { "POINT(",   0                    }, // B0
-    { "POS",      0                    }, // B1
-    { "RAD",      0                    }, // B2
-    { "RND",      0                    }, // B3
-    { "SGN",      0                    }, // B4
-    { "SIN",      0                    }, // B5
-    { "SQR",      0                    }, // B6
-    { "TAN",      0                    }, // B7
-    { "TO",       SPC_BEFORE|SPC_AFTER }, // B8
-    { "TRUE",     0                    }, // B9
-    { "USR",      0                    }, // BA
-    { "VAL",      0                    }, // BB
-    { "VPOS",     0                    }, // BC
-    { "CHR$",     0                    }, // BD
-    /* String-valued functions */
-    { "GET$",     0                    }, // BE
-    { "INKEY$",   0                    }, // BF
-    { "LEFT$(",   0                    }, // C0
-    { "MID$(",    0                    }, // C1
-    { "RIGHT$(",  0                    }, // C2
-    { "STR$",     0                    }, // C3
-    { "STRING$(", 0                    }, // C4
-    /* EOF is an odd-ball */
-    { "EOF",      0                    }, // C5
-    /* Commands */
-    { "AUTO",     0                    }, // C6
-    { "DELETE",   0                    }, // C7
-    { "LOAD",     0                    }, // C8
-    { "LIST",     0                    }, // C9
-    { "NEW",      0                    }, // CA
-    { "OLD",      0                    }, // CB
-    { "RENUMBER", 0                    }, // CC
-    { "SAVE",     0                    }, // CD
-    { "",         0                    }, // CE
-    /* Pseudo-variable statements */
-    { "PTR",      0                    }, // CF
-    { "PAGE",     0                    }, // D0
-    { "TIME",     0                    }, // D1
-    { "LOMEM",    0                    }, // D2
-    { "HIMEM",    0                    }, // D3
-    /* Statements */
-    { "SOUND",    SPC_AFTER            }, // D4
-    { "BPUT",     SPC_AFTER            }, // D5
-    { "CALL",     SPC_AFTER            }, // D6
-    { "CHAIN",    SPC_AFTER            }, // D7
-    { "CLEAR",    SPC_AFTER            }, // D8
-    { "CLOSE",    SPC_AFTER            }, // D9
-    { "CLG",      SPC_AFTER            }, // DA
-    { "CLS",      SPC_AFTER            }, // DB
-    { "DATA",     SPC_AFTER|SKIP_EOL   }, // DC
-    { "DEF",      SPC_AFTER            }, // DD
-    { "DIM",      SPC_AFTER            }, // DE
-    { "DRAW",     SPC_AFTER            }, // DF
-    { "END",      SPC_AFTER            }, // E0
-    { "ENDPROC",  SPC_AFTER            }, // E1
-    { "ENVELOPE", SPC_AFTER            }, // E2
-    { "FOR",      SPC_AFTER|INC_INDENT }, // E3
-    { "GOSUB",    SPC_AFTER            }, // E4
-    { "GOTO",     SPC_AFTER            }, // E5
-    { "GCOL",     SPC_AFTER            }, // E6
-    { "IF",       SPC_AFTER            }, // E7
-    { "INPUT",    SPC_AFTER            }, // E8
-    { "LET",      SPC_AFTER            }, // E9
-    { "LOCAL",    SPC_AFTER            }, // EA
-    { "MODE",     SPC_AFTER            }, // EB
-    { "MOVE",     SPC_AFTER            }, // EC
-    { "NEXT",     SPC_AFTER|DEC_INDENT }, // ED
-    { "ON",       SPC_AFTER            }, // EE
-    { "VDU",      SPC_AFTER            }, // EF
-    { "PLOT",     SPC_AFTER            }, // F0
-    { "PRINT",    SPC_AFTER            }, // F1
-    { "PROC",     0                    }, // F2
-    { "READ",     SPC_AFTER            }, // F3
-    { "REM",      SPC_AFTER|SKIP_EOL   }, // F4
-    { "REPEAT",   SPC_AFTER|INC_INDENT }, // F5
-    { "REPORT",   SPC_AFTER            }, // F6
-    { "RESTORE",  SPC_AFTER            }, // F7
-    { "RETURN",   SPC_AFTER            }, // F8
-    { "RUN",      SPC_AFTER            }, // F9
-    { "STOP",     SPC_AFTER            }, // FA
-    { "COLOUR",   SPC_AFTER            }, // FB
-    { "TRACE",    SPC_AFTER            }, // FC
-    { "UNTIL",    SPC_AFTER|DEC_INDENT }, // FD
-    { "WIDTH",    SPC_AFTER            }, // FE
-    { "OSCLI",    SPC_AFTER            }  // FF
-};
+/* With --stats the statistics of the thread, otherwise NULL, and the
+ * report wanted at the end of the run.  Every worker of a site keeps
+ * its own and adds them into those of the run when done.  With --trace
+ * each phase is also recorded as a span for the file in hand. */
 
-struct outcfg {
-    const char *fmt_lineno;
-    const char *fmt_token;
-    const char *str_prefix;
-    const char *fmt_skipeol;
-    const char *gen_suffix;
-    const char *eol;
-};
+static _Thread_local bbcutil_stats *stats;
+static bbcutil_stats run_stats;
+static int stats_mode;
+static _Thread_local const char *cur_file;
 
-static const struct outcfg cfg_plain =
+static inline bool timing(void)
 {
-    "%5u",
-    "%s",
-    "",
-    "%s",
-    "",
-    "\n"
-};
+    return stats || bbcutil_tracing();
+}
 
-static const struct outcfg cfg_colour =
+static inline uint64_t phase_mark(void)
 {
-    "\e[38;5;160m%5u\e[0m",
-    "\e[38;5;45m%s\e[0m",
-    "\e[38;5;166m",
-    "\e[38;5;128m%s",
-    "\e[0m"
-};
+    return timing() ? bbcutil_clock() : 0;
+}
+
+static inline uint64_t phase_lap(bbcutil_phase phase, uint64_t mark)
+{
+    if (!timing())
+        return 0;
+    uint64_t now = bbcutil_clock();
+    if (stats)
+        stats->ns[phase] += now - mark;
+    if (bbcutil_tracing())
+        bbcutil_trace_span(phase, cur_file, mark, now);
+    return now;
+}
 
-static const struct outcfg cfg_dark =
+static void stats_count(size_t size, unsigned lines, const bbcutil_listing *lst)
 {
-    "\e[38;5;124m%5u\e[0m",
-    "\e[38;5;20m%s\e[0m",
-    "\e[38;5;94m",
-    "\e[38;5;128m%s",
-    "\e[0m"
+    if (stats) {
+        stats->files++;
+        stats->bytes_in += size;
+        stats->lines += lines;
+        stats->tokens += bbcutil_listing_tokens(lst);
+    }
+}
+
+/* An output target is a style and template plus, when rendering more
+ * than one target, the name of the output file with %f standing for
+ * the input file name. */
+
+struct target {
+    bbcutil_renderer *rend;
+    bbcutil_template *tmpl;
+    const char *output;
 };
 
-static const struct outcfg cfg_html =
+static char *target_name(const char *pattern, const char *fn)
 {
-    "<span class=\"lineno\">%5u</span> ",
-    "<span class=\"token\">%s</span>",
-    "<span class=\"string\">",
-    "<span class=\"skipeol\">%s",
-    "</span>"
+    char *name;
+    size_t size;
+    FILE *fp = open_memstream(&name, &size);
+    if (!fp)
+        return NULL;
+    while (*pattern) {
+        int ch = *pattern++;
+        if (ch == '%' && *pattern == 'f') {
+            fputs(fn, fp);
+            pattern++;
+        }
+        else if (ch == '%' && *pattern == '%')
+            putc(*pattern++, fp);
+        else
+            putc(ch, fp);
+    }
+    fclose(fp);
+    return name;
+}
+
+/* a template from the file named or the default given, with its text
+ * folded into hash, if wanted, so a change to it can be noticed. */
+
+static bbcutil_template *load_template(const char *tmpl_name, const char *dflt, uint64_t *hash)
+{
+    unsigned char *tmpl_data = (unsigned char *)dflt;
+    unsigned char *tmpl_end = tmpl_data + strlen(dflt);
+    if (tmpl_name && !(tmpl_data = bbcutil_load("bas2txt", tmpl_name, &tmpl_end)))
+        return NULL;
+    bbcutil_template *tmpl = bbcutil_template_compile(tmpl_data, tmpl_end - tmpl_data);
+    if (hash)
+        *hash = bbcutil_hash(tmpl_data, tmpl_end - tmpl_data, *hash);
+    if (tmpl_name)
+        free(tmpl_data);
+    if (!tmpl)
+        fputs("bas2txt: out of memory\n", stderr);
+    return tmpl;
+}
+
+struct render_ctx {
+    const bbcutil_renderer *rend;
+    const bbcutil_listing *lst;
 };
 
-static unsigned bas2txt(const unsigned char *line, unsigned len, unsigned lineno, unsigned indent, const struct outcfg *ocfg, bool doindent)
-{
-    printf(ocfg->fmt_lineno, lineno);
-    /* pre-scan the line for a decrease in indent. */
-    int new_indent = indent;
-    bool in_str = false;
-    const unsigned char *ptr = line;
-    const unsigned char *end = line + len;
-    if (doindent) {
-        putchar(' ');
-        while (ptr < end) {
-            int ch = *ptr++;
-            if (in_str) {
-                if (ch == '"')
-                    in_str = false;
-            }
-            else if (ch & 0x80) {
-                const struct token *t = high_tokens + (ch & 0x7f);
-                unsigned flags = t->flags;
-                if (flags & DEC_INDENT)
-                    --new_indent;
-                if (flags & INC_INDENT)
-                    ++new_indent;
-                if (flags & SKIP_EOL)
-                    break;
-            }
-            else if (ch == '"')
-                in_str = true;
-        }
-        /* a decrease in indent if applied immediately */
-        if (new_indent < indent && new_indent >= 0)
-            indent = new_indent;
-        for (int i = indent; i; --i) {
-            putchar(' ');
-            putchar(' ');
-        }
-    }
-    /* now print the line */
-    bool did_space = true;
-    bool need_space = false;
-    in_str = false;
-    ptr = line;
-    while (ptr < end) {
-        int ch = *ptr++;
-        if (in_str) {
-            putchar(ch);
-            if (ch == '"') {
-                in_str = false;
-                fputs(ocfg->gen_suffix, stdout);
+static void render_program(void *ctx, FILE *ofp)
+{
+    const struct render_ctx *rc = ctx;
+    bbcutil_render(rc->rend, rc->lst, ofp);
+}
+
+/* for the statistics or a trace the output is rendered into memory
+ * and written from there so as to time each apart. */
+
+static void template(const struct target *tgt, bbcutil_tmpl_vars *vars, const bbcutil_listing *lst, FILE *ofp)
+{
+    struct render_ctx rc = { tgt->rend, lst };
+    vars->program = render_program;
+    vars->ctx = &rc;
+    char *text;
+    size_t size;
+    FILE *mfp;
+    if (!timing() || !(mfp = open_memstream(&text, &size))) {
+        bbcutil_template_write(tgt->tmpl, vars, ofp);
+        return;
+    }
+    uint64_t mark = bbcutil_clock();
+    bbcutil_template_write(tgt->tmpl, vars, mfp);
+    fclose(mfp);
+    mark = phase_lap(BBCUTIL_PH_RENDER, mark);
+    fwrite(text, size, 1, ofp);
+    phase_lap(BBCUTIL_PH_WRITE, mark);
+    if (stats)
+        stats->bytes_out += size;
+    free(text);
+}
+
+static int emit_tar(const char *name, const struct target *tgt, bbcutil_tmpl_vars *vars, const bbcutil_listing *lst)
+{
+    char *text;
+    size_t size;
+    FILE *ofp = open_memstream(&text, &size);
+    if (!ofp) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
+    }
+    template(tgt, vars, lst, ofp);
+    fclose(ofp);
+    uint64_t mark = phase_mark();
+    bbcutil_res res = bbcutil_tar_write(stdout, name, text, size, vars->mtime);
+    phase_lap(BBCUTIL_PH_WRITE, mark);
+    free(text);
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "bas2txt: %s on archive\n", bbcutil_rmsg(res));
+        return 2;
+    }
+    return 0;
+}
+
+static int emit_file(const char *name, const struct target *tgt, bbcutil_tmpl_vars *vars, const bbcutil_listing *lst)
+{
+    FILE *ofp = fopen(name, "w");
+    if (!ofp) {
+        fprintf(stderr, "bas2txt: unable to open '%s' for writing: %s\n", name, strerror(errno));
+        return 2;
+    }
+    template(tgt, vars, lst, ofp);
+    if (fclose(ofp)) {
+        fprintf(stderr, "bas2txt: write error on '%s': %s\n", name, strerror(errno));
+        return 2;
+    }
+    return 0;
+}
+
+/* references are resolved before anything is written so running out
+ * of memory doing so leaves no partial output. */
+
+static int emit_targets(bbcutil_tmpl_vars *vars, const struct target *targets, unsigned ntargets,
+                        bool archive, bbcutil_listing *lst)
+{
+    const char *fn = vars->name;
+    int status = 0;
+    uint64_t mark = phase_mark();
+    bool resolved = false;
+    for (const struct target *tgt = targets; tgt < targets + ntargets; tgt++) {
+        if (bbcutil_renderer_links(tgt->rend)) {
+            if (bbcutil_listing_resolve(lst) != BBCUTIL_OK) {
+                fprintf(stderr, "bas2txt: out of memory converting %s\n", fn);
+                return 2;
             }
+            resolved = true;
         }
-        else if (ch & 0x80) {
-            const struct token *t = high_tokens + (ch & 0x7f);
-            unsigned flags = t->flags;
-            if (!did_space && (need_space || (flags & SPC_BEFORE)))
-                putchar(' ');
-            if (ch == 0x8d) {
-                unsigned b1 = ptr[0];
-                unsigned lsb = ((b1 & 0x30) << 2) ^ ptr[1];
-                unsigned msb = ((b1 & 0x0c) << 4) ^ ptr[2];
-                printf("%u", (msb << 8) | lsb);
-                ptr += 3;
-            }
-            else if (flags & SKIP_EOL) {
-                printf(ocfg->fmt_skipeol, t->text);
-                fwrite(ptr, end-ptr, 1, stdout);
-                fputs(ocfg->gen_suffix, stdout);
-                break;
+    }
+    if (resolved)
+        phase_lap(BBCUTIL_PH_DECODE, mark);
+    for (const struct target *tgt = targets; tgt < targets + ntargets; tgt++) {
+        int tstat;
+        if (tgt->output) {
+            char *name = target_name(tgt->output, fn);
+            if (!name) {
+                fputs("bas2txt: out of memory\n", stderr);
+                return 2;
             }
+            if (archive)
+                tstat = emit_tar(name, tgt, vars, lst);
             else
-                printf(ocfg->fmt_token, t->text);
-            did_space = need_space = false;
-            if (flags & SPC_AFTER)
-                need_space = true;
+                tstat = emit_file(name, tgt, vars, lst);
+            free(name);
         }
+        else if (archive)
+            tstat = emit_tar(fn, tgt, vars, lst);
         else {
-            if (ch == '"') {
-                in_str = true;
-                need_space = false;
-                fputs(ocfg->str_prefix, stdout);
-            }
-            else if (ch == ' ' || ch == ':') {
-                did_space = true;
-                need_space = false;
-            }
-            else
-                did_space = false;
-            if (need_space && !did_space) {
-                need_space = false;
-                did_space = true;
-                putchar(' ');
+            template(tgt, vars, lst, stdout);
+            tstat = 0;
+        }
+        if (tstat)
+            status = tstat;
+    }
+    return status;
+}
+
+/* COMAL shares the Wilson layout so a BASIC program the heuristics take
+ * for COMAL is still listed.  Without a file name any other file is
+ * passed over quietly. */
+
+static bbcutil_kind program_kind(const char *fn, const unsigned char *file, size_t size, size_t *prog_len, unsigned *lines)
+{
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, size, &fmt);
+    *prog_len = fmt.prog_len;
+    *lines = fmt.lines;
+    if (kind == BBCUTIL_COMAL)
+        kind = BBCUTIL_WILSON;
+    else if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+        if (fn)
+            fprintf(stderr, "bas2txt: %s is not a BBC BASIC program or is corrupt\n", fn);
+        kind = BBCUTIL_UNKNOWN;
+    }
+    return kind;
+}
+
+/* the modification time is only looked up if a template needs it. */
+
+static bool uses_time(const struct target *targets, unsigned ntargets)
+{
+    for (const struct target *tgt = targets; tgt < targets + ntargets; tgt++)
+        if (bbcutil_template_uses(tgt->tmpl, 't'))
+            return true;
+    return false;
+}
+
+static int convert(const char *fn, unsigned char *file, unsigned char *file_end, const struct target *targets, unsigned ntargets,
+                   bool doindent, const struct range *range, bool archive, int64_t mtime, bbcutil_listing *lst)
+{
+    size_t prog_len;
+    unsigned lines;
+    cur_file = fn;
+    uint64_t mark = phase_mark();
+    bbcutil_kind kind = program_kind(fn, file, file_end - file, &prog_len, &lines);
+    mark = phase_lap(BBCUTIL_PH_SNIFF, mark);
+    if (kind == BBCUTIL_UNKNOWN)
+        return 3;
+    struct stat stb;
+    if (mtime < 0 && uses_time(targets, ntargets) && !stat(fn, &stb))
+        mtime = stb.st_mtime;
+    bbcutil_tmpl_vars vars = { fn, file_end - file, lines, kind, mtime };
+    bbcutil_res res;
+    bbcutil_listing_clear(lst, file);
+    if (range) {
+        bbcutil_index idx;
+        if ((res = bbcutil_index_build(&idx, file, file + prog_len, kind, bbcutil_basic_depth)) == BBCUTIL_OK) {
+            res = bbcutil_listing_range(lst, &idx, range->first, range->last, doindent);
+            bbcutil_index_free(&idx);
+        }
+    }
+    else
+        res = bbcutil_listing_decode(lst, file, file + prog_len, kind, NULL, doindent);
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "bas2txt: out of memory converting %s\n", fn);
+        return 2;
+    }
+    phase_lap(BBCUTIL_PH_DECODE, mark);
+    stats_count(file_end - file, lines, lst);
+    return emit_targets(&vars, targets, ntargets, archive, lst);
+}
+
+/* With a range of lines the program is mapped rather than read and the
+ * index is taken from a sidecar file if there is one matching the size
+ * and modification time of the program so only the pages holding the
+ * lines wanted are read. */
+
+static int convert_mapped(const char *fn, const struct target *targets, unsigned ntargets, bool doindent,
+                          const struct range *range, bool save_index, bbcutil_listing *lst)
+{
+    cur_file = fn;
+    uint64_t mark = phase_mark();
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "bas2txt: unable to open '%s' for reading: %s\n", fn, strerror(errno));
+        return 2;
+    }
+    struct stat stb;
+    if (fstat(fd, &stb)) {
+        fprintf(stderr, "bas2txt: unable to stat '%s': %s\n", fn, strerror(errno));
+        close(fd);
+        return 2;
+    }
+    if (stb.st_size == 0) {
+        fprintf(stderr, "bas2txt: %s is an empty file\n", fn);
+        close(fd);
+        return 2;
+    }
+    unsigned char *file = mmap(NULL, stb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "bas2txt: unable to map '%s': %s\n", fn, strerror(errno));
+        return 2;
+    }
+    mark = phase_lap(BBCUTIL_PH_LOAD, mark);
+    int status = 0;
+    int64_t mtime = stb.st_mtim.tv_sec * 1000000000LL + stb.st_mtim.tv_nsec;
+    char *sidecar;
+    bbcutil_index idx;
+    if (asprintf(&sidecar, "%s.lix", fn) < 0) {
+        fputs("bas2txt: out of memory\n", stderr);
+        munmap(file, stb.st_size);
+        return 2;
+    }
+    bbcutil_res res = bbcutil_index_load(&idx, sidecar, stb.st_size, mtime);
+    unsigned lines = 0;
+    if (res == BBCUTIL_OK)
+        lines = idx.count;
+    else {
+        size_t prog_len;
+        bbcutil_kind kind = program_kind(fn, file, stb.st_size, &prog_len, &lines);
+        if (kind == BBCUTIL_UNKNOWN)
+            status = 3;
+        else if ((res = bbcutil_index_build(&idx, file, file + prog_len, kind, bbcutil_basic_depth)) != BBCUTIL_OK) {
+            fprintf(stderr, "bas2txt: out of memory converting %s\n", fn);
+            status = 2;
+        }
+        else if (save_index && (res = bbcutil_index_save(&idx, sidecar, stb.st_size, mtime)) != BBCUTIL_OK)
+            fprintf(stderr, "bas2txt: unable to write index '%s': %s\n", sidecar, bbcutil_rmsg(res));
+    }
+    mark = phase_lap(BBCUTIL_PH_SNIFF, mark);
+    if (!status) {
+        bbcutil_listing_clear(lst, file);
+        bbcutil_tmpl_vars vars = { fn, stb.st_size, lines, idx.kind, stb.st_mtime };
+        if (bbcutil_listing_range(lst, &idx, range->first, range->last, doindent) == BBCUTIL_OK) {
+            phase_lap(BBCUTIL_PH_DECODE, mark);
+            stats_count(stb.st_size, lines, lst);
+            status = emit_targets(&vars, targets, ntargets, false, lst);
+        }
+        else {
+            fprintf(stderr, "bas2txt: out of memory converting %s\n", fn);
+            status = 2;
+        }
+        bbcutil_index_free(&idx);
+    }
+    free(sidecar);
+    munmap(file, stb.st_size);
+    return status;
+}
+
+static int convert_tar(const struct target *targets, unsigned ntargets, bool doindent, const struct range *range,
+                       bbcutil_listing *lst)
+{
+    int status = 0;
+    bbcutil_member mem = { 0 };
+    bbcutil_res res;
+    uint64_t mark = phase_mark();
+    while ((res = bbcutil_tar_read(stdin, &mem)) == BBCUTIL_OK) {
+        cur_file = mem.name;
+        phase_lap(BBCUTIL_PH_LOAD, mark);
+        if (mem.size == 0) {
+            fprintf(stderr, "bas2txt: %s is an empty file\n", mem.name);
+            status = 2;
+            mark = phase_mark();
+            continue;
+        }
+        int cstat = convert(mem.name, mem.data, mem.data + mem.size, targets, ntargets, doindent, range, true, mem.mtime, lst);
+        if (cstat)
+            status = cstat;
+        mark = phase_mark();
+    }
+    if (res == BBCUTIL_EOF)
+        res = bbcutil_tar_end(stdout);
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "bas2txt: %s on archive\n", bbcutil_rmsg(res));
+        status = 2;
+    }
+    bbcutil_listing_free(lst);
+    bbcutil_tar_free(&mem);
+    return status;
+}
+
+static bool parse_target(const char *spec, struct target *tgt)
+{
+    const char *colon = strchr(spec, ':');
+    if (!colon || !colon[1]) {
+        fprintf(stderr, "bas2txt: target '%s' should be <style>[,<template>]:<output>\n", spec);
+        return false;
+    }
+    const char *comma = memchr(spec, ',', colon - spec);
+    const char *style_end = comma ? comma : colon;
+    bbcutil_res res = bbcutil_renderer_new(spec, style_end - spec, &tgt->rend);
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "bas2txt: %s '%.*s'\n", bbcutil_rmsg(res), (int)(style_end - spec), spec);
+        return false;
+    }
+    char *tmpl_name = NULL;
+    if (comma && !(tmpl_name = strndup(comma + 1, colon - comma - 1)))
+        return false;
+    tgt->tmpl = load_template(tmpl_name, "%p", NULL);
+    free(tmpl_name);
+    if (!tgt->tmpl)
+        return false;
+    tgt->output = colon + 1;
+    return true;
+}
+
+/* a range is A-B, A- or -B or a single line number. */
+
+static bool parse_range(const char *spec, struct range *range)
+{
+    char *end;
+    range->first = 0;
+    range->last = 0xffff;
+    if (*spec != '-') {
+        range->first = strtoul(spec, &end, 10);
+        if (end == spec)
+            return false;
+        if (!*end) {
+            range->last = range->first;
+            return true;
+        }
+        spec = end;
+    }
+    if (*spec++ != '-')
+        return false;
+    if (*spec) {
+        range->last = strtoul(spec, &end, 10);
+        if (*end || end == spec)
+            return false;
+    }
+    return range->first <= range->last;
+}
+
+/* A site is a page for each program, rendered in html through the
+ * template, and an index page for each directory listing the programs
+ * in it, with the work of rendering shared between threads.  A manifest
+ * in the output directory keeps the hash of each program, seeded with
+ * the template, and what the index says about it, so a program which
+ * has not changed since the last build is not rendered again. */
+
+#define SITE_MANIFEST ".bas2txt-site"
+/* as the suffix is not ".html" alone no program page can be an index */
+#define SITE_SUFFIX   ".list.html"
+#define SITE_SKIPPED  -1
+
+#define SITE_STYLE \
+    "    <style>\n" \
+    "body { font-family: monospace; }\n" \
+    "th, td { padding: 0 1em 0 0; text-align: left; }\n" \
+    ".lineno  { color: #046a28; }\n" \
+    ".token   { color: #0e229b; }\n" \
+    ".string  { color: #9b560e; }\n" \
+    ".skipeol { color: #af00d7; }\n" \
+    ".lineref, .call { color: inherit; }\n" \
+    ".defname  { font-weight: bold; }\n" \
+    ".dangling { background: #ffd7d7; text-decoration: wavy underline red; }\n" \
+    "    </style>\n"
+
+static const char site_page[] =
+    "<html>\n"
+    "  <head>\n"
+    "    <title>%f</title>\n"
+    SITE_STYLE
+    "  </head>\n"
+    "  <body>\n"
+    "    <p><a href=\"index.html\">Index</a> %f: %d, %l lines, %s bytes</p>\n"
+    "    <pre>%p</pre>\n"
+    "  </body>\n"
+    "</html>\n";
+
+struct site_entry {
+    char *path;
+    char *rel;
+    uint64_t hash;
+    size_t size;
+    unsigned lines;
+    bbcutil_kind kind;
+    bool walked;
+    int status;
+};
+
+struct site {
+    const char *outdir;
+    struct target tgt;
+    uint64_t seed;
+    bool doindent;
+    struct site_entry *entries;
+    unsigned count;
+    unsigned alloc;
+    struct site_entry *old;
+    unsigned nold;
+    pthread_mutex_t lock;
+};
+
+/* entries are sorted with '/' before any other character so that those
+ * in a directory, and everything below it, are together. */
+
+static int site_compare(const void *a, const void *b)
+{
+    const unsigned char *p = (const unsigned char *)((const struct site_entry *)a)->rel;
+    const unsigned char *q = (const unsigned char *)((const struct site_entry *)b)->rel;
+    while (*p && *p == *q) {
+        p++;
+        q++;
+    }
+    return (*p == '/' ? 1 : *p) - (*q == '/' ? 1 : *q);
+}
+
+static void site_free(struct site_entry *entries, unsigned count)
+{
+    for (unsigned ix = 0; ix < count; ix++) {
+        free(entries[ix].path);
+        free(entries[ix].rel);
+    }
+    free(entries);
+}
+
+static bool site_grow(struct site_entry **entries, unsigned count, unsigned *alloc)
+{
+    if (count < *alloc)
+        return true;
+    unsigned size = *alloc ? *alloc * 2 : 64;
+    struct site_entry *grown = realloc(*entries, size * sizeof(struct site_entry));
+    if (!grown)
+        return false;
+    *entries = grown;
+    *alloc = size;
+    return true;
+}
+
+/* the name within the site is the name given less any empty, current
+ * or parent directories so that every page is within the output. */
+
+static bool site_add(struct site *site, const char *path, const char *name, bool walked)
+{
+    if (!site_grow(&site->entries, site->count, &site->alloc))
+        return false;
+    char *rel = malloc(strlen(name) + 1);
+    char *copy = strdup(path);
+    if (!rel || !copy) {
+        free(rel);
+        free(copy);
+        return false;
+    }
+    char *ptr = rel;
+    while (*name) {
+        size_t len = strcspn(name, "/");
+        if (len && strncmp(name, ".", len) && strncmp(name, "..", len)) {
+            if (ptr > rel)
+                *ptr++ = '/';
+            memcpy(ptr, name, len);
+            ptr += len;
+        }
+        name += len;
+        if (*name)
+            name++;
+    }
+    *ptr = 0;
+    site->entries[site->count++] = (struct site_entry){ copy, rel, 0, 0, 0, BBCUTIL_UNKNOWN, walked, 0 };
+    return true;
+}
+
+static struct site *walk_site;
+static size_t walk_base;
+static int walk_status;
+
+static int site_walk(const char *fpath, const struct stat *sb, int type, struct FTW *ftw)
+{
+    if (ftw->level > 0 && fpath[ftw->base] == '.')
+        return type == FTW_D ? FTW_SKIP_SUBTREE : FTW_CONTINUE;
+    if (type == FTW_DNR) {
+        fprintf(stderr, "bas2txt: unable to read directory '%s'\n", fpath);
+        walk_status = 2;
+    }
+    else if (type == FTW_F && !site_add(walk_site, fpath, fpath + walk_base, true))
+        return FTW_STOP;
+    return FTW_CONTINUE;
+}
+
+static char *site_path(const char *outdir, const char *rel, const char *suffix)
+{
+    char *path;
+    if (asprintf(&path, "%s/%s%s", outdir, rel, suffix) < 0) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return NULL;
+    }
+    return path;
+}
+
+static bool make_dirs(char *path)
+{
+    for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = 0;
+        bool failed = mkdir(path, 0777) && errno != EEXIST;
+        if (failed)
+            fprintf(stderr, "bas2txt: unable to create directory '%s': %s\n", path, strerror(errno));
+        *slash = '/';
+        if (failed)
+            return false;
+    }
+    return true;
+}
+
+/* a manifest which is missing or cannot be read just means every
+ * program is rendered. */
+
+static void site_load_manifest(struct site *site)
+{
+    char *fn = site_path(site->outdir, SITE_MANIFEST, "");
+    FILE *fp = fn ? fopen(fn, "r") : NULL;
+    free(fn);
+    if (!fp)
+        return;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    unsigned alloc = 0;
+    while ((len = getline(&line, &size, fp)) > 0) {
+        if (line[len-1] == '\n')
+            line[--len] = 0;
+        struct site_entry ent = { 0 };
+        int kind, pos = 0;
+        if (sscanf(line, "%" SCNx64 " %zu %u %d %n", &ent.hash, &ent.size, &ent.lines, &kind, &pos) != 4 || !line[pos])
+            continue;
+        if (!site_grow(&site->old, site->nold, &alloc) || !(ent.rel = strdup(line + pos)))
+            break;
+        ent.kind = kind;
+        site->old[site->nold++] = ent;
+    }
+    free(line);
+    fclose(fp);
+    qsort(site->old, site->nold, sizeof(struct site_entry), site_compare);
+}
+
+static int site_save_manifest(const struct site *site)
+{
+    char *fn = site_path(site->outdir, SITE_MANIFEST, "");
+    char *tmp = site_path(site->outdir, SITE_MANIFEST, ".tmp");
+    int status = 2;
+    FILE *fp;
+    if (fn && tmp) {
+        if ((fp = fopen(tmp, "w"))) {
+            for (const struct site_entry *ent = site->entries; ent < site->entries + site->count; ent++)
+                fprintf(fp, "%016" PRIx64 " %zu %u %d %s\n", ent->hash, ent->size, ent->lines, ent->kind, ent->rel);
+            if (fclose(fp) || rename(tmp, fn)) {
+                fprintf(stderr, "bas2txt: unable to write manifest '%s': %s\n", fn, strerror(errno));
+                remove(tmp);
             }
-            if (ch >= 0x01 && ch <= 0x08)
-                fputs(low_tokens[ch-1], stdout);
             else
-                putchar(ch);
+                status = 0;
         }
+        else
+            fprintf(stderr, "bas2txt: unable to open '%s' for writing: %s\n", tmp, strerror(errno));
     }
-    putchar('\n');
-    if (doindent) {
-        /* an increase in indent is applied afterwards ready for the next line */
-        if (new_indent > indent)
-            indent = new_indent;
+    free(fn);
+    free(tmp);
+    return status;
+}
+
+static int site_render(const struct site *site, struct site_entry *ent, unsigned char *file, char *out, bbcutil_listing *lst)
+{
+    size_t prog_len;
+    uint64_t mark = phase_mark();
+    bbcutil_kind kind = program_kind(ent->walked ? NULL : ent->path, file, ent->size, &prog_len, &ent->lines);
+    mark = phase_lap(BBCUTIL_PH_SNIFF, mark);
+    if (kind == BBCUTIL_UNKNOWN)
+        return ent->walked ? SITE_SKIPPED : 3;
+    ent->kind = kind;
+    struct stat stb;
+    int64_t mtime = -1;
+    if (bbcutil_template_uses(site->tgt.tmpl, 't') && !stat(ent->path, &stb))
+        mtime = stb.st_mtime;
+    bbcutil_tmpl_vars vars = { ent->path, ent->size, ent->lines, kind, mtime, NULL, NULL, true };
+    bbcutil_listing_clear(lst, file);
+    if (bbcutil_listing_decode(lst, file, file + prog_len, kind, NULL, site->doindent) != BBCUTIL_OK
+        || (bbcutil_renderer_links(site->tgt.rend) && bbcutil_listing_resolve(lst) != BBCUTIL_OK)) {
+        fprintf(stderr, "bas2txt: out of memory converting %s\n", ent->path);
+        return 2;
     }
-    return indent;
+    phase_lap(BBCUTIL_PH_DECODE, mark);
+    stats_count(ent->size, ent->lines, lst);
+    if (!make_dirs(out))
+        return 2;
+    return emit_file(out, &site->tgt, &vars, lst);
 }
 
-static unsigned char *is_wilson(unsigned char *prog, unsigned char *file_end)
+/* a program is rendered unless its hash and size are as in the
+ * manifest and its page is still there. */
+
+static int site_build(const struct site *site, struct site_entry *ent, bbcutil_listing *lst)
 {
-    file_end -= 2;
-    while (prog <= file_end) {
-        if (prog[0] != 0x0d)
-            return NULL;
-        if (prog[1] == 0xff)
-            return prog;
-        prog += prog[3];
+    unsigned char *file_end;
+    cur_file = ent->path;
+    uint64_t mark = phase_mark();
+    unsigned char *file = bbcutil_load("bas2txt", ent->path, &file_end);
+    if (!file)
+        return 2;
+    ent->size = file_end - file;
+    ent->hash = bbcutil_hash(file, ent->size, site->seed);
+    phase_lap(BBCUTIL_PH_LOAD, mark);
+    int status = 2;
+    char *out = site_path(site->outdir, ent->rel, SITE_SUFFIX);
+    if (out) {
+        const struct site_entry *old = bsearch(ent, site->old, site->nold, sizeof(struct site_entry), site_compare);
+        struct stat stb;
+        if (old && old->hash == ent->hash && old->size == ent->size && !stat(out, &stb)) {
+            ent->lines = old->lines;
+            ent->kind = old->kind;
+            status = 0;
+        }
+        else
+            status = site_render(site, ent, file, out, lst);
+        free(out);
     }
-    return NULL;
+    free(file);
+    return status;
 }
 
-static void wilson2txt(unsigned char *prog, unsigned char *prog_end, const struct outcfg *ocfg, bool doindent)
+static void site_worker(bbcutil_work *work, void *ctx)
 {
-    unsigned indent = 0;
-    while (prog < prog_end) {
-        unsigned lineno = (prog[1] << 8) | prog[2];
-        unsigned len = prog[3];
-        indent = bas2txt(prog+4, len-4, lineno, indent, ocfg, doindent);
-        prog += len;
+    struct site *site = ctx;
+    bbcutil_listing *lst = bbcutil_listing_new();
+    bbcutil_stats *saved = stats;
+    bbcutil_stats own;
+    if (stats_mode) {
+        bbcutil_stats_init(&own);
+        stats = &own;
+    }
+    unsigned ix;
+    while (bbcutil_work_next(work, &ix)) {
+        struct site_entry *ent = site->entries + ix;
+        if (lst)
+            ent->status = site_build(site, ent, lst);
+        else {
+            fprintf(stderr, "bas2txt: out of memory converting %s\n", ent->path);
+            ent->status = 2;
+        }
+    }
+    bbcutil_listing_free(lst);
+    if (stats_mode) {
+        bbcutil_stats_collect(&own);
+        pthread_mutex_lock(&site->lock);
+        bbcutil_stats_merge(&run_stats, &own);
+        pthread_mutex_unlock(&site->lock);
+        stats = saved;
     }
 }
 
-static unsigned char *is_russell(unsigned char *prog, unsigned char *file_end)
+static void put_href(const char *name, size_t len, FILE *ofp)
 {
-    while (prog < file_end) {
-        if (prog[0] == 0x00 && prog[1] == 0xff && prog[2] == 0xff)
-            return prog;
-        prog += prog[0];
-        if (prog[-1] != 0x0d)
-            return NULL;
+    while (len--) {
+        int ch = (unsigned char)*name++;
+        if ((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')
+            || ch == '-' || ch == '.' || ch == '_' || ch == '~' || ch == '/')
+            putc(ch, ofp);
+        else
+            fprintf(ofp, "%%%02X", ch);
     }
-    return NULL;
 }
 
-static void russell2txt(unsigned char *prog, unsigned char *prog_end, const struct outcfg *ocfg, bool doindent)
+/* the index of a directory lists its programs and subdirectories, each
+ * of which is indexed in turn, from the entries first to last which are
+ * those with the directory as a prefix of dirlen characters. */
+
+static int site_index(const struct site *site, const char *dir, size_t dirlen, unsigned first, unsigned last)
 {
-    unsigned indent = 0;
-    while (prog < prog_end) {
-        unsigned len = prog[0];
-        unsigned lineno = prog[1] | (prog[2] << 8);
-        indent = bas2txt(prog + 3, len - 4, lineno, indent, ocfg, doindent);
-        prog += len;
+    char *fn;
+    if (asprintf(&fn, "%s/%.*sindex.html", site->outdir, (int)dirlen, dir) < 0) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
+    }
+    if (!make_dirs(fn)) {
+        free(fn);
+        return 2;
+    }
+    FILE *ofp = fopen(fn, "w");
+    if (!ofp) {
+        fprintf(stderr, "bas2txt: unable to open '%s' for writing: %s\n", fn, strerror(errno));
+        free(fn);
+        return 2;
+    }
+    fputs("<html>\n  <head>\n    <title>/", ofp);
+    bbcutil_html_write((const unsigned char *)dir, dirlen, ofp);
+    fputs("</title>\n" SITE_STYLE "  </head>\n  <body>\n    <h1>/", ofp);
+    bbcutil_html_write((const unsigned char *)dir, dirlen, ofp);
+    fputs("</h1>\n    <table>\n      <tr><th>Name</th><th>Dialect</th><th>Lines</th><th>Size</th></tr>\n", ofp);
+    if (dirlen)
+        fputs("      <tr><td><a href=\"../index.html\">../</a></td></tr>\n", ofp);
+    int status = 0;
+    unsigned ix = first;
+    while (ix < last) {
+        const struct site_entry *ent = site->entries + ix;
+        const char *name = ent->rel + dirlen;
+        const char *slash = strchr(name, '/');
+        if (slash) {
+            size_t sublen = slash - ent->rel + 1;
+            unsigned end = ix + 1;
+            while (end < last && !strncmp(site->entries[end].rel, ent->rel, sublen))
+                end++;
+            fputs("      <tr><td><a href=\"", ofp);
+            put_href(name, slash - name + 1, ofp);
+            fputs("index.html\">", ofp);
+            bbcutil_html_write((const unsigned char *)name, slash - name + 1, ofp);
+            fprintf(ofp, "</a></td><td colspan=\"3\">%u program%s</td></tr>\n", end - ix, end - ix == 1 ? "" : "s");
+            int istat = site_index(site, ent->rel, sublen, ix, end);
+            if (istat)
+                status = istat;
+            ix = end;
+        }
+        else {
+            size_t len = strlen(name);
+            fputs("      <tr><td><a href=\"", ofp);
+            put_href(name, len, ofp);
+            fputs(SITE_SUFFIX "\">", ofp);
+            bbcutil_html_write((const unsigned char *)name, len, ofp);
+            fprintf(ofp, "</a></td><td>%s</td><td>%u</td><td>%zu</td></tr>\n",
+                    bbcutil_kind_name(ent->kind), ent->lines, ent->size);
+            ix++;
+        }
+    }
+    fputs("    </table>\n  </body>\n</html>\n", ofp);
+    if (fclose(ofp)) {
+        fprintf(stderr, "bas2txt: write error on '%s': %s\n", fn, strerror(errno));
+        status = 2;
     }
+    free(fn);
+    return status;
 }
 
-static unsigned char *load_file(const char *fn, unsigned char **end)
+static bool site_has_dir(const struct site *site, const char *dir, size_t len)
 {
-    FILE *fp = fopen(fn, "rb");
-    if (fp) {
-        if (!fseek(fp, 0L, SEEK_END)) {
-            long size = ftell(fp);
-            if (size == 0)
-                fprintf(stderr, "bas2txt: %s is an empty file\n", fn);
-            else {
-                unsigned char *data = malloc(size);
-                if (data) {
-                    rewind(fp);
-                    if (fread(data, size, 1, fp) == 1) {
-                        fclose(fp);
-                        *end = data + size;
-                        return data;
-                    }
-                    else
-                        fprintf(stderr, "bas2txt: read error on %s: %s", fn, strerror(errno));
-                }
-                else
-                    fprintf(stderr, "bas2txt: out of memory reading %s\n", fn);
+    for (const struct site_entry *ent = site->entries; ent < site->entries + site->count; ent++)
+        if (!strncmp(ent->rel, dir, len))
+            return true;
+    return false;
+}
+
+/* pages left from programs no longer in the site are removed, as are
+ * the index pages of any directories that leaves empty. */
+
+static void site_prune(const struct site *site)
+{
+    for (const struct site_entry *old = site->old; old < site->old + site->nold; old++) {
+        if (bsearch(old, site->entries, site->count, sizeof(struct site_entry), site_compare))
+            continue;
+        char *fn = site_path(site->outdir, old->rel, SITE_SUFFIX);
+        if (fn)
+            remove(fn);
+        free(fn);
+        for (size_t len = strlen(old->rel); len--; ) {
+            if (old->rel[len] != '/')
+                continue;
+            if (site_has_dir(site, old->rel, len + 1))
+                break;
+            if (asprintf(&fn, "%s/%.*sindex.html", site->outdir, (int)len + 1, old->rel) >= 0) {
+                remove(fn);
+                fn[strlen(fn) - 10] = 0;
+                rmdir(fn);
+                free(fn);
             }
         }
+    }
+}
+
+static int build_site(const char *outdir, char **names, unsigned count, const char *tmpl_name, bool doindent)
+{
+    struct site site = { .outdir = outdir, .seed = doindent, .doindent = doindent };
+    if (bbcutil_renderer_new("html", 4, &site.tgt.rend) != BBCUTIL_OK) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
+    }
+    if (!(site.tgt.tmpl = load_template(tmpl_name, site_page, &site.seed)))
+        return 2;
+    walk_site = &site;
+    for (unsigned ix = 0; ix < count; ix++) {
+        struct stat stb;
+        bool added = true;
+        if (stat(names[ix], &stb)) {
+            fprintf(stderr, "bas2txt: unable to stat '%s': %s\n", names[ix], strerror(errno));
+            walk_status = 2;
+        }
+        else if (S_ISDIR(stb.st_mode)) {
+            /* the pages of a directory go under its own name so that two
+             * directories holding the same names do not clash. */
+            const char *name = names[ix];
+            size_t len = strlen(name);
+            while (len > 1 && name[len-1] == '/')
+                len--;
+            while (len > 0 && name[len-1] != '/')
+                len--;
+            walk_base = len;
+            added = nftw(names[ix], site_walk, 16, FTW_PHYS | FTW_ACTIONRETVAL) != FTW_STOP;
+        }
         else
-            fprintf(stderr, "bas2txt: seek error on %s: %s", fn, strerror(errno));
-        fclose(fp);
+            added = site_add(&site, names[ix], names[ix], false);
+        if (!added) {
+            fputs("bas2txt: out of memory\n", stderr);
+            return 2;
+        }
     }
-    else
-        fprintf(stderr, "bas2txt: unable to open '%s' for reading: %s", fn, strerror(errno));
-    return NULL;
-}
-
-static void template(const char *fn, unsigned char *tmpl, unsigned char *tmpl_end, unsigned char *prog, unsigned char *prog_end, const struct outcfg *ocfg,
-                     bool doindent, void (*func)(unsigned char *prog, unsigned char *prog_end, const struct outcfg *ocfg, bool doindent))
-{
-    unsigned char *ptr = tmpl;
-    while (ptr < tmpl_end) {
-        int ch = *ptr++;
-        if (ch == '%') {
-            fwrite(tmpl, ptr-tmpl-1, 1, stdout);
-            ch = *ptr++;
-            if (ch == 'f')
-                fputs(fn, stdout);
-            else if (ch == 'p')
-                func(prog, prog_end, ocfg, doindent);
-            else
-                putchar(ch);
-            tmpl = ptr;
+    int status = walk_status;
+
+    /* a program named twice is only rendered once but two programs that
+     * would share a page are an error. */
+    qsort(site.entries, site.count, sizeof(struct site_entry), site_compare);
+    unsigned kept = 0;
+    for (unsigned ix = 0; ix < site.count; ix++) {
+        struct site_entry *ent = site.entries + ix;
+        const struct site_entry *prev = kept ? site.entries + kept - 1 : NULL;
+        bool clash = prev && !strcmp(ent->rel, prev->rel);
+        if (clash && strcmp(ent->path, prev->path)) {
+            fprintf(stderr, "bas2txt: %s and %s would both be %s in the site\n", prev->path, ent->path, ent->rel);
+            status = 1;
+        }
+        if (!*ent->rel || clash) {
+            free(ent->path);
+            free(ent->rel);
         }
+        else
+            site.entries[kept++] = *ent;
     }
-    fwrite(tmpl, ptr-tmpl, 1, stdout);
+    site.count = kept;
+    site_load_manifest(&site);
+
+    pthread_mutex_init(&site.lock, NULL);
+    bbcutil_parallel(site.count, 0, site_worker, &site);
+
+    /* only the programs rendered are indexed. */
+    kept = 0;
+    for (unsigned ix = 0; ix < site.count; ix++) {
+        struct site_entry *ent = site.entries + ix;
+        if (ent->status) {
+            if (ent->status > 0)
+                status = ent->status;
+            free(ent->path);
+            free(ent->rel);
+        }
+        else
+            site.entries[kept++] = *ent;
+    }
+    site.count = kept;
+    site_prune(&site);
+    int istat = site_index(&site, "", 0, 0, site.count);
+    if (!istat)
+        istat = site_save_manifest(&site);
+    if (istat)
+        status = istat;
+    site_free(site.entries, site.count);
+    site_free(site.old, site.nold);
+    bbcutil_template_free(site.tgt.tmpl);
+    bbcutil_renderer_free(site.tgt.rend);
+    return status;
 }
 
-static const char usage[]  = "Usage: bas2txt [-c] [-d] [-h] <file> [ ... ]\n";
+#define BATCH_DEPTH 32
+
+static const char usage[]  = "Usage: bas2txt [-b] [-c] [-d] [-h] [-j] [-n] [-l <lines> [-i]] [-t <template>] <file> [ ... ]\n"
+                             "       bas2txt [-n] [-l <lines> [-i]] -m <style>[,<template>]:<output> [ -m ... ] <file> [ ... ]\n"
+                             "       bas2txt -a [<options>] < in.tar > out.tar\n"
+                             "       bas2txt [-n] [-t <template>] --site <outdir> <file-or-dir> [ ... ]\n"
+                             "       any of which can be given --stats[=json] to report on the run\n"
+                             "       or --trace <file> to write a Chrome trace of it\n";
+
+/* the time to flush what is left of the output is part of writing. */
+
+static int finish(int status)
+{
+    if (stats) {
+        uint64_t mark = bbcutil_clock();
+        fflush(stdout);
+        bbcutil_stats_lap(stats, BBCUTIL_PH_WRITE, mark);
+        bbcutil_stats_report("bas2txt", stats, stats_mode, stderr);
+    }
+    if (!bbcutil_trace_close("bas2txt") && !status)
+        status = 2;
+    return status;
+}
 
 int main(int argc, char **argv)
 {
-    const struct outcfg *ocfg = &cfg_plain;
+    const char *style = "plain";
     bool tmpl_next = false;
+    bool target_next = false;
+    bool range_next = false;
+    bool site_next = false;
+    bool trace_next = false;
     bool doindent = true;
+    bool archive = false;
+    bool save_index = false;
+    struct range range_buf;
+    const struct range *range = NULL;
     const char *tmpl_name = NULL;
+    const char *site = NULL;
+    const char *trace = NULL;
+    struct target *targets = calloc(argc, sizeof(struct target));
+    unsigned ntargets = 0;
+    if (!targets) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
+    }
     while (--argc) {
         const char *arg = *++argv;
         if (tmpl_next) {
             tmpl_name = arg;
             tmpl_next = false;
         }
+        else if (target_next) {
+            if (!parse_target(arg, targets + ntargets++))
+                return 1;
+            target_next = false;
+        }
+        else if (range_next) {
+            if (!parse_range(arg, &range_buf)) {
+                fprintf(stderr, "bas2txt: invalid line range '%s'\n%s", arg, usage);
+                return 1;
+            }
+            range = &range_buf;
+            range_next = false;
+        }
+        else if (site_next) {
+            site = arg;
+            site_next = false;
+        }
+        else if (trace_next) {
+            trace = arg;
+            trace_next = false;
+        }
         else {
             if (arg[0] != '-')
                 break;
             int opt = arg[1];
+            if (opt == '-') {
+                if (!strcmp(arg, "--jsonl"))
+                    opt = 'j';
+                else if (!strcmp(arg, "--binary"))
+                    opt = 'b';
+                else if (!strcmp(arg, "--lines"))
+                    opt = 'l';
+                else if (!strcmp(arg, "--index"))
+                    opt = 'i';
+                else if (!strcmp(arg, "--site"))
+                    opt = 's';
+                else if (!strcmp(arg, "--trace")) {
+                    trace_next = true;
+                    continue;
+                }
+                else if ((stats_mode = bbcutil_stats_option(arg))) {
+                    bbcutil_stats_init(&run_stats);
+                    stats = &run_stats;
+                    continue;
+                }
+                else {
+                    fprintf(stderr, "bas2txt: unrecognised option '%s'\n%s", arg, usage);
+                    return 1;
+                }
+            }
             switch(opt) {
+                case 'a':
+                    archive = true;
+                    break;
+                case 'b':
+                    style = "binary";
+                    break;
                 case 'c':
-                    ocfg = &cfg_colour;
+                    style = "colour";
                     break;
                 case 'd':
-                    ocfg = &cfg_dark;
+                    style = "dark";
                     break;
                 case 'h':
-                    ocfg = &cfg_html;
+                    style = "html";
+                    break;
+                case 'i':
+                    save_index = true;
+                    break;
+                case 'j':
+                    style = "jsonl";
+                    break;
+                case 'l':
+                    range_next = true;
+                    break;
+                case 'm':
+                    target_next = true;
+                    break;
+                case 's':
+                    site_next = true;
                     break;
                 case 't':
                     tmpl_next = true;
@@ -466,38 +1131,65 @@ int main(int argc, char **argv)
             }
         }
     }
-    if (argc == 0) {
+    if ((archive ? argc != 0 : argc == 0) || (site && (archive || range || ntargets))) {
         fputs(usage, stderr);
         return 1;
     }
-    unsigned char *tmpl_data, *tmpl_end;
-    if (tmpl_name) {
-        if (!(tmpl_data = load_file(tmpl_name, &tmpl_end)))
+    if (trace && !bbcutil_trace_open(trace)) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
+    }
+    if (site)
+        return finish(build_site(site, argv, argc, tmpl_name, doindent));
+    if (!ntargets) {
+        /* a single target written to stdout */
+        struct target *tgt = targets + ntargets++;
+        if (bbcutil_renderer_new(style, strlen(style), &tgt->rend) != BBCUTIL_OK) {
+            fputs("bas2txt: out of memory\n", stderr);
+            return 2;
+        }
+        if (!(tgt->tmpl = load_template(tmpl_name, "%p", NULL)))
             return 2;
     }
-    else {
-        tmpl_data = (unsigned char *)"%p";
-        tmpl_end = tmpl_data + 2;
+    bbcutil_listing *lst = bbcutil_listing_new();
+    if (!lst) {
+        fputs("bas2txt: out of memory\n", stderr);
+        return 2;
     }
+    if (archive)
+        return finish(convert_tar(targets, ntargets, doindent, range, lst));
     int status = 0;
+    if (range) {
+        while (argc--) {
+            int cstat = convert_mapped(*argv++, targets, ntargets, doindent, range, save_index, lst);
+            if (cstat)
+                status = cstat;
+        }
+        bbcutil_listing_free(lst);
+        return finish(status);
+    }
+    bbcutil_batch *batch = bbcutil_batch_open("bas2txt", argv, argc, BATCH_DEPTH);
+    if (!batch) {
+        fprintf(stderr, "bas2txt: out of memory\n");
+        return 2;
+    }
     while (argc--) {
-        const char *fn = *argv++;
+        const char *fn;
         unsigned char *file_end;
-        unsigned char *file = load_file(fn, &file_end);
+        uint64_t mark = phase_mark();
+        unsigned char *file = bbcutil_batch_next(batch, &fn, &file_end);
+        cur_file = fn;
+        phase_lap(BBCUTIL_PH_LOAD, mark);
         if (file) {
-            unsigned char *prog_end;
-            if ((prog_end = is_wilson(file, file_end)))
-                template(fn, tmpl_data, tmpl_end, file, prog_end, ocfg, doindent, wilson2txt);
-            else if ((prog_end = is_russell(file, file_end)))
-                template(fn, tmpl_data, tmpl_end, file, prog_end, ocfg, doindent, russell2txt);
-            else {
-                fprintf(stderr, "bas2txt: %s is not a BBC BASIC program or is corrupt\n", fn);
-                status = 3;
-            }
+            int cstat = convert(fn, file, file_end, targets, ntargets, doindent, NULL, false, -1, lst);
+            if (cstat)
+                status = cstat;
             free(file);
         }
         else
             status = 2;
     }
-    return status;
+    bbcutil_batch_close(batch);
+    bbcutil_listing_free(lst);
+    return finish(status);
 }
@@ -0,0 +1,619 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A program is crunched in two walks over its lines.  The first finds
+ * the lines referred to, anything that makes that incomplete, such as
+ * GOTO with a computed target, the names used and how often, and
+ * anything that makes renaming unsafe: EVAL, which can name variables
+ * in a string, or assembler, whose mnemonics look like variables.  The
+ * second writes each line again without its REMs and unneeded spaces
+ * and with shorter names.  Keywords are already tokens so no space is
+ * needed around them, only between two runs of plain text that would
+ * otherwise run together.  Star commands are passed to the OS as they
+ * are and DATA is read as it is, so both are left untouched. */
+
+#define TOK_ELSE  0x8b
+#define TOK_EVAL  0xa0
+#define TOK_USR   0xba
+#define TOK_CALL  0xd6
+#define TOK_CHAIN 0xd7
+#define TOK_FOR   0xe3
+#define TOK_REM   0xf4
+
+struct sym {
+    uint64_t hash;
+    const unsigned char *name;
+    unsigned len;
+    bbcutil_idtype type;
+    unsigned uses;
+    unsigned order;
+    char new_name[8];
+    unsigned new_len;
+    bool loop;
+    bool pinned;
+    bool promoted;
+};
+
+struct crunch {
+    struct sym *syms;
+    unsigned count;
+    unsigned size;
+    unsigned *slots;
+    unsigned mask;
+    uint8_t refs[BBCUTIL_REFS_SIZE];
+    bool computed;
+    bool eval;
+    bool chain;
+    bool call;
+    bool assembler;
+    bool strip_rems;
+    bool strip_spaces;
+    bool rename;
+    bool promote;
+    unsigned promoted;
+    size_t rem_bytes;
+    size_t space_bytes;
+    size_t name_bytes;
+    unsigned lines_removed;
+};
+
+static inline bool name_char(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '`';
+}
+
+static bool table_grow(struct crunch *c)
+{
+    unsigned size = c->slots ? (c->mask + 1) * 2 : 256;
+    unsigned *slots = calloc(size, sizeof(unsigned));
+    if (!slots)
+        return false;
+    for (unsigned ix = 0; ix < c->count; ix++) {
+        unsigned slot = c->syms[ix].hash & (size - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (size - 1);
+        slots[slot] = ix + 1;
+    }
+    free(c->slots);
+    c->slots = slots;
+    c->mask = size - 1;
+    return true;
+}
+
+static struct sym *table_find(const struct crunch *c, bbcutil_idtype type, const void *name, unsigned len, uint64_t hash)
+{
+    if (!c->slots)
+        return NULL;
+    unsigned slot = hash & c->mask;
+    unsigned ix;
+    while ((ix = c->slots[slot])) {
+        struct sym *sym = c->syms + ix - 1;
+        if (sym->hash == hash && sym->type == type && sym->len == len && !memcmp(sym->name, name, len))
+            return sym;
+        slot = (slot + 1) & c->mask;
+    }
+    return NULL;
+}
+
+/* arrays and variables of the same name are different symbols, as are
+ * procedures and functions. */
+
+static struct sym *table_get(struct crunch *c, bbcutil_idtype type, const unsigned char *name, unsigned len)
+{
+    uint64_t hash = bbcutil_hash(name, len, type);
+    struct sym *sym = table_find(c, type, name, len, hash);
+    if (sym)
+        return sym;
+    if ((c->count + 1) * 2 > (c->slots ? c->mask + 1 : 0) && !table_grow(c))
+        return NULL;
+    if (c->count == c->size) {
+        unsigned size = c->size ? c->size * 2 : 256;
+        struct sym *syms = realloc(c->syms, size * sizeof(struct sym));
+        if (!syms)
+            return NULL;
+        c->syms = syms;
+        c->size = size;
+    }
+    sym = c->syms + c->count;
+    memset(sym, 0, sizeof(struct sym));
+    sym->hash = hash;
+    sym->type = type;
+    sym->name = name;
+    sym->len = len;
+    sym->order = c->count++;
+    unsigned slot = hash & c->mask;
+    while (c->slots[slot])
+        slot = (slot + 1) & c->mask;
+    c->slots[slot] = c->count;
+    return sym;
+}
+
+/* EVAL can name variables in a string and the mnemonics of assembler
+ * look like variables so renaming is unsafe in either.  For promotion
+ * the counters of FOR loops are noted, as are integer variables passed
+ * to machine code in a CALL, which keep their names. */
+
+static bool scan_line(struct crunch *c, const bbcutil_line *line)
+{
+    const unsigned char *star = bbcutil_star_command(line);
+    const unsigned char *end = star ? star : line->text_end;
+    const unsigned char *loops[128];
+    const unsigned char *calls[128][2];
+    unsigned nloops = 0, ncalls = 0;
+    bool after_for = false;
+    bool in_call = false;
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bbcutil_toks_init(&it, line, BBCUTIL_WILSON);
+    while (bbcutil_toks_next(&it, &tok) && tok.ptr < end) {
+        if (tok.type == BBCUTIL_TOK_PLAIN) {
+            const unsigned char *stop = tok.end < end ? tok.end : end;
+            if (memchr(tok.ptr, '[', stop - tok.ptr))
+                c->assembler = true;
+            if (after_for) {
+                const unsigned char *ptr = tok.ptr;
+                while (ptr < stop && *ptr == ' ')
+                    ptr++;
+                if (ptr < stop) {
+                    loops[nloops++] = ptr;
+                    after_for = false;
+                }
+            }
+            const unsigned char *colon;
+            if (in_call && (colon = memchr(tok.ptr, ':', stop - tok.ptr))) {
+                calls[ncalls - 1][1] = colon;
+                in_call = false;
+            }
+            continue;
+        }
+        after_for = false;
+        if (tok.type != BBCUTIL_TOK_KEYWORD)
+            continue;
+        switch(tok.tok) {
+            case TOK_ELSE:
+                if (in_call) {
+                    calls[ncalls - 1][1] = tok.ptr;
+                    in_call = false;
+                }
+                break;
+            case TOK_EVAL:
+                c->eval = true;
+                break;
+            case TOK_CHAIN:
+                c->chain = true;
+                break;
+            case TOK_USR:
+                c->call = true;
+                break;
+            case TOK_CALL:
+                c->call = true;
+                if (!in_call) {
+                    calls[ncalls][0] = tok.end;
+                    calls[ncalls++][1] = end;
+                    in_call = true;
+                }
+                break;
+            case TOK_FOR:
+                after_for = true;
+                break;
+        }
+    }
+
+    bbcutil_idents ids;
+    bbcutil_ident id;
+    bbcutil_idents_init(&ids, line);
+    while (bbcutil_idents_next(&ids, &id)) {
+        if (star && id.name >= star)
+            break;
+        if (id.type == BBCUTIL_ID_LINEREF)
+            continue;
+        struct sym *sym = table_get(c, id.type, id.name, id.len);
+        if (!sym)
+            return false;
+        sym->uses++;
+        if (id.type == BBCUTIL_ID_VAR && id.name[id.len - 1] == '%') {
+            for (unsigned ix = 0; ix < nloops; ix++)
+                if (loops[ix] == id.name)
+                    sym->loop = true;
+            for (unsigned ix = 0; ix < ncalls; ix++)
+                if (id.name >= calls[ix][0] && id.name < calls[ix][1])
+                    sym->pinned = true;
+        }
+    }
+    return true;
+}
+
+/* New names are lower case, so never the start of a keyword, in order
+ * a, b, ... z, aa, ba, ... and never one already in use.  A single
+ * upper case letter with % is a resident integer, shared with machine
+ * code and kept over CHAIN, so those keep their names. */
+
+static unsigned gen_name(unsigned n, char *buf)
+{
+    static const char rest[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    unsigned len = 0;
+    buf[len++] = 'a' + n % 26;
+    n /= 26;
+    while (n) {
+        n--;
+        buf[len++] = rest[n % 36];
+        n /= 36;
+    }
+    return len;
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+    const struct sym *x = *(const struct sym * const *)a;
+    const struct sym *y = *(const struct sym * const *)b;
+    if (x->uses != y->uses)
+        return x->uses > y->uses ? -1 : 1;
+    return x->order < y->order ? -1 : 1;
+}
+
+static inline bool resident(const struct sym *sym)
+{
+    return sym->type == BBCUTIL_ID_VAR && sym->len == 2 && sym->name[1] == '%' && sym->name[0] >= 'A' && sym->name[0] <= 'Z';
+}
+
+/* Integer variables are promoted to the resident integers the program
+ * does not use, which the interpreter finds without a search, loop
+ * counters first and then the most used.  A%, C%, X% and Y% set the
+ * registers for machine code so are not taken if it has CALL or USR. */
+
+static int promote_cmp(const void *a, const void *b)
+{
+    const struct sym *x = *(const struct sym * const *)a;
+    const struct sym *y = *(const struct sym * const *)b;
+    if (x->loop != y->loop)
+        return x->loop ? -1 : 1;
+    return sym_cmp(a, b);
+}
+
+static bool promote(struct crunch *c)
+{
+    struct sym **order = malloc(c->count * sizeof(struct sym *) + 1);
+    if (!order)
+        return false;
+    unsigned count = 0;
+    for (unsigned ix = 0; ix < c->count; ix++) {
+        struct sym *sym = c->syms + ix;
+        if (sym->type == BBCUTIL_ID_VAR && sym->name[sym->len - 1] == '%' && !resident(sym) && !sym->pinned)
+            order[count++] = sym;
+    }
+    qsort(order, count, sizeof(struct sym *), promote_cmp);
+    char name[2] = { 'A' - 1, '%' };
+    for (unsigned ix = 0; ix < count; ix++) {
+        while (++name[0] <= 'Z') {
+            if (c->call && strchr("ACXY", name[0]))
+                continue;
+            if (!table_find(c, BBCUTIL_ID_VAR, name, 2, bbcutil_hash(name, 2, BBCUTIL_ID_VAR)))
+                break;
+        }
+        if (name[0] > 'Z')
+            break;
+        struct sym *sym = order[ix];
+        memcpy(sym->new_name, name, 2);
+        sym->new_len = 2;
+        sym->promoted = true;
+        c->promoted++;
+    }
+    free(order);
+    return true;
+}
+
+static unsigned name_space(const struct sym *sym)
+{
+    unsigned suffix = 0;
+    if (sym->type == BBCUTIL_ID_VAR || sym->type == BBCUTIL_ID_ARRAY) {
+        int ch = sym->name[sym->len - 1];
+        suffix = ch == '%' ? 1 : ch == '$' ? 2 : 0;
+    }
+    return sym->type * 3 + suffix;
+}
+
+static bool assign_names(struct crunch *c)
+{
+    struct sym **order = malloc(c->count * sizeof(struct sym *) + 1);
+    if (!order)
+        return false;
+    for (unsigned ix = 0; ix < c->count; ix++)
+        order[ix] = c->syms + ix;
+    qsort(order, c->count, sizeof(struct sym *), sym_cmp);
+    unsigned next[BBCUTIL_ID_LINEREF * 3];
+    memset(next, 0, sizeof(next));
+    for (unsigned ix = 0; ix < c->count; ix++) {
+        struct sym *sym = order[ix];
+        if (resident(sym) || sym->promoted)
+            continue;
+        unsigned ns = name_space(sym);
+        unsigned suffix = ns % 3 ? 1 : 0;
+        char cand[sizeof(sym->new_name)];
+        unsigned len;
+        for (;;) {
+            len = gen_name(next[ns], cand);
+            if (suffix)
+                cand[len++] = sym->name[sym->len - 1];
+            if (!table_find(c, sym->type, cand, len, bbcutil_hash(cand, len, sym->type)))
+                break;
+            next[ns]++;
+        }
+        if (len < sym->len) {
+            memcpy(sym->new_name, cand, len);
+            sym->new_len = len;
+            next[ns]++;
+        }
+    }
+    free(order);
+    return true;
+}
+
+/* Output of the text of a line.  Spaces are dropped as they are met
+ * and one put back only if the text either side would otherwise run
+ * together, as two names or numbers or two strings would. */
+
+#define CL_OTHER 0
+#define CL_WORD  1
+#define CL_QUOTE 2
+
+struct out {
+    unsigned char *ptr;
+    unsigned char *start;
+    unsigned last;
+    bool pending;
+};
+
+static void put(struct crunch *c, struct out *o, int ch, unsigned cls)
+{
+    if (o->pending) {
+        if ((o->last == CL_WORD && cls == CL_WORD && ch != '%' && ch != '$') || (o->last == CL_QUOTE && ch == '"')) {
+            *o->ptr++ = ' ';
+            c->space_bytes--;
+        }
+        o->pending = false;
+    }
+    *o->ptr++ = ch;
+    o->last = cls;
+}
+
+static void put_plain(struct crunch *c, struct out *o, int ch)
+{
+    put(c, o, ch, name_char(ch) || ch == '.' || ch == '%' || ch == '$' ? CL_WORD : CL_OTHER);
+}
+
+struct span {
+    const unsigned char *name;
+    const struct sym *sym;
+};
+
+static size_t crunch_line(struct crunch *c, const bbcutil_line *line, unsigned char *text, struct span *spans)
+{
+    const unsigned char *star = bbcutil_star_command(line);
+    unsigned nspans = 0;
+    if (c->rename || c->promoted) {
+        bbcutil_idents it;
+        bbcutil_ident id;
+        bbcutil_idents_init(&it, line);
+        while (bbcutil_idents_next(&it, &id) && !(star && id.name >= star)) {
+            if (id.type != BBCUTIL_ID_LINEREF) {
+                const struct sym *sym = table_find(c, id.type, id.name, id.len, bbcutil_hash(id.name, id.len, id.type));
+                if (sym && sym->new_len) {
+                    spans[nspans].name = id.name;
+                    spans[nspans++].sym = sym;
+                }
+            }
+        }
+    }
+    struct out o = { text, text, CL_OTHER, false };
+    unsigned span_ix = 0;
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bbcutil_toks_init(&it, line, BBCUTIL_WILSON);
+    while (bbcutil_toks_next(&it, &tok)) {
+        switch(tok.type) {
+            case BBCUTIL_TOK_PLAIN:
+                for (const unsigned char *ptr = tok.ptr; ptr < tok.end;) {
+                    if (ptr == star) {
+                        put(c, &o, *ptr++, CL_OTHER);
+                        while (ptr < line->text_end)
+                            *o.ptr++ = *ptr++;
+                        return o.ptr - text;
+                    }
+                    if (span_ix < nspans && ptr == spans[span_ix].name) {
+                        const struct sym *sym = spans[span_ix++].sym;
+                        for (unsigned ix = 0; ix < sym->new_len; ix++)
+                            put_plain(c, &o, sym->new_name[ix]);
+                        c->name_bytes += sym->len - sym->new_len;
+                        ptr += sym->len;
+                    }
+                    else if (*ptr == ' ' && c->strip_spaces) {
+                        o.pending = true;
+                        c->space_bytes++;
+                        ptr++;
+                    }
+                    else
+                        put_plain(c, &o, *ptr++);
+                }
+                break;
+            case BBCUTIL_TOK_STRING:
+                put(c, &o, '"', CL_QUOTE);
+                for (const unsigned char *ptr = tok.ptr + 1; ptr < tok.end; ptr++)
+                    *o.ptr++ = *ptr;
+                o.last = tok.tok ? CL_QUOTE : CL_OTHER;
+                break;
+            case BBCUTIL_TOK_TAIL:
+                if (tok.tok == TOK_REM && c->strip_rems) {
+                    unsigned char *keep = o.ptr;
+                    while (keep > text && keep[-1] == ' ')
+                        keep--;
+                    if (keep > text && keep[-1] == ':') {
+                        keep--;
+                        while (keep > text && keep[-1] == ' ')
+                            keep--;
+                    }
+                    c->rem_bytes += (o.ptr - keep) + (tok.end - tok.ptr) + 1;
+                    o.ptr = keep;
+                    o.pending = false;
+                    return o.ptr - text;
+                }
+                put(c, &o, tok.tok, CL_OTHER);
+                for (const unsigned char *ptr = tok.ptr; ptr < tok.end; ptr++)
+                    *o.ptr++ = *ptr;
+                break;
+            default:
+                put(c, &o, tok.ptr[0], CL_OTHER);
+                for (const unsigned char *ptr = tok.ptr + 1; ptr < tok.end; ptr++)
+                    *o.ptr++ = *ptr;
+        }
+    }
+    return o.ptr - text;
+}
+
+static unsigned char *crunch(struct crunch *c, const unsigned char *prog, const unsigned char *prog_end,
+                             const unsigned char *file_end, bbcutil_kind kind, size_t *out_size)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    c->computed = !bbcutil_line_targets(prog, prog_end, kind, c->refs);
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line))
+        if (!scan_line(c, &line))
+            return NULL;
+    if (c->assembler)
+        c->strip_spaces = false;
+    if (c->eval || c->assembler)
+        c->rename = c->promote = false;
+    if (c->chain)
+        c->promote = false;
+    if ((c->promote && !promote(c)) || (c->rename && !assign_names(c)))
+        return NULL;
+
+    unsigned char *out = malloc(file_end - prog);
+    struct span *spans = malloc(256 * sizeof(struct span));
+    if (!out || !spans) {
+        free(out);
+        free(spans);
+        return NULL;
+    }
+    unsigned char *optr = out;
+    unsigned hdr = kind == BBCUTIL_RUSSELL ? 3 : 4;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        size_t rem_bytes = c->rem_bytes;
+        size_t len = crunch_line(c, &line, optr + hdr, spans);
+        if (!len && c->rem_bytes > rem_bytes && !c->computed
+            && !(c->refs[line.lineno >> 3] & (1 << (line.lineno & 7)))) {
+            c->rem_bytes += hdr + (kind == BBCUTIL_RUSSELL);
+            c->lines_removed++;
+            continue;
+        }
+        if (kind == BBCUTIL_RUSSELL) {
+            optr[0] = len + 4;
+            optr[1] = line.lineno;
+            optr[2] = line.lineno >> 8;
+            optr[len + 3] = 0x0d;
+            optr += len + 4;
+        }
+        else {
+            optr[0] = 0x0d;
+            optr[1] = line.lineno >> 8;
+            optr[2] = line.lineno;
+            optr[3] = len + 4;
+            optr += len + 4;
+        }
+    }
+    memcpy(optr, lines.ptr, file_end - lines.ptr);
+    optr += file_end - lines.ptr;
+    free(spans);
+    *out_size = optr - out;
+    return out;
+}
+
+static const char usage[] = "Usage: bascrunch [-n] [-p] [-r] [-s] <bas-in> [<bas-out>]\n";
+
+int main(int argc, char **argv)
+{
+    struct crunch c;
+    memset(&c, 0, sizeof(c));
+    c.strip_rems = c.strip_spaces = c.rename = true;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 'n':
+                c.rename = false;
+                break;
+            case 'p':
+                c.promote = true;
+                break;
+            case 'r':
+                c.strip_rems = false;
+                break;
+            case 's':
+                c.strip_spaces = false;
+                break;
+            case 0:
+                fprintf(stderr, "bascrunch: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "bascrunch: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc < 1 || argc > 2) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    const char *in_fn = argv[0];
+    const char *out_fn = argc == 2 ? argv[1] : in_fn;
+    unsigned char *file_end;
+    unsigned char *file = bbcutil_load("bascrunch", in_fn, &file_end);
+    if (!file)
+        return 2;
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, file_end - file, &fmt);
+    if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+        fprintf(stderr, "bascrunch: %s is not a BBC BASIC program or is corrupt\n", in_fn);
+        free(file);
+        return 3;
+    }
+    bool want_rename = c.rename || c.promote;
+    bool want_promote = c.promote;
+    size_t out_size;
+    unsigned char *out = crunch(&c, file, file + fmt.prog_len, file_end, kind, &out_size);
+    int status;
+    if (!out) {
+        fputs("bascrunch: out of memory\n", stderr);
+        status = 2;
+    }
+    else {
+        status = bbcutil_save("bascrunch", out_fn, out, out_size) ? 0 : 2;
+        if (!status) {
+            printf("%s: %zu bytes crunched to %zu, saving %zu: %zu in REMs (%u lines removed), %zu in spaces, %zu in names\n",
+                   in_fn, (size_t)(file_end - file), out_size, (size_t)(file_end - file) - out_size,
+                   c.rem_bytes, c.lines_removed, c.space_bytes, c.name_bytes);
+            for (unsigned ix = 0; ix < c.count; ix++) {
+                const struct sym *sym = c.syms + ix;
+                if (sym->promoted)
+                    printf("%s: %.*s promoted to %.2s (%s%u uses)\n", in_fn, (int)sym->len, sym->name, sym->new_name,
+                           sym->loop ? "loop counter, " : "", sym->uses);
+            }
+            if (want_rename && c.eval)
+                printf("%s: names kept as the program uses EVAL\n", in_fn);
+            else if (want_promote && c.chain)
+                printf("%s: no integers promoted as the program uses CHAIN\n", in_fn);
+            if (c.assembler)
+                printf("%s: spaces and names kept as the program contains assembler\n", in_fn);
+            if (c.strip_rems && c.computed)
+                printf("%s: no lines removed as the program has computed line numbers\n", in_fn);
+        }
+        free(out);
+    }
+    free(c.slots);
+    free(c.syms);
+    free(file);
+    return status;
+}
@@ -1,37 +1,145 @@
 #include "basdata.h"
+#include "bbcutil.h"
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* With --stats the statistics of the run, otherwise NULL.  Reading an
+ * item is counted as decoding it and formatting it as rendering, each
+ * item being a line of output. */
+
+static bbcutil_stats *stats;
+static int stats_mode;
+
+static inline uint64_t stats_mark(void)
+{
+    return stats ? bbcutil_clock() : 0;
+}
+
+static inline uint64_t stats_lap(bbcutil_phase phase, uint64_t mark)
+{
+    return stats ? bbcutil_stats_lap(stats, phase, mark) : 0;
+}
+
+static int basdata2txt(const char *fn, FILE *fp, FILE *ofp)
+{
+    basdata_var var;
+    basdata_res res;
+    uint64_t mark = stats_mark();
+    while ((res = basdata_readv(fp, &var)) == BASDATA_OK) {
+        mark = stats_lap(BBCUTIL_PH_DECODE, mark);
+        int len = 0;
+        switch(var.type) {
+            case BASDATA_STRING:
+                if (var.u.s.len)
+                    len = fprintf(ofp, "S: %.*s\n", var.u.s.len, var.u.s.str);
+                else
+                    len = fputs("S:\n", ofp) < 0 ? 0 : 3;
+                break;
+            case BASDATA_INTEGER:
+                len = fprintf(ofp, "I: %12d 0x%08X\n", var.u.i, var.u.i);
+                break;
+            case BASDATA_FLOAT:
+                len = fprintf(ofp, "F: %g\n", var.u.f);
+            default:
+                break;
+        }
+        if (stats) {
+            mark = bbcutil_stats_lap(stats, BBCUTIL_PH_RENDER, mark);
+            stats->bytes_out += len > 0 ? len : 0;
+            stats->lines++;
+        }
+    }
+    if (stats) {
+        long pos = ftell(fp);
+        stats->files++;
+        stats->bytes_in += pos > 0 ? pos : 0;
+    }
+    if (res != BASDATA_EOF) {
+        fprintf(stderr, "basdata2txt: %s on %s\n", basdata_rmsg(res), fn);
+        return 1;
+    }
+    return 0;
+}
+
+static int basdata2tar(void)
+{
+    int status = 0;
+    bbcutil_member mem = { 0 };
+    bbcutil_res res;
+    uint64_t mark = stats_mark();
+    while ((res = bbcutil_tar_read(stdin, &mem)) == BBCUTIL_OK) {
+        char *text;
+        size_t size;
+        FILE *ofp = open_memstream(&text, &size);
+        if (!ofp) {
+            res = BBCUTIL_NOMEM;
+            break;
+        }
+        stats_lap(BBCUTIL_PH_LOAD, mark);
+        if (mem.size) {
+            FILE *fp = fmemopen(mem.data, mem.size, "rb");
+            if (!fp) {
+                fclose(ofp);
+                free(text);
+                res = BBCUTIL_NOMEM;
+                break;
+            }
+            if (basdata2txt(mem.name, fp, ofp))
+                status = 1;
+            fclose(fp);
+        }
+        fclose(ofp);
+        mark = stats_mark();
+        res = bbcutil_tar_write(stdout, mem.name, text, size, mem.mtime);
+        free(text);
+        mark = stats_lap(BBCUTIL_PH_WRITE, mark);
+        if (res != BBCUTIL_OK)
+            break;
+    }
+    if (res == BBCUTIL_EOF)
+        res = bbcutil_tar_end(stdout);
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "basdata2txt: %s on archive\n", bbcutil_rmsg(res));
+        status = 1;
+    }
+    bbcutil_tar_free(&mem);
+    return status;
+}
+
+/* the time to flush what is left of the output is part of writing. */
+
+static int finish(int status)
+{
+    if (stats) {
+        uint64_t mark = bbcutil_clock();
+        fflush(stdout);
+        bbcutil_stats_lap(stats, BBCUTIL_PH_WRITE, mark);
+        bbcutil_stats_report("basdata2txt", stats, stats_mode, stderr);
+    }
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     int status = 0;
+    bbcutil_stats run_stats;
+    if (argc > 1 && (stats_mode = bbcutil_stats_option(argv[1]))) {
+        bbcutil_stats_init(&run_stats);
+        stats = &run_stats;
+        argv++;
+        argc--;
+    }
+    if (argc == 2 && !strcmp(argv[1], "-a"))
+        return finish(basdata2tar());
     while (--argc) {
         const char *fn = *++argv;
+        uint64_t mark = stats_mark();
         FILE *fp = fopen(fn, "rb");
+        stats_lap(BBCUTIL_PH_LOAD, mark);
         if (fp) {
-            basdata_var var;
-            basdata_res res;
-            while ((res = basdata_readv(fp, &var)) == BASDATA_OK) {
-                switch(var.type) {
-                    case BASDATA_STRING:
-                        if (var.u.s.len)
-                            printf("S: %.*s\n", var.u.s.len, var.u.s.str);
-                        else
-                            fputs("S:\n", stdout);
-                        break;
-                    case BASDATA_INTEGER:
-                        printf("I: %12d 0x%08X\n", var.u.i, var.u.i);
-                        break;
-                    case BASDATA_FLOAT:
-                        printf("F: %g\n", var.u.f);
-                    default:
-                        break;
-                }
-            }
-            if (res != BASDATA_EOF) {
+            if (basdata2txt(fn, fp, stdout))
                 status = 1;
-                fprintf(stderr, "basdata2txt: %s on %s\n", basdata_rmsg(res), fn);
-            }
             fclose(fp);
         }
         else {
@@ -39,5 +147,5 @@ int main(int argc, char **argv)
             status = 1;
         }
     }
-    return status;
+    return finish(status);
 }
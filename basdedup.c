@@ -0,0 +1,301 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Each program is reduced to a fingerprint of its normalised lines:
+ * the token bytes without the line number, spaces outside strings or
+ * the values of line number references, so renumbered and respaced
+ * copies match.  The fingerprint is a hash of the whole sequence of
+ * lines, to find identical programs, and a MinHash signature of the set
+ * of lines, to find near duplicates.  Only the fingerprints are kept,
+ * so memory is bounded by the number of programs, not their size. */
+
+#define MINHASHES 64
+#define BANDS     16
+#define ROWS      (MINHASHES / BANDS)
+
+struct sig {
+    uint64_t whole;
+    uint32_t mins[MINHASHES];
+    unsigned lines;
+    bool loaded;
+    bool program;
+};
+
+struct job {
+    char **names;
+    struct sig *sigs;
+    unsigned count;
+};
+
+static uint64_t mh_mul[MINHASHES];
+static uint64_t mh_add[MINHASHES];
+
+static void minhash_init(void)
+{
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (int i = 0; i < MINHASHES; i++) {
+        state = bbcutil_hash(&state, sizeof(state), i);
+        mh_mul[i] = state | 1;
+        state = bbcutil_hash(&state, sizeof(state), i);
+        mh_add[i] = state;
+    }
+}
+
+static uint64_t norm_hash(const bbcutil_line *line, bbcutil_kind kind)
+{
+    unsigned char buf[256];
+    unsigned char *ptr = buf;
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bbcutil_toks_init(&it, line, kind);
+    while (bbcutil_toks_next(&it, &tok)) {
+        switch(tok.type) {
+            case BBCUTIL_TOK_KEYWORD:
+            case BBCUTIL_TOK_LINENO:
+                *ptr++ = tok.tok;
+                break;
+            case BBCUTIL_TOK_STRING:
+                memcpy(ptr, tok.ptr, tok.end - tok.ptr);
+                ptr += tok.end - tok.ptr;
+                break;
+            case BBCUTIL_TOK_TAIL:
+                *ptr++ = tok.tok;
+                /* fall through */
+            case BBCUTIL_TOK_PLAIN:
+                for (const unsigned char *p = tok.ptr; p < tok.end; p++)
+                    if (*p != ' ')
+                        *ptr++ = *p;
+                break;
+        }
+    }
+    return bbcutil_hash(buf, ptr - buf, 0);
+}
+
+static void fingerprint(struct sig *sig, const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    memset(sig->mins, 0xff, sizeof(sig->mins));
+    sig->whole = 0;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        uint64_t hash = norm_hash(&line, kind);
+        sig->whole = bbcutil_hash(&hash, sizeof(hash), sig->whole);
+        for (int i = 0; i < MINHASHES; i++) {
+            uint32_t value = (hash * mh_mul[i] + mh_add[i]) >> 32;
+            if (value < sig->mins[i])
+                sig->mins[i] = value;
+        }
+        sig->lines++;
+    }
+}
+
+static void worker(bbcutil_work *work, void *ctx)
+{
+    struct job *job = ctx;
+    unsigned ix;
+    while (bbcutil_work_next(work, &ix)) {
+        struct sig *sig = job->sigs + ix;
+        unsigned char *end;
+        unsigned char *data = bbcutil_load("basdedup", job->names[ix], &end);
+        if (data) {
+            bbcutil_fmt fmt;
+            bbcutil_kind kind = bbcutil_sniff(data, end - data, &fmt);
+            if (kind == BBCUTIL_WILSON || kind == BBCUTIL_RUSSELL || kind == BBCUTIL_COMAL) {
+                fingerprint(sig, data, data + fmt.prog_len, kind);
+                sig->program = true;
+            }
+            sig->loaded = true;
+            free(data);
+        }
+    }
+}
+
+/* Near duplicates are found by locality sensitive hashing: the
+ * signature is cut into bands and programs with any band the same are
+ * candidates, kept if their signatures agree closely enough.  Clusters
+ * are the connected components, each named by its first program. */
+
+struct band {
+    uint64_t key;
+    unsigned prog;
+};
+
+static int band_cmp(const void *a, const void *b)
+{
+    const struct band *x = a;
+    const struct band *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->prog < y->prog ? -1 : x->prog > y->prog;
+}
+
+static unsigned similarity(const struct sig *a, const struct sig *b)
+{
+    unsigned same = 0;
+    for (int i = 0; i < MINHASHES; i++)
+        same += a->mins[i] == b->mins[i];
+    return same * 100 / MINHASHES;
+}
+
+static unsigned find(unsigned *parent, unsigned ix)
+{
+    while (parent[ix] != ix)
+        ix = parent[ix] = parent[parent[ix]];
+    return ix;
+}
+
+static void join(unsigned *parent, unsigned a, unsigned b)
+{
+    a = find(parent, a);
+    b = find(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else
+        parent[a] = b;
+}
+
+/* members of a bucket are compared with the few before them, enough
+ * to connect a cluster without comparing every pair of a large one. */
+
+#define BUCKET_TRIES 8
+
+static bool cluster(const struct sig *sigs, unsigned count, unsigned threshold, unsigned *parent)
+{
+    struct band *bands = malloc((size_t)count * BANDS * sizeof(struct band));
+    if (!bands)
+        return false;
+    size_t nbands = 0;
+    for (unsigned ix = 0; ix < count; ix++) {
+        parent[ix] = ix;
+        if (sigs[ix].program)
+            for (int b = 0; b < BANDS; b++) {
+                bands[nbands].key = bbcutil_hash(sigs[ix].mins + b * ROWS, ROWS * sizeof(uint32_t), b);
+                bands[nbands++].prog = ix;
+            }
+    }
+    qsort(bands, nbands, sizeof(struct band), band_cmp);
+    for (size_t start = 0, end; start < nbands; start = end) {
+        for (end = start + 1; end < nbands && bands[end].key == bands[start].key; end++) {
+            const struct sig *sig = sigs + bands[end].prog;
+            size_t from = end - start > BUCKET_TRIES ? end - BUCKET_TRIES : start;
+            for (size_t i = from; i < end; i++) {
+                const struct sig *other = sigs + bands[i].prog;
+                if (sig->whole == other->whole || similarity(sig, other) >= threshold) {
+                    join(parent, bands[i].prog, bands[end].prog);
+                    break;
+                }
+            }
+        }
+    }
+    free(bands);
+    return true;
+}
+
+static const char usage[] = "Usage: basdedup [-j <threads>] [-t <percent>] <file> [ ... ]\n";
+
+int main(int argc, char **argv)
+{
+    int threads = 0;
+    unsigned threshold = 80;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        const char *value = NULL;
+        if (opt == 'j' || opt == 't') {
+            if (arg[2])
+                value = arg + 2;
+            else if (argc > 1) {
+                value = *++argv;
+                --argc;
+            }
+            else {
+                fprintf(stderr, "basdedup: missing value for '%c'\n%s", opt, usage);
+                return 1;
+            }
+        }
+        switch(opt) {
+            case 'j':
+                threads = atoi(value);
+                break;
+            case 't':
+                threshold = atoi(value);
+                if (threshold < 1 || threshold > 100) {
+                    fprintf(stderr, "basdedup: threshold should be 1 to 100\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 0:
+                fprintf(stderr, "basdedup: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "basdedup: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc == 0) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    minhash_init();
+    struct job job;
+    job.names = argv;
+    job.count = argc;
+    job.sigs = calloc(argc, sizeof(struct sig));
+    unsigned *parent = malloc(argc * sizeof(unsigned));
+    unsigned *next = malloc(argc * sizeof(unsigned));
+    if (!job.sigs || !parent || !next) {
+        fputs("basdedup: out of memory\n", stderr);
+        return 2;
+    }
+    bbcutil_parallel(job.count, threads, worker, &job);
+
+    int status = 0;
+    for (unsigned ix = 0; ix < job.count; ix++) {
+        if (!job.sigs[ix].loaded)
+            status = 2;
+        else if (!job.sigs[ix].program) {
+            fprintf(stderr, "basdedup: %s is not a BBC BASIC or COMAL program or is corrupt\n", argv[ix]);
+            if (!status)
+                status = 3;
+        }
+    }
+    if (!cluster(job.sigs, job.count, threshold, parent)) {
+        fputs("basdedup: out of memory\n", stderr);
+        return 2;
+    }
+
+    /* each cluster is listed under its first program, the others with
+     * their similarity to it. */
+    unsigned clusters = 0;
+    for (unsigned ix = 0; ix < job.count; ix++)
+        next[ix] = ix;
+    for (unsigned ix = job.count; ix-- > 0;) {
+        unsigned root = find(parent, ix);
+        if (root != ix) {
+            next[ix] = next[root];
+            next[root] = ix;
+        }
+    }
+    for (unsigned root = 0; root < job.count; root++) {
+        if (parent[root] != root || next[root] == root)
+            continue;
+        if (clusters++)
+            putchar('\n');
+        puts(argv[root]);
+        for (unsigned ix = next[root]; ix != root; ix = next[ix]) {
+            const struct sig *sig = job.sigs + ix;
+            if (sig->whole == job.sigs[root].whole && sig->lines == job.sigs[root].lines)
+                printf("  %s identical\n", argv[ix]);
+            else
+                printf("  %s %u%%\n", argv[ix], similarity(sig, job.sigs + root));
+        }
+    }
+    free(next);
+    free(parent);
+    free(job.sigs);
+    return status;
+}
@@ -0,0 +1,410 @@
+#include "bbcutil.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A program to be compared is reduced to a hash of the token bytes of
+ * each line with its line number, unless line numbers are ignored (-i)
+ * as when comparing against a renumbered copy, so the diff compares
+ * words rather than detokenised text.  Lines of both programs are then
+ * numbered by equivalence class, equal hashes being confirmed by
+ * comparing the bytes once, so the diff itself compares integers. */
+
+struct line {
+    uint64_t hash;
+    const unsigned char *text;
+    uint32_t text_len;
+    uint32_t lineno;
+    uint32_t off;
+    uint32_t len;
+};
+
+struct prog {
+    const char *fn;
+    unsigned char *file;
+    bbcutil_kind kind;
+    struct line *lines;
+    unsigned count;
+    uint32_t *cls;
+    bool *changed;
+    unsigned cursor;
+    unsigned depth;
+};
+
+static int load_prog(struct prog *p, const char *fn, bool linenos)
+{
+    unsigned char *file_end;
+    p->fn = fn;
+    if (!(p->file = bbcutil_load("basdiff", fn, &file_end)))
+        return 2;
+    bbcutil_fmt fmt;
+    p->kind = bbcutil_sniff(p->file, file_end - p->file, &fmt);
+    if (p->kind == BBCUTIL_COMAL)
+        p->kind = BBCUTIL_WILSON;
+    else if (p->kind != BBCUTIL_WILSON && p->kind != BBCUTIL_RUSSELL) {
+        fprintf(stderr, "basdiff: %s is not a BBC BASIC program or is corrupt\n", fn);
+        return 3;
+    }
+    const unsigned char *prog_end = p->file + fmt.prog_len;
+    p->lines = malloc((fmt.lines + 1) * sizeof(struct line));
+    p->cls = malloc((fmt.lines + 1) * sizeof(uint32_t));
+    p->changed = calloc(fmt.lines + 1, sizeof(bool));
+    if (!p->lines || !p->cls || !p->changed) {
+        fputs("basdiff: out of memory\n", stderr);
+        return 2;
+    }
+    bbcutil_lines lines;
+    bbcutil_line line;
+    struct line *lp = p->lines;
+    bbcutil_lines_init(&lines, p->file, prog_end, p->kind);
+    while (lp < p->lines + fmt.lines && bbcutil_lines_next(&lines, &line)) {
+        lp->off = line.start - p->file;
+        lp->len = line.end - line.start;
+        lp->text = line.text;
+        lp->text_len = line.text_end - line.text;
+        lp->lineno = line.lineno;
+        lp->hash = bbcutil_hash(line.text, lp->text_len, linenos ? line.lineno : 0);
+        lp++;
+    }
+    p->count = lp - p->lines;
+    return 0;
+}
+
+static inline bool same_line(const struct line *a, const struct line *b, bool linenos)
+{
+    return a->hash == b->hash && a->text_len == b->text_len && (!linenos || a->lineno == b->lineno)
+        && !memcmp(a->text, b->text, a->text_len);
+}
+
+struct class_slot {
+    const struct line *line;
+    uint32_t cls;
+};
+
+static bool classify(struct prog *old, struct prog *new, bool linenos)
+{
+    size_t size = 16;
+    while (size < (old->count + new->count) * 2)
+        size *= 2;
+    struct class_slot *slots = calloc(size, sizeof(struct class_slot));
+    if (!slots)
+        return false;
+    uint32_t next = 0;
+    struct prog *progs[2] = { old, new };
+    for (int i = 0; i < 2; i++) {
+        struct prog *p = progs[i];
+        for (unsigned ix = 0; ix < p->count; ix++) {
+            const struct line *lp = p->lines + ix;
+            struct class_slot *slot = slots + (lp->hash & (size - 1));
+            while (slot->line && !same_line(slot->line, lp, linenos))
+                if (++slot == slots + size)
+                    slot = slots;
+            if (!slot->line) {
+                slot->line = lp;
+                slot->cls = next++;
+            }
+            p->cls[ix] = slot->cls;
+        }
+    }
+    free(slots);
+    return true;
+}
+
+/* The diff is Myers' O(ND) algorithm in linear space, finding the middle
+ * snake of each stretch and recursing either side of it, marking lines
+ * removed from the old program and added in the new.  As in GNU diff,
+ * once the search for a snake has cost too much the furthest reaching
+ * forward path is taken instead, giving up minimality to bound the time
+ * spent on programs which have little in common. */
+
+struct diff {
+    const uint32_t *xcls;
+    const uint32_t *ycls;
+    bool *xchanged;
+    bool *ychanged;
+    int too_expensive;
+    int *fdiag;
+    int *bdiag;
+};
+
+static inline bool line_eq(const struct diff *d, int x, int y)
+{
+    return d->xcls[x] == d->ycls[y];
+}
+
+static void middle_snake(const struct diff *d, int xoff, int xlim, int yoff, int ylim, int *xmid, int *ymid)
+{
+    int *fd = d->fdiag;
+    int *bd = d->bdiag;
+    int dmin = xoff - ylim;
+    int dmax = xlim - yoff;
+    int fmid = xoff - yoff;
+    int bmid = xlim - ylim;
+    int fmin = fmid, fmax = fmid;
+    int bmin = bmid, bmax = bmid;
+    bool odd = (fmid - bmid) & 1;
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+    for (int cost = 1;; cost++) {
+        if (fmin > dmin)
+            fd[--fmin - 1] = -1;
+        else
+            ++fmin;
+        if (fmax < dmax)
+            fd[++fmax + 1] = -1;
+        else
+            --fmax;
+        for (int k = fmax; k >= fmin; k -= 2) {
+            int lo = fd[k - 1], hi = fd[k + 1];
+            int x = lo >= hi ? lo + 1 : hi;
+            int y = x - k;
+            while (x < xlim && y < ylim && line_eq(d, x, y)) {
+                x++;
+                y++;
+            }
+            fd[k] = x;
+            if (odd && bmin <= k && k <= bmax && bd[k] <= x) {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+        if (bmin > dmin)
+            bd[--bmin - 1] = INT_MAX;
+        else
+            ++bmin;
+        if (bmax < dmax)
+            bd[++bmax + 1] = INT_MAX;
+        else
+            --bmax;
+        for (int k = bmax; k >= bmin; k -= 2) {
+            int lo = bd[k - 1], hi = bd[k + 1];
+            int x = lo < hi ? lo : hi - 1;
+            int y = x - k;
+            while (x > xoff && y > yoff && line_eq(d, x - 1, y - 1)) {
+                x--;
+                y--;
+            }
+            bd[k] = x;
+            if (!odd && fmin <= k && k <= fmax && x <= fd[k]) {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+        if (cost >= d->too_expensive) {
+            int best = -1;
+            for (int k = fmax; k >= fmin; k -= 2) {
+                int x = fd[k] < xlim ? fd[k] : xlim;
+                int y = x - k;
+                if (y > ylim) {
+                    x = ylim + k;
+                    y = ylim;
+                }
+                if (x + y > best) {
+                    best = x + y;
+                    *xmid = x;
+                    *ymid = y;
+                }
+            }
+            return;
+        }
+    }
+}
+
+static void compare(const struct diff *d, int xoff, int xlim, int yoff, int ylim)
+{
+    while (xoff < xlim && yoff < ylim && line_eq(d, xoff, yoff)) {
+        xoff++;
+        yoff++;
+    }
+    while (xlim > xoff && ylim > yoff && line_eq(d, xlim - 1, ylim - 1)) {
+        xlim--;
+        ylim--;
+    }
+    if (xoff == xlim)
+        memset(d->ychanged + yoff, true, ylim - yoff);
+    else if (yoff == ylim)
+        memset(d->xchanged + xoff, true, xlim - xoff);
+    else {
+        int xmid = xlim, ymid = ylim;
+        middle_snake(d, xoff, xlim, yoff, ylim, &xmid, &ymid);
+        compare(d, xoff, xmid, yoff, ymid);
+        compare(d, xmid, xlim, ymid, ylim);
+    }
+}
+
+/* Only the lines of the hunks are listed.  The indent depth is carried
+ * forward from the last line listed, so lines between hunks are scanned
+ * for their effect on it but not decoded. */
+
+static void list_line(struct prog *p, unsigned ix, int mark, const bbcutil_renderer *rend, bbcutil_listing *lst, bool doindent)
+{
+    if (doindent)
+        while (p->cursor < ix) {
+            const struct line *lp = p->lines + p->cursor++;
+            bbcutil_lines lines;
+            bbcutil_line line;
+            bbcutil_lines_init(&lines, p->file + lp->off, p->file + lp->off + lp->len, p->kind);
+            if (bbcutil_lines_next(&lines, &line))
+                p->depth = bbcutil_basic_depth(&line, p->depth);
+        }
+    const struct line *lp = p->lines + ix;
+    bbcutil_listing_clear(lst, p->file);
+    if (bbcutil_listing_decode(lst, p->file + lp->off, p->file + lp->off + lp->len, p->kind, &p->depth, doindent) != BBCUTIL_OK) {
+        fputs("basdiff: out of memory\n", stderr);
+        exit(2);
+    }
+    p->cursor = ix + 1;
+    putchar(mark);
+    bbcutil_render(rend, lst, stdout);
+}
+
+static void print_hunk(struct prog *old, unsigned x0, unsigned x1, struct prog *new, unsigned y0, unsigned y1,
+                       const bbcutil_renderer *rend, bbcutil_listing *lst, bool doindent)
+{
+    printf("@@ -%u,%u +%u,%u @@\n", x1 > x0 ? x0 + 1 : x0, x1 - x0, y1 > y0 ? y0 + 1 : y0, y1 - y0);
+    while (x0 < x1 || y0 < y1) {
+        if (x0 < x1 && old->changed[x0])
+            list_line(old, x0++, '-', rend, lst, doindent);
+        else if (y0 < y1 && new->changed[y0])
+            list_line(new, y0++, '+', rend, lst, doindent);
+        else {
+            list_line(new, y0++, ' ', rend, lst, doindent);
+            x0++;
+        }
+    }
+}
+
+/* changes closer together than twice the context go in one hunk.  The
+ * lines before a change, back to the end of the one before, are common
+ * to both programs so x and y move back together. */
+
+static bool print_diff(struct prog *old, struct prog *new, unsigned context, const bbcutil_renderer *rend,
+                       bbcutil_listing *lst, bool doindent)
+{
+    unsigned x = 0, y = 0;
+    unsigned hx = 0, hy = 0;
+    unsigned ex = 0, ey = 0;
+    bool in_hunk = false;
+    bool differ = false;
+    while (x < old->count || y < new->count) {
+        if (!old->changed[x] && !new->changed[y]) {
+            x++;
+            y++;
+            continue;
+        }
+        if (!differ)
+            printf("--- %s\n+++ %s\n", old->fn, new->fn);
+        differ = true;
+        if (in_hunk && x - ex > 2 * context) {
+            print_hunk(old, hx, ex + context, new, hy, ey + context, rend, lst, doindent);
+            in_hunk = false;
+        }
+        if (!in_hunk) {
+            unsigned lead = context < x - ex ? context : x - ex;
+            hx = x - lead;
+            hy = y - lead;
+            in_hunk = true;
+        }
+        while (x < old->count && old->changed[x])
+            x++;
+        while (y < new->count && new->changed[y])
+            y++;
+        ex = x;
+        ey = y;
+    }
+    if (in_hunk) {
+        unsigned tail = context < old->count - ex ? context : old->count - ex;
+        print_hunk(old, hx, ex + tail, new, hy, ey + tail, rend, lst, doindent);
+    }
+    return differ;
+}
+
+static const char usage[] = "Usage: basdiff [-c] [-d] [-h] [-i] [-n] [-u <context>] <old> <new>\n";
+
+int main(int argc, char **argv)
+{
+    const char *style = "plain";
+    bool linenos = true;
+    bool doindent = true;
+    unsigned context = 3;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 'c':
+                style = "colour";
+                break;
+            case 'd':
+                style = "dark";
+                break;
+            case 'h':
+                style = "html";
+                break;
+            case 'i':
+                linenos = false;
+                break;
+            case 'n':
+                doindent = false;
+                break;
+            case 'u':
+                {
+                    if (!arg[2] && argc > 1) {
+                        --argc;
+                        arg = *++argv;
+                    }
+                    else
+                        arg += 2;
+                    char *end;
+                    context = strtoul(arg, &end, 10);
+                    if (*end || end == arg) {
+                        fprintf(stderr, "basdiff: invalid context\n%s", usage);
+                        return 1;
+                    }
+                }
+                break;
+            case 0:
+                fprintf(stderr, "basdiff: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "basdiff: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc != 2) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    struct prog old = { 0 };
+    struct prog new = { 0 };
+    int status = load_prog(&old, argv[0], linenos);
+    if (!status)
+        status = load_prog(&new, argv[1], linenos);
+    if (status)
+        return status;
+    struct diff d = { old.cls, new.cls, old.changed, new.changed };
+    size_t diags = old.count + new.count + 3;
+    d.too_expensive = 1;
+    for (size_t n = diags; n; n >>= 2)
+        d.too_expensive <<= 1;
+    if (d.too_expensive < 4096)
+        d.too_expensive = 4096;
+    d.fdiag = malloc(diags * 2 * sizeof(int));
+    bbcutil_renderer *rend;
+    bbcutil_listing *lst = bbcutil_listing_new();
+    if (!d.fdiag || !lst || !classify(&old, &new, linenos) || bbcutil_renderer_new(style, strlen(style), &rend) != BBCUTIL_OK) {
+        fputs("basdiff: out of memory\n", stderr);
+        return 2;
+    }
+    d.bdiag = d.fdiag + diags;
+    d.fdiag += new.count + 1;
+    d.bdiag += new.count + 1;
+    compare(&d, 0, old.count, 0, new.count);
+    status = print_diff(&old, &new, context, rend, lst, doindent) ? 1 : 0;
+    bbcutil_renderer_free(rend);
+    bbcutil_listing_free(lst);
+    return status;
+}
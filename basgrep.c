@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A query is turned into the bytes it has in the tokenised program: a
+ * keyword is its token, an identifier or string its text and a line
+ * number reference the 0x8D token and encoded number.  The file is
+ * searched for those bytes and only the lines holding them are split
+ * into tokens to check the match is in the right context, a keyword
+ * not in a string or REM, an identifier not part of a longer name. */
+
+#define Q_KEYWORD 0
+#define Q_IDENT   1
+#define Q_STRING  2
+#define Q_LINEREF 3
+
+struct query {
+    int type;
+    const unsigned char *text;
+    size_t len;
+    unsigned lineno;
+    unsigned char toks[128];
+    unsigned ntoks;
+    unsigned char needle[4];
+    const unsigned char *find;
+    size_t find_len;
+};
+
+struct result {
+    char *text;
+    size_t size;
+    unsigned matches;
+    int status;
+};
+
+struct job {
+    char **names;
+    struct result *results;
+    unsigned count;
+    bool show_names;
+    const struct query *query;
+    const bbcutil_renderer *rend;
+};
+
+static inline bool name_char(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '`';
+}
+
+/* A, A% and A$ are different variables so a name without a suffix
+ * must not be followed by one. */
+
+static bool ident_in(const struct query *q, const unsigned char *ptr, const unsigned char *end)
+{
+    const unsigned char *start = ptr;
+    while ((ptr = memmem(ptr, end - ptr, q->text, q->len))) {
+        const unsigned char *after = ptr + q->len;
+        if ((ptr == start || !name_char(ptr[-1]))
+            && (after == end || !name_char(q->text[q->len - 1])
+                || (!name_char(*after) && *after != '%' && *after != '$')))
+            return true;
+        ptr++;
+    }
+    return false;
+}
+
+static bool line_matches(const struct query *q, const bbcutil_line *line, bbcutil_kind kind)
+{
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bbcutil_toks_init(&it, line, kind);
+    while (bbcutil_toks_next(&it, &tok)) {
+        switch(q->type) {
+            case Q_KEYWORD:
+                if (tok.type != BBCUTIL_TOK_STRING && tok.type != BBCUTIL_TOK_PLAIN
+                    && memchr(q->toks, tok.tok, q->ntoks))
+                    return true;
+                break;
+            case Q_IDENT:
+                if (tok.type == BBCUTIL_TOK_PLAIN && ident_in(q, tok.ptr, tok.end))
+                    return true;
+                break;
+            case Q_STRING:
+                if (tok.type == BBCUTIL_TOK_STRING && memmem(tok.ptr, tok.end - tok.ptr, q->text, q->len))
+                    return true;
+                break;
+            case Q_LINEREF:
+                if (tok.type == BBCUTIL_TOK_LINENO && tok.lineno == q->lineno)
+                    return true;
+                break;
+        }
+    }
+    return false;
+}
+
+static inline const unsigned char *next_candidate(const struct query *q, const unsigned char *ptr, const unsigned char *end)
+{
+    if (!q->find)
+        return ptr;
+    if (q->find_len == 1)
+        return memchr(ptr, *q->find, end - ptr);
+    return memmem(ptr, end - ptr, q->find, q->find_len);
+}
+
+/* line headers are followed without looking at the text of lines
+ * before the next candidate.  Matching lines are listed on their own,
+ * without the indent of the lines around them. */
+
+static unsigned search(const struct query *q, const char *fn, bool show_name, const unsigned char *prog,
+                       const unsigned char *prog_end, bbcutil_kind kind, const bbcutil_renderer *rend,
+                       bbcutil_listing *lst, FILE *ofp)
+{
+    unsigned matches = 0;
+    bbcutil_lines lines;
+    bbcutil_line line;
+    const unsigned char *cand = next_candidate(q, prog, prog_end);
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (cand && bbcutil_lines_next(&lines, &line)) {
+        if (cand >= line.end)
+            continue;
+        if (line_matches(q, &line, kind)) {
+            matches++;
+            bbcutil_listing_clear(lst, prog);
+            if (bbcutil_listing_decode(lst, line.start, line.end, kind, NULL, true) != BBCUTIL_OK)
+                return matches;
+            if (show_name) {
+                fputs(fn, ofp);
+                putc(':', ofp);
+            }
+            bbcutil_render(rend, lst, ofp);
+        }
+        cand = next_candidate(q, line.end, prog_end);
+    }
+    return matches;
+}
+
+static void grep_file(const struct job *job, const char *fn, struct result *res, bbcutil_listing *lst)
+{
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "basgrep: unable to open '%s' for reading: %s\n", fn, strerror(errno));
+        res->status = 2;
+        return;
+    }
+    struct stat stb;
+    if (fstat(fd, &stb)) {
+        fprintf(stderr, "basgrep: unable to stat '%s': %s\n", fn, strerror(errno));
+        close(fd);
+        res->status = 2;
+        return;
+    }
+    if (stb.st_size == 0) {
+        fprintf(stderr, "basgrep: %s is an empty file\n", fn);
+        close(fd);
+        res->status = 2;
+        return;
+    }
+    unsigned char *file = mmap(NULL, stb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "basgrep: unable to map '%s': %s\n", fn, strerror(errno));
+        res->status = 2;
+        return;
+    }
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, stb.st_size, &fmt);
+    if (kind == BBCUTIL_COMAL)
+        kind = BBCUTIL_WILSON;
+    if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+        fprintf(stderr, "basgrep: %s is not a BBC BASIC program or is corrupt\n", fn);
+        res->status = 3;
+    }
+    else {
+        FILE *ofp = open_memstream(&res->text, &res->size);
+        if (ofp) {
+            res->matches = search(job->query, fn, job->show_names, file, file + fmt.prog_len, kind, job->rend, lst, ofp);
+            fclose(ofp);
+        }
+        else {
+            fputs("basgrep: out of memory\n", stderr);
+            res->status = 2;
+        }
+    }
+    munmap(file, stb.st_size);
+}
+
+static void worker(bbcutil_work *work, void *ctx)
+{
+    struct job *job = ctx;
+    bbcutil_listing *lst = bbcutil_listing_new();
+    unsigned ix;
+    while (bbcutil_work_next(work, &ix)) {
+        if (lst)
+            grep_file(job, job->names[ix], job->results + ix, lst);
+        else {
+            fputs("basgrep: out of memory\n", stderr);
+            job->results[ix].status = 2;
+        }
+    }
+    bbcutil_listing_free(lst);
+}
+
+static bool parse_query(struct query *q, int type, const char *arg)
+{
+    q->type = type;
+    q->text = (const unsigned char *)arg;
+    q->len = strlen(arg);
+    q->find = q->text;
+    q->find_len = q->len;
+    switch(type) {
+        case Q_KEYWORD:
+            q->ntoks = bbcutil_keyword_tokens(arg, q->len, q->toks);
+            if (!q->ntoks) {
+                fprintf(stderr, "basgrep: unknown keyword '%s'\n", arg);
+                return false;
+            }
+            q->find = q->ntoks == 1 ? q->toks : NULL;
+            q->find_len = 1;
+            break;
+        case Q_LINEREF:
+            {
+                char *end;
+                unsigned long lineno = strtoul(arg, &end, 10);
+                if (*end || end == arg || lineno > 32767) {
+                    fprintf(stderr, "basgrep: invalid line number '%s'\n", arg);
+                    return false;
+                }
+                q->lineno = lineno;
+                q->needle[0] = 0x8d;
+                bbcutil_lineno_encode(q->needle + 1, lineno);
+                q->find = q->needle;
+                q->find_len = 4;
+            }
+            break;
+        default:
+            if (!q->len) {
+                fputs("basgrep: empty search text\n", stderr);
+                return false;
+            }
+    }
+    return true;
+}
+
+static const char usage[] = "Usage: basgrep [-c] [-d] [-h] [-j <threads>] -k <keyword> | -i <identifier> | -s <text> | -r <line> <file> [ ... ]\n";
+
+int main(int argc, char **argv)
+{
+    const char *style = "plain";
+    int threads = 0;
+    struct query query;
+    bool have_query = false;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        const char *value = NULL;
+        if (opt && strchr("jkisr", opt)) {
+            if (arg[2])
+                value = arg + 2;
+            else if (argc > 1) {
+                value = *++argv;
+                --argc;
+            }
+            else {
+                fprintf(stderr, "basgrep: missing value for '%c'\n%s", opt, usage);
+                return 1;
+            }
+        }
+        switch(opt) {
+            case 'c':
+                style = "colour";
+                break;
+            case 'd':
+                style = "dark";
+                break;
+            case 'h':
+                style = "html";
+                break;
+            case 'j':
+                threads = atoi(value);
+                break;
+            case 'k':
+            case 'i':
+            case 's':
+            case 'r':
+                if (have_query) {
+                    fprintf(stderr, "basgrep: only one search may be given\n%s", usage);
+                    return 1;
+                }
+                if (!parse_query(&query, opt == 'k' ? Q_KEYWORD : opt == 'i' ? Q_IDENT : opt == 's' ? Q_STRING : Q_LINEREF, value))
+                    return 1;
+                have_query = true;
+                break;
+            case 0:
+                fprintf(stderr, "basgrep: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "basgrep: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc == 0 || !have_query) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    bbcutil_renderer *rend;
+    struct job job;
+    job.names = argv;
+    job.count = argc;
+    job.show_names = argc > 1;
+    job.query = &query;
+    job.results = calloc(argc, sizeof(struct result));
+    if (!job.results || bbcutil_renderer_new(style, strlen(style), &rend) != BBCUTIL_OK) {
+        fputs("basgrep: out of memory\n", stderr);
+        return 2;
+    }
+    job.rend = rend;
+    bbcutil_parallel(job.count, threads, worker, &job);
+
+    /* like grep, the status is 0 for a match, 1 for none. */
+    int status = 1;
+    int error = 0;
+    for (unsigned ix = 0; ix < job.count; ix++) {
+        struct result *res = job.results + ix;
+        if (res->text) {
+            fwrite(res->text, res->size, 1, stdout);
+            free(res->text);
+        }
+        if (res->matches)
+            status = 0;
+        if (res->status)
+            error = res->status;
+    }
+    free(job.results);
+    bbcutil_renderer_free(rend);
+    return error ? error : status;
+}
@@ -0,0 +1,218 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A line is appended to the one before, after a colon, when nothing can
+ * tell the difference: no line number reference goes to it and the line
+ * before does not decide whether the rest of itself runs.  IF and ON
+ * make the rest of the line conditional, ON ERROR makes it the error
+ * handler, REM, DATA and star commands take the rest of the line as
+ * their text, and a line starting with DEF is skipped when the program
+ * runs into it.  DEF and DATA must start a line to be found, so lines
+ * starting with them stay on their own, as does assembler. */
+
+#define TOK_ERL  0x9e
+#define TOK_IF   0xe7
+#define TOK_ON   0xee
+#define TOK_DATA 0xdc
+#define TOK_DEF  0xdd
+
+#define MAX_TEXT 251
+
+struct info {
+    bool head;
+    bool tail;
+};
+
+static void line_info(const bbcutil_line *line, bool *assembler, struct info *info)
+{
+    const unsigned char *star = bbcutil_star_command(line);
+    const unsigned char *text = line->text;
+    bool in_asm = *assembler;
+    bool asm_seen = in_asm;
+    while (text < line->text_end && *text == ' ')
+        text++;
+    info->head = !(text < line->text_end && (*text == TOK_DEF || *text == TOK_DATA || *text == '*'));
+    info->tail = info->head && !star;
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bbcutil_toks_init(&it, line, BBCUTIL_WILSON);
+    while (bbcutil_toks_next(&it, &tok) && !(star && tok.ptr >= star)) {
+        if (tok.type == BBCUTIL_TOK_PLAIN) {
+            for (const unsigned char *ptr = tok.ptr; ptr < tok.end && ptr != star; ptr++) {
+                if (*ptr == '[')
+                    in_asm = asm_seen = true;
+                else if (*ptr == ']')
+                    in_asm = false;
+            }
+        }
+        else if (tok.type == BBCUTIL_TOK_TAIL || (tok.type == BBCUTIL_TOK_KEYWORD && (tok.tok == TOK_IF || tok.tok == TOK_ON)))
+            info->tail = false;
+    }
+    if (asm_seen)
+        info->head = info->tail = false;
+    *assembler = in_asm;
+}
+
+struct stats {
+    unsigned lines_in;
+    unsigned lines_out;
+};
+
+static size_t pack(const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind,
+                   const uint8_t *refs, unsigned char *out, struct stats *stats)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned char *optr = out;
+    unsigned char *rec = NULL;
+    size_t rec_len = 0;
+    bool open = false;
+    bool assembler = false;
+    unsigned hdr = kind == BBCUTIL_RUSSELL ? 3 : 4;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        struct info info;
+        size_t len = line.text_end - line.text;
+        line_info(&line, &assembler, &info);
+        stats->lines_in++;
+        if (rec && open && info.head && !(refs[line.lineno >> 3] & (1 << (line.lineno & 7)))
+            && rec_len + (rec_len && len) + len <= MAX_TEXT) {
+            if (rec_len && len)
+                rec[hdr + rec_len++] = ':';
+            memcpy(rec + hdr + rec_len, line.text, len);
+            rec_len += len;
+            open = info.tail;
+        }
+        else {
+            if (rec)
+                optr = rec + hdr + rec_len + (kind == BBCUTIL_RUSSELL);
+            rec = optr;
+            rec_len = len;
+            open = info.tail;
+            memcpy(rec, line.start, hdr);
+            memcpy(rec + hdr, line.text, len);
+            stats->lines_out++;
+        }
+        if (kind == BBCUTIL_RUSSELL) {
+            rec[0] = rec_len + 4;
+            rec[hdr + rec_len] = 0x0d;
+        }
+        else
+            rec[3] = rec_len + 4;
+    }
+    if (rec)
+        optr = rec + hdr + rec_len + (kind == BBCUTIL_RUSSELL);
+    return optr - out;
+}
+
+/* ERL gives the line number an error was raised on so a program which
+ * tests it would change behaviour once its lines are merged. */
+
+static bool uses_erl(const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        bbcutil_toks it;
+        bbcutil_tok tok;
+        bbcutil_toks_init(&it, &line, kind);
+        while (bbcutil_toks_next(&it, &tok))
+            if (tok.type == BBCUTIL_TOK_KEYWORD && tok.tok == TOK_ERL)
+                return true;
+    }
+    return false;
+}
+
+static void report_dangling(void *ctx, unsigned lineno, unsigned target)
+{
+    fprintf(stderr, "baspack: %s: line %u refers to missing line %u\n", (const char *)ctx, lineno, target);
+}
+
+static const char usage[] = "Usage: baspack [-s <start>] [-i <step>] <bas-in> [<bas-out>]\n";
+
+int main(int argc, char **argv)
+{
+    unsigned start = 10;
+    unsigned step = 10;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 's':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 32767, &start)) {
+                    fprintf(stderr, "baspack: invalid start line\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 'i':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 32767, &step) || !step) {
+                    fprintf(stderr, "baspack: invalid step\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 0:
+                fprintf(stderr, "baspack: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "baspack: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc < 1 || argc > 2) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    const char *in_fn = argv[0];
+    const char *out_fn = argc == 2 ? argv[1] : in_fn;
+    unsigned char *file_end;
+    unsigned char *file = bbcutil_load("baspack", in_fn, &file_end);
+    if (!file)
+        return 2;
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, file_end - file, &fmt);
+    if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+        fprintf(stderr, "baspack: %s is not a BBC BASIC program or is corrupt\n", in_fn);
+        free(file);
+        return 3;
+    }
+
+    /* with a computed target any line may be one and renumbering would
+     * break it, so such a program is left alone, as is one using ERL. */
+    uint8_t *refs = malloc(BBCUTIL_REFS_SIZE);
+    unsigned char *out = malloc(file_end - file);
+    int status;
+    if (!refs || !out) {
+        fputs("baspack: out of memory\n", stderr);
+        status = 2;
+    }
+    else if (!bbcutil_line_targets(file, file + fmt.prog_len, kind, refs)) {
+        fprintf(stderr, "baspack: %s has computed line numbers so cannot be packed\n", in_fn);
+        status = 1;
+    }
+    else if (uses_erl(file, file + fmt.prog_len, kind)) {
+        fprintf(stderr, "baspack: %s uses ERL so cannot be packed\n", in_fn);
+        status = 1;
+    }
+    else {
+        struct stats stats = { 0, 0 };
+        size_t prog_len = pack(file, file + fmt.prog_len, kind, refs, out, &stats);
+        size_t rest = file_end - file - fmt.prog_len;
+        memcpy(out + prog_len, file + fmt.prog_len, rest);
+        bbcutil_res res = bbcutil_renumber(out, out + prog_len, kind, start, step, report_dangling, (void *)in_fn);
+        if (res != BBCUTIL_OK) {
+            fprintf(stderr, "baspack: unable to renumber %s: %s\n", in_fn, bbcutil_rmsg(res));
+            status = res == BBCUTIL_RANGE ? 1 : 2;
+        }
+        else if (!(status = bbcutil_save("baspack", out_fn, out, prog_len + rest) ? 0 : 2))
+            printf("%s: %u lines packed into %u, saving %zu bytes\n", in_fn, stats.lines_in, stats.lines_out,
+                   fmt.prog_len - prog_len);
+    }
+    free(out);
+    free(refs);
+    free(file);
+    return status;
+}
@@ -0,0 +1,71 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void report_dangling(void *ctx, unsigned lineno, unsigned target)
+{
+    fprintf(stderr, "basrenum: %s: line %u refers to missing line %u\n", (const char *)ctx, lineno, target);
+}
+
+static const char usage[] = "Usage: basrenum [-s <start>] [-i <step>] <bas-in> [<bas-out>]\n";
+
+int main(int argc, char **argv)
+{
+    unsigned start = 10;
+    unsigned step = 10;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 's':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 32767, &start)) {
+                    fprintf(stderr, "basrenum: invalid start line\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 'i':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 32767, &step) || !step) {
+                    fprintf(stderr, "basrenum: invalid step\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 0:
+                fprintf(stderr, "basrenum: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "basrenum: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc < 1 || argc > 2) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    const char *in_fn = argv[0];
+    const char *out_fn = argc == 2 ? argv[1] : in_fn;
+    unsigned char *file_end;
+    unsigned char *file = bbcutil_load("basrenum", in_fn, &file_end);
+    if (!file)
+        return 2;
+    bbcutil_fmt fmt;
+    bbcutil_kind kind = bbcutil_sniff(file, file_end - file, &fmt);
+    /* COMAL refers to labels rather than lines, so with the COMAL dialect
+     * only the line headers are renumbered. */
+    if (kind == BBCUTIL_UNKNOWN || kind == BBCUTIL_DATA) {
+        fprintf(stderr, "basrenum: %s is not a BBC BASIC or COMAL program or is corrupt\n", in_fn);
+        free(file);
+        return 3;
+    }
+    bbcutil_res res = bbcutil_renumber(file, file + fmt.prog_len, kind, start, step, report_dangling, (void *)in_fn);
+    int status;
+    if (res != BBCUTIL_OK) {
+        fprintf(stderr, "basrenum: unable to renumber %s: %s\n", in_fn, bbcutil_rmsg(res));
+        status = res == BBCUTIL_RANGE ? 1 : 2;
+    }
+    else
+        status = bbcutil_save("basrenum", out_fn, file, file_end - file) ? 0 : 2;
+    free(file);
+    return status;
+}
@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Symbols and their references are allocated from an arena released
+ * in one go when the program is done with, and found through a hash
+ * table of pointers into it.  Names point into the loaded program. */
+
+#define ARENA_CHUNK 65536
+
+struct chunk {
+    struct chunk *next;
+    unsigned char data[];
+};
+
+struct arena {
+    struct chunk *chunks;
+    unsigned char *ptr;
+    unsigned char *end;
+};
+
+static void *arena_alloc(struct arena *a, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    if (a->end - a->ptr < size) {
+        size_t chunk_size = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        struct chunk *c = malloc(sizeof(struct chunk) + chunk_size);
+        if (!c)
+            return NULL;
+        c->next = a->chunks;
+        a->chunks = c;
+        a->ptr = c->data;
+        a->end = c->data + chunk_size;
+    }
+    void *mem = a->ptr;
+    a->ptr += size;
+    return mem;
+}
+
+static void arena_free(struct arena *a)
+{
+    struct chunk *c = a->chunks;
+    while (c) {
+        struct chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->chunks = NULL;
+    a->ptr = a->end = NULL;
+}
+
+struct ref {
+    struct ref *next;
+    unsigned lineno;
+    bool def;
+};
+
+struct sym {
+    uint64_t hash;
+    const unsigned char *name;
+    unsigned len;
+    bbcutil_idtype type;
+    unsigned defs;
+    unsigned uses;
+    struct ref *first;
+    struct ref *last;
+};
+
+struct symtab {
+    struct arena arena;
+    struct sym **slots;
+    unsigned mask;
+    unsigned count;
+};
+
+static bool symtab_grow(struct symtab *tab)
+{
+    unsigned size = tab->slots ? (tab->mask + 1) * 2 : 256;
+    struct sym **slots = calloc(size, sizeof(struct sym *));
+    if (!slots)
+        return false;
+    if (tab->slots) {
+        for (unsigned ix = 0; ix <= tab->mask; ix++) {
+            struct sym *sym = tab->slots[ix];
+            if (sym) {
+                unsigned slot = sym->hash & (size - 1);
+                while (slots[slot])
+                    slot = (slot + 1) & (size - 1);
+                slots[slot] = sym;
+            }
+        }
+        free(tab->slots);
+    }
+    tab->slots = slots;
+    tab->mask = size - 1;
+    return true;
+}
+
+/* arrays and variables of the same name are different symbols, as are
+ * procedures and functions. */
+
+static struct sym *symtab_get(struct symtab *tab, bbcutil_idtype type, const unsigned char *name, unsigned len)
+{
+    if ((tab->count + 1) * 2 > tab->mask + 1 && !symtab_grow(tab))
+        return NULL;
+    uint64_t hash = bbcutil_hash(name, len, type);
+    unsigned slot = hash & tab->mask;
+    struct sym *sym;
+    while ((sym = tab->slots[slot])) {
+        if (sym->hash == hash && sym->type == type && sym->len == len && !memcmp(sym->name, name, len))
+            return sym;
+        slot = (slot + 1) & tab->mask;
+    }
+    if (!(sym = arena_alloc(&tab->arena, sizeof(struct sym))))
+        return NULL;
+    memset(sym, 0, sizeof(struct sym));
+    sym->hash = hash;
+    sym->type = type;
+    sym->name = name;
+    sym->len = len;
+    tab->slots[slot] = sym;
+    tab->count++;
+    return sym;
+}
+
+static bool add_ref(struct symtab *tab, struct sym *sym, unsigned lineno, bool def)
+{
+    if (def)
+        sym->defs++;
+    else
+        sym->uses++;
+    if (sym->last && sym->last->lineno == lineno && sym->last->def == def)
+        return true;
+    struct ref *ref = arena_alloc(&tab->arena, sizeof(struct ref));
+    if (!ref)
+        return false;
+    ref->next = NULL;
+    ref->lineno = lineno;
+    ref->def = def;
+    if (sym->last)
+        sym->last->next = ref;
+    else
+        sym->first = ref;
+    sym->last = ref;
+    return true;
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+    const struct sym *x = *(const struct sym **)a;
+    const struct sym *y = *(const struct sym **)b;
+    if (x->type != y->type)
+        return x->type < y->type ? -1 : 1;
+    int res = memcmp(x->name, y->name, x->len < y->len ? x->len : y->len);
+    if (res)
+        return res;
+    return x->len < y->len ? -1 : x->len > y->len;
+}
+
+static const char *const type_prefix[] = { "", "", "PROC", "FN" };
+
+static void put_name(const struct sym *sym, FILE *ofp)
+{
+    fputs(type_prefix[sym->type], ofp);
+    fwrite(sym->name, sym->len, 1, ofp);
+    if (sym->type == BBCUTIL_ID_ARRAY)
+        putc('(', ofp);
+}
+
+/* The table lists each symbol with the lines it appears on, a star
+ * marking the line defining a procedure or function.  The problems
+ * follow: procedures and functions defined but never used or used but
+ * never defined and references to lines which do not exist. */
+
+struct lineref {
+    unsigned lineno;
+    unsigned target;
+};
+
+static int xref(const char *fn, const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind,
+                bool table, FILE *ofp)
+{
+    struct symtab tab = { { NULL } };
+    uint64_t *lines = calloc(65536 / 64, sizeof(uint64_t));
+    struct lineref *refs = NULL;
+    size_t nrefs = 0, refs_size = 0;
+    int status = 0;
+    bbcutil_lines it;
+    bbcutil_line line;
+    if (!lines || !symtab_grow(&tab))
+        status = 2;
+    bbcutil_lines_init(&it, prog, prog_end, kind);
+    while (!status && bbcutil_lines_next(&it, &line)) {
+        bbcutil_idents ids;
+        bbcutil_ident id;
+        lines[line.lineno >> 6] |= 1ULL << (line.lineno & 63);
+        bbcutil_idents_init(&ids, &line);
+        while (!status && bbcutil_idents_next(&ids, &id)) {
+            if (id.type == BBCUTIL_ID_LINEREF) {
+                if (nrefs == refs_size) {
+                    refs_size = refs_size ? refs_size * 2 : 64;
+                    struct lineref *nr = realloc(refs, refs_size * sizeof(struct lineref));
+                    if (!nr) {
+                        status = 2;
+                        break;
+                    }
+                    refs = nr;
+                }
+                refs[nrefs].lineno = line.lineno;
+                refs[nrefs++].target = id.lineno;
+            }
+            else {
+                struct sym *sym = symtab_get(&tab, id.type, id.name, id.len);
+                if (!sym || !add_ref(&tab, sym, line.lineno, id.def))
+                    status = 2;
+            }
+        }
+    }
+    struct sym **syms = NULL;
+    if (!status && !(syms = malloc((tab.count + 1) * sizeof(struct sym *))))
+        status = 2;
+    if (status) {
+        fprintf(stderr, "basxref: out of memory processing %s\n", fn);
+        free(syms);
+        free(refs);
+        free(lines);
+        free(tab.slots);
+        arena_free(&tab.arena);
+        return status;
+    }
+    unsigned count = 0;
+    for (unsigned ix = 0; ix <= tab.mask; ix++)
+        if (tab.slots[ix])
+            syms[count++] = tab.slots[ix];
+    qsort(syms, count, sizeof(struct sym *), sym_cmp);
+    if (table) {
+        for (unsigned ix = 0; ix < count; ix++) {
+            const struct sym *sym = syms[ix];
+            int width = strlen(type_prefix[sym->type]) + sym->len + (sym->type == BBCUTIL_ID_ARRAY);
+            put_name(sym, ofp);
+            for (; width < 16; width++)
+                putc(' ', ofp);
+            for (const struct ref *ref = sym->first; ref; ref = ref->next)
+                fprintf(ofp, " %u%s", ref->lineno, ref->def ? "*" : "");
+            putc('\n', ofp);
+        }
+    }
+    for (unsigned ix = 0; ix < count; ix++) {
+        const struct sym *sym = syms[ix];
+        if (sym->type != BBCUTIL_ID_PROC && sym->type != BBCUTIL_ID_FN)
+            continue;
+        if (sym->defs && !sym->uses) {
+            fprintf(ofp, "%s: ", fn);
+            put_name(sym, ofp);
+            fprintf(ofp, " defined at line %u is never used\n", sym->first->lineno);
+        }
+        else if (!sym->defs) {
+            fprintf(ofp, "%s: ", fn);
+            put_name(sym, ofp);
+            fprintf(ofp, " used at line %u is not defined\n", sym->first->lineno);
+        }
+    }
+    for (size_t ix = 0; ix < nrefs; ix++) {
+        unsigned target = refs[ix].target;
+        if (!(lines[target >> 6] & 1ULL << (target & 63)))
+            fprintf(ofp, "%s: line %u refers to missing line %u\n", fn, refs[ix].lineno, target);
+    }
+    free(syms);
+    free(refs);
+    free(lines);
+    free(tab.slots);
+    arena_free(&tab.arena);
+    return 0;
+}
+
+struct result {
+    char *text;
+    size_t size;
+    int status;
+};
+
+struct job {
+    char **names;
+    struct result *results;
+    unsigned count;
+    bool table;
+};
+
+static void worker(bbcutil_work *work, void *ctx)
+{
+    struct job *job = ctx;
+    unsigned ix;
+    while (bbcutil_work_next(work, &ix)) {
+        const char *fn = job->names[ix];
+        struct result *res = job->results + ix;
+        unsigned char *end;
+        unsigned char *data = bbcutil_load("basxref", fn, &end);
+        if (!data) {
+            res->status = 2;
+            continue;
+        }
+        bbcutil_fmt fmt;
+        bbcutil_kind kind = bbcutil_sniff(data, end - data, &fmt);
+        if (kind == BBCUTIL_COMAL)
+            kind = BBCUTIL_WILSON;
+        if (kind != BBCUTIL_WILSON && kind != BBCUTIL_RUSSELL) {
+            fprintf(stderr, "basxref: %s is not a BBC BASIC program or is corrupt\n", fn);
+            res->status = 3;
+        }
+        else {
+            FILE *ofp = open_memstream(&res->text, &res->size);
+            if (ofp) {
+                if (job->table && job->count > 1)
+                    fprintf(ofp, "%s%s:\n", ix ? "\n" : "", fn);
+                res->status = xref(fn, data, data + fmt.prog_len, kind, job->table, ofp);
+                fclose(ofp);
+            }
+            else {
+                fputs("basxref: out of memory\n", stderr);
+                res->status = 2;
+            }
+        }
+        free(data);
+    }
+}
+
+static const char usage[] = "Usage: basxref [-j <threads>] [-p] <file> [ ... ]\n";
+
+int main(int argc, char **argv)
+{
+    unsigned threads = 0;
+    bool table = true;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 'j':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 1024, &threads)) {
+                    fprintf(stderr, "basxref: invalid thread count\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 'p':
+                table = false;
+                break;
+            case 0:
+                fprintf(stderr, "basxref: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "basxref: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc == 0) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    struct job job;
+    job.names = argv;
+    job.count = argc;
+    job.table = table;
+    job.results = calloc(argc, sizeof(struct result));
+    if (!job.results) {
+        fputs("basxref: out of memory\n", stderr);
+        return 2;
+    }
+    bbcutil_parallel(job.count, threads, worker, &job);
+
+    int status = 0;
+    for (unsigned ix = 0; ix < job.count; ix++) {
+        struct result *res = job.results + ix;
+        if (res->text) {
+            fwrite(res->text, res->size, 1, stdout);
+            free(res->text);
+        }
+        if (res->status)
+            status = res->status;
+    }
+    free(job.results);
+    return status;
+}
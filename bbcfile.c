@@ -0,0 +1,87 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct result {
+    bbcutil_fmt fmt;
+    size_t size;
+    bool loaded;
+};
+
+struct job {
+    char **names;
+    struct result *results;
+    unsigned count;
+};
+
+static void worker(bbcutil_work *work, void *ctx)
+{
+    struct job *job = ctx;
+    unsigned ix;
+    while (bbcutil_work_next(work, &ix)) {
+        struct result *res = job->results + ix;
+        unsigned char *end;
+        unsigned char *data = bbcutil_load("bbcfile", job->names[ix], &end);
+        if (data) {
+            res->size = end - data;
+            bbcutil_sniff(data, res->size, &res->fmt);
+            res->loaded = true;
+            free(data);
+        }
+    }
+}
+
+static const char usage[] = "Usage: bbcfile [-j <threads>] <file> [ ... ]\n";
+
+int main(int argc, char **argv)
+{
+    unsigned threads = 0;
+    while (--argc) {
+        const char *arg = *++argv;
+        if (arg[0] != '-')
+            break;
+        int opt = arg[1];
+        switch(opt) {
+            case 'j':
+                if (!bbcutil_number_arg(arg, &argc, &argv, 1024, &threads)) {
+                    fprintf(stderr, "bbcfile: invalid thread count\n%s", usage);
+                    return 1;
+                }
+                break;
+            case 0:
+                fprintf(stderr, "bbcfile: missing option\n%s", usage);
+                return 1;
+            default:
+                fprintf(stderr, "bbcfile: unrecognised option '%c'\n%s", opt, usage);
+                return 1;
+        }
+    }
+    if (argc == 0) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    struct job job;
+    job.names = argv;
+    job.count = argc;
+    job.results = calloc(argc, sizeof(struct result));
+    if (!job.results) {
+        fputs("bbcfile: out of memory\n", stderr);
+        return 2;
+    }
+    bbcutil_parallel(job.count, threads, worker, &job);
+
+    int status = 0;
+    for (unsigned ix = 0; ix < job.count; ix++) {
+        struct result *res = job.results + ix;
+        if (!res->loaded)
+            status = 2;
+        else if (res->fmt.kind == BBCUTIL_UNKNOWN)
+            printf("%s: unknown\n", argv[ix]);
+        else if (res->fmt.kind == BBCUTIL_DATA)
+            printf("%s: %s, %u items (confidence %u%%)\n", argv[ix], bbcutil_kind_name(res->fmt.kind), res->fmt.lines, res->fmt.confidence);
+        else
+            printf("%s: %s program, %u lines (confidence %u%%)\n", argv[ix], bbcutil_kind_name(res->fmt.kind), res->fmt.lines, res->fmt.confidence);
+    }
+    free(job.results);
+    return status;
+}
@@ -0,0 +1,440 @@
+#ifndef BBCUTIL_INC
+#define BBCUTIL_INC
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+    BBCUTIL_OK,
+    BBCUTIL_EOF,
+    BBCUTIL_BADHDR,
+    BBCUTIL_NOMEM,
+    BBCUTIL_RANGE,
+    BBCUTIL_BADSTYLE,
+    BBCUTIL_IOERR
+} bbcutil_res;
+
+/* A regular file member of a tar archive.  Zero-initialise before the
+ * first call to bbcutil_tar_read, the buffers are re-used by subsequent
+ * calls and released by bbcutil_tar_free. */
+
+typedef struct {
+    char *name;
+    unsigned char *data;
+    size_t size;
+    size_t cap;
+    long mtime;
+} bbcutil_member;
+
+extern bbcutil_res bbcutil_tar_read(FILE *fp, bbcutil_member *mem);
+extern void bbcutil_tar_free(bbcutil_member *mem);
+extern bbcutil_res bbcutil_tar_write(FILE *fp, const char *name, const void *data, size_t size, long mtime);
+extern bbcutil_res bbcutil_tar_end(FILE *fp);
+
+/* Loading whole files into memory and saving them.  Errors are reported
+ * on stderr prefixed with the program name.  Saving replaces a file only
+ * once the new one is completely written, keeping its mode. */
+
+typedef struct bbcutil_batch bbcutil_batch;
+
+extern unsigned char *bbcutil_load(const char *prog, const char *fn, unsigned char **end);
+extern bool bbcutil_save(const char *prog, const char *fn, const unsigned char *data, size_t size);
+extern bbcutil_batch *bbcutil_batch_open(const char *prog, char **names, unsigned count, unsigned depth);
+extern unsigned char *bbcutil_batch_next(bbcutil_batch *b, const char **fn, unsigned char **end);
+extern void bbcutil_batch_close(bbcutil_batch *b);
+
+/* Work on count items shared between threads, the calling thread being
+ * one of them, with threads less than 1 for one per processor online.
+ * fn is run once in each thread and takes the index of each item it is
+ * to work on from bbcutil_work_next until that returns false, so it can
+ * keep state of its own from one item to the next.  bbcutil_parallel
+ * returns when all are done. */
+
+typedef struct bbcutil_work bbcutil_work;
+typedef void (*bbcutil_worker_fn)(bbcutil_work *work, void *ctx);
+
+extern void bbcutil_parallel(unsigned count, int threads, bbcutil_worker_fn fn, void *ctx);
+extern bool bbcutil_work_next(bbcutil_work *work, unsigned *ix);
+
+/* File format detection.  For programs prog_len is the offset of the
+ * end of program marker, confidence is a percentage. */
+
+typedef enum {
+    BBCUTIL_UNKNOWN,
+    BBCUTIL_WILSON,
+    BBCUTIL_RUSSELL,
+    BBCUTIL_COMAL,
+    BBCUTIL_DATA
+} bbcutil_kind;
+
+typedef struct {
+    bbcutil_kind kind;
+    unsigned confidence;
+    size_t prog_len;
+    unsigned lines;
+} bbcutil_fmt;
+
+extern bbcutil_kind bbcutil_sniff(const unsigned char *data, size_t size, bbcutil_fmt *fmt);
+extern const char *bbcutil_kind_name(bbcutil_kind kind);
+
+/* Iteration over a tokenised program in place.  kind is one of WILSON,
+ * RUSSELL or COMAL.  The line iterator stops at the end of program marker
+ * or at the first line whose length would overrun the buffer.  Within a
+ * line, text runs from after the header (and COMAL indent byte) up to but
+ * not including the carriage return of a Russell line.
+ *
+ * Each token is a span [ptr, end) of the line.  For KEYWORD, LINENO and
+ * TAIL tok is the token byte; for TAIL (REM, DATA and the COMAL comment
+ * tokens) the span is the untokenised rest of the line after it.  For
+ * STRING the span includes the quotes and tok is non-zero if the closing
+ * quote was present.  PLAIN is a run of untokenised text. */
+
+typedef enum {
+    BBCUTIL_TOK_PLAIN,
+    BBCUTIL_TOK_KEYWORD,
+    BBCUTIL_TOK_LINENO,
+    BBCUTIL_TOK_STRING,
+    BBCUTIL_TOK_TAIL
+} bbcutil_toktype;
+
+typedef struct {
+    const unsigned char *ptr;
+    const unsigned char *end;
+    bbcutil_kind kind;
+} bbcutil_lines;
+
+typedef struct {
+    const unsigned char *start;
+    const unsigned char *end;
+    const unsigned char *text;
+    const unsigned char *text_end;
+    unsigned lineno;
+    unsigned indent;
+} bbcutil_line;
+
+typedef struct {
+    const unsigned char *ptr;
+    const unsigned char *end;
+    const uint8_t *classes;
+} bbcutil_toks;
+
+typedef struct {
+    bbcutil_toktype type;
+    unsigned tok;
+    unsigned lineno;
+    const unsigned char *ptr;
+    const unsigned char *end;
+} bbcutil_tok;
+
+extern void bbcutil_lines_init(bbcutil_lines *it, const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind);
+extern bool bbcutil_lines_next(bbcutil_lines *it, bbcutil_line *line);
+extern void bbcutil_toks_init(bbcutil_toks *it, const bbcutil_line *line, bbcutil_kind kind);
+extern bool bbcutil_toks_next(bbcutil_toks *it, bbcutil_tok *tok);
+extern unsigned bbcutil_lineno_decode(const unsigned char *ptr);
+extern void bbcutil_lineno_encode(unsigned char *ptr, unsigned lineno);
+
+/* A star command runs from a * at the start of a statement to the end
+ * of the line and is passed to the OS as it is.  Gives the *, or NULL
+ * if the line has none. */
+
+extern const unsigned char *bbcutil_star_command(const bbcutil_line *line);
+
+/* Identifiers used in a line of a BASIC program: variables with any
+ * % or $ suffix, arrays, the names of procedures and functions, which
+ * are definitions after DEF, and line number references.  The name is
+ * a span of the line, without the PROC or FN keyword or the bracket of
+ * an array. */
+
+typedef enum {
+    BBCUTIL_ID_VAR,
+    BBCUTIL_ID_ARRAY,
+    BBCUTIL_ID_PROC,
+    BBCUTIL_ID_FN,
+    BBCUTIL_ID_LINEREF
+} bbcutil_idtype;
+
+typedef struct {
+    bbcutil_toks toks;
+    const unsigned char *ptr;
+    const unsigned char *end;
+    unsigned name_tok;
+    bool def;
+    bool name_def;
+} bbcutil_idents;
+
+typedef struct {
+    bbcutil_idtype type;
+    bool def;
+    const unsigned char *name;
+    size_t len;
+    unsigned lineno;
+} bbcutil_ident;
+
+extern void bbcutil_idents_init(bbcutil_idents *it, const bbcutil_line *line);
+extern bool bbcutil_idents_next(bbcutil_idents *it, bbcutil_ident *id);
+
+/* An index of the lines of a program by line number, built in one walk
+ * or loaded from a sidecar file saved with the size and modification
+ * time of the program, which must match for it to load.  A sidecar whose
+ * offsets or line numbers do not ascend is rejected as BADHDR.  The
+ * depth function gives the indent depth after a line given that before
+ * it; the index records it at intervals and bbcutil_index_depth
+ * recovers it for any line.  bbcutil_index_find gives the index of the first line
+ * numbered at least lineno, or count if none is. */
+
+typedef unsigned (*bbcutil_depth_fn)(const bbcutil_line *line, unsigned depth);
+
+typedef struct {
+    bbcutil_kind kind;
+    unsigned count;
+    unsigned interval;
+    const uint32_t *offsets;
+    const uint16_t *linenos;
+    const uint16_t *depths;
+    void *mem;
+    size_t mem_size;
+    bool mapped;
+} bbcutil_index;
+
+extern bbcutil_res bbcutil_index_build(bbcutil_index *idx, const unsigned char *prog, const unsigned char *prog_end,
+                                       bbcutil_kind kind, bbcutil_depth_fn depth_fn);
+extern bbcutil_res bbcutil_index_save(const bbcutil_index *idx, const char *fn, uint64_t size, int64_t mtime);
+extern bbcutil_res bbcutil_index_load(bbcutil_index *idx, const char *fn, uint64_t size, int64_t mtime);
+extern unsigned bbcutil_index_find(const bbcutil_index *idx, unsigned lineno);
+extern unsigned bbcutil_index_depth(const bbcutil_index *idx, const unsigned char *prog, unsigned ix, bbcutil_depth_fn depth_fn);
+extern void bbcutil_index_free(bbcutil_index *idx);
+
+/* A hash map from 32 bit keys to 32 bit values, such as line numbers to
+ * new line numbers or file offsets.  The key 0xffffffff is reserved. */
+
+typedef struct {
+    uint32_t *slots;
+    unsigned mask;
+    unsigned count;
+} bbcutil_map;
+
+extern bbcutil_res bbcutil_map_init(bbcutil_map *map, unsigned expected);
+extern bbcutil_res bbcutil_map_put(bbcutil_map *map, uint32_t key, uint32_t value);
+extern bool bbcutil_map_get(const bbcutil_map *map, uint32_t key, uint32_t *value);
+extern void bbcutil_map_free(bbcutil_map *map);
+
+/* A 64 bit hash of a run of bytes, as for fingerprinting lines.  It is
+ * not stable across byte orders. */
+
+extern uint64_t bbcutil_hash(const void *data, size_t len, uint64_t seed);
+
+/* Renumber a Wilson or Russell BASIC program in place.  Line number
+ * references (the 0x8D token) are re-encoded to follow the lines they
+ * refer to; references to lines which do not exist are left unchanged
+ * and passed to the dangling callback, if given, with the new number of
+ * the line containing them.  A COMAL program has no line references so
+ * only its line headers change. */
+
+typedef void (*bbcutil_dangling_cb)(void *ctx, unsigned lineno, unsigned target);
+
+extern bbcutil_res bbcutil_renumber(unsigned char *prog, unsigned char *prog_end, bbcutil_kind kind,
+                                    unsigned start, unsigned step, bbcutil_dangling_cb dangling, void *ctx);
+
+/* The lines of a Wilson or Russell program that line number references
+ * go to, as a bitmap of 65536 bits in refs.  The result is false if
+ * there may be others: a GOTO, GOSUB or RESTORE with a computed line
+ * number, or a list of line numbers left as plain digits, as after ON. */
+
+#define BBCUTIL_REFS_SIZE 8192
+
+extern bool bbcutil_line_targets(const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind, uint8_t *refs);
+
+/* Listing a BASIC or COMAL program.  A listing is decoded once from the
+ * lines of a program held in memory at base, which must stay in place
+ * while the listing is in use, and can be rendered in any number of
+ * styles: plain, colour, dark, html, jsonl and binary.  Decoding appends
+ * to the listing and, if indent is given, starts from the indent depth
+ * it points to and leaves there that after the last line; COMAL lines
+ * are indented as the program has them.  bbcutil_basic_depth is the
+ * depth function to index a program with for listing.  Styles with links
+ * (html) link line number references and PROC/FN names only once the
+ * listing has been resolved. */
+
+typedef struct bbcutil_listing bbcutil_listing;
+typedef struct bbcutil_renderer bbcutil_renderer;
+
+extern bbcutil_listing *bbcutil_listing_new(void);
+extern void bbcutil_listing_clear(bbcutil_listing *lst, const unsigned char *base);
+extern bbcutil_res bbcutil_listing_decode(bbcutil_listing *lst, const unsigned char *prog, const unsigned char *prog_end,
+                                          bbcutil_kind kind, unsigned *indent, bool doindent);
+extern bbcutil_res bbcutil_listing_range(bbcutil_listing *lst, const bbcutil_index *idx, unsigned first, unsigned last, bool doindent);
+extern bbcutil_res bbcutil_listing_resolve(bbcutil_listing *lst);
+extern void bbcutil_listing_free(bbcutil_listing *lst);
+extern size_t bbcutil_listing_tokens(const bbcutil_listing *lst);
+extern unsigned bbcutil_basic_depth(const bbcutil_line *line, unsigned depth);
+
+/* The BASIC tokens for a keyword, ignoring case, into toks which has
+ * room for 128.  Some pseudo-variables have two, one for assignment. */
+
+extern unsigned bbcutil_keyword_tokens(const char *name, size_t len, unsigned char *toks);
+
+extern bbcutil_res bbcutil_renderer_new(const char *style, size_t len, bbcutil_renderer **rend);
+extern bool bbcutil_renderer_links(const bbcutil_renderer *rend);
+extern void bbcutil_render(const bbcutil_renderer *rend, const bbcutil_listing *lst, FILE *ofp);
+extern void bbcutil_renderer_free(bbcutil_renderer *rend);
+
+/* The keywords of a dialect, generated from dialects.txt by mktables.
+ * keywords gives the text of each token byte and how it is listed and
+ * classes the kind of each byte to the token iterator.  match has the
+ * keywords in the order they are tried when tokenising, those starting
+ * with the character ch from starts[ch] up to starts[ch + 1]. */
+
+#define BBCUTIL_KW_SPC_BEFORE 0x01
+#define BBCUTIL_KW_SPC_AFTER  0x02
+#define BBCUTIL_KW_INC_INDENT 0x04
+#define BBCUTIL_KW_DEC_INDENT 0x08
+#define BBCUTIL_KW_SKIP_EOL   0x10
+#define BBCUTIL_KW_SKIP_TWO   0x20
+#define BBCUTIL_KW_LINEREF    0x40
+
+#define BBCUTIL_MT_COND   0x01
+#define BBCUTIL_MT_MID    0x02
+#define BBCUTIL_MT_START  0x04
+#define BBCUTIL_MT_FNPROC 0x08
+#define BBCUTIL_MT_LINENO 0x10
+#define BBCUTIL_MT_REM    0x20
+#define BBCUTIL_MT_PSEUDO 0x40
+
+#define BBCUTIL_CL_PLAIN   0
+#define BBCUTIL_CL_KEYWORD 1
+#define BBCUTIL_CL_LINENO  2
+#define BBCUTIL_CL_QUOTE   3
+#define BBCUTIL_CL_TAIL    4
+#define BBCUTIL_CL_SKIPTWO 5
+
+typedef struct {
+    char text[14];
+    uint8_t flags;
+} bbcutil_keyword;
+
+typedef struct {
+    char text[14];
+    uint8_t len;
+    uint8_t token;
+    uint8_t flags;
+} bbcutil_match;
+
+typedef struct {
+    const bbcutil_keyword *keywords;
+    const uint8_t *classes;
+    const bbcutil_match *match;
+    const uint16_t *starts;
+} bbcutil_dialect;
+
+extern const bbcutil_dialect bbcutil_basic_dialect;
+extern const bbcutil_dialect bbcutil_comal_dialect;
+
+/* Templates for the output made from each program, compiled once and
+ * written for any number of programs.  In a template %f is replaced by
+ * the name of the program, %p by the program itself, as written by the
+ * program function, %l by its line count, %s by its size in bytes, %d
+ * by its dialect and %t by its modification time, or the current time
+ * if that is negative.  % before any other character stands for that
+ * character.  With html set the name is escaped for html. */
+
+typedef struct bbcutil_template bbcutil_template;
+
+typedef struct {
+    const char *name;
+    size_t size;
+    unsigned lines;
+    bbcutil_kind kind;
+    int64_t mtime;
+    void (*program)(void *ctx, FILE *ofp);
+    void *ctx;
+    bool html;
+} bbcutil_tmpl_vars;
+
+extern bbcutil_template *bbcutil_template_compile(const unsigned char *data, size_t size);
+extern bool bbcutil_template_uses(const bbcutil_template *tmpl, int subst);
+extern void bbcutil_template_write(const bbcutil_template *tmpl, const bbcutil_tmpl_vars *vars, FILE *ofp);
+extern void bbcutil_template_free(bbcutil_template *tmpl);
+
+/* Statistics for the --stats option of the converters: the time spent
+ * in each phase, measured with bbcutil_clock, and how much went through.
+ * The tokens by class are only counted, on the hot paths of decoding and
+ * tokenising, when built with BBCUTIL_TOKEN_STATS defined.  Those counts
+ * are kept per thread and moved into the statistics by collect. */
+
+typedef enum {
+    BBCUTIL_PH_LOAD,
+    BBCUTIL_PH_SNIFF,
+    BBCUTIL_PH_DECODE,
+    BBCUTIL_PH_RENDER,
+    BBCUTIL_PH_WRITE,
+    BBCUTIL_PHASES
+} bbcutil_phase;
+
+typedef enum {
+    BBCUTIL_TC_KEYWORD,
+    BBCUTIL_TC_STRING,
+    BBCUTIL_TC_TAIL,
+    BBCUTIL_TC_LINEREF,
+    BBCUTIL_TOKCLASSES
+} bbcutil_tokclass;
+
+typedef struct {
+    uint64_t start;
+    uint64_t ns[BBCUTIL_PHASES];
+    uint64_t files;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t lines;
+    uint64_t tokens;
+    uint64_t classes[BBCUTIL_TOKCLASSES];
+} bbcutil_stats;
+
+#define BBCUTIL_STATS_TEXT 1
+#define BBCUTIL_STATS_JSON 2
+
+#ifdef BBCUTIL_TOKEN_STATS
+extern _Thread_local uint64_t bbcutil_token_counts[BBCUTIL_TOKCLASSES];
+#define BBCUTIL_COUNT_TOKEN(class) (bbcutil_token_counts[class]++)
+#else
+#define BBCUTIL_COUNT_TOKEN(class) ((void)0)
+#endif
+
+extern uint64_t bbcutil_clock(void);
+extern int bbcutil_stats_option(const char *arg);
+extern void bbcutil_stats_init(bbcutil_stats *st);
+extern uint64_t bbcutil_stats_lap(bbcutil_stats *st, bbcutil_phase phase, uint64_t mark);
+extern void bbcutil_stats_collect(bbcutil_stats *st);
+extern void bbcutil_stats_merge(bbcutil_stats *st, const bbcutil_stats *from);
+extern void bbcutil_stats_report(const char *prog, bbcutil_stats *st, int mode, FILE *fp);
+
+/* Tracing for --trace: a span of time for each phase of each file on
+ * each thread, written when the trace is closed as Chrome trace event
+ * JSON, which Perfetto and chrome://tracing read.  Recording a span
+ * takes no lock; every thread which recorded any must be done before
+ * the trace is closed. */
+
+extern bool bbcutil_trace_open(const char *fn);
+extern bool bbcutil_tracing(void);
+extern void bbcutil_trace_span(bbcutil_phase phase, const char *file, uint64_t start, uint64_t end);
+extern bool bbcutil_trace_close(const char *prog);
+
+/* HTML escaping of program text. */
+
+extern int bbcutil_html_putc(int ch, FILE *fp);
+extern void bbcutil_html_write(const unsigned char *text, size_t len, FILE *fp);
+
+/* JSON escaping of program text, without the surrounding quotes. */
+
+extern int bbcutil_json_putc(int ch, FILE *fp);
+extern void bbcutil_json_write(const unsigned char *text, size_t len, FILE *fp);
+
+/* The value of an option taking a number from 0 to max, either joined
+ * to it, as in -s10, or as the next argument, which is then taken. */
+
+extern bool bbcutil_number_arg(const char *arg, int *argc, char ***argv, unsigned max, unsigned *value);
+
+extern const char *bbcutil_rmsg(bbcutil_res res);
+
+#endif
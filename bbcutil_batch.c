@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Batch loader for long lists of small files.  Where io_uring is
+ * available the open, statx and read for the next few files are kept
+ * in flight while the caller converts the file already delivered.  Any
+ * file that fails on the ring, and every file when io_uring cannot be
+ * set up, is loaded by bbcutil_load so error reporting is unchanged. */
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define OP_OPEN  0
+#define OP_STATX 1
+#define OP_READ  2
+#define OP_CLOSE 3
+
+struct slot {
+    int fd;
+    unsigned pending;
+    bool failed;
+    bool ready;
+    unsigned char *data;
+    size_t size;
+    size_t done;
+#ifdef USE_IO_URING
+    struct statx stx;
+#endif
+};
+
+struct bbcutil_batch {
+    const char *prog;
+    char **names;
+    unsigned count;
+    unsigned depth;
+    unsigned next_open;
+    unsigned next_take;
+    struct slot *slots;
+    int ring_fd;
+#ifdef USE_IO_URING
+    unsigned sq_entries;
+    unsigned to_submit;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    size_t sqe_len;
+#endif
+};
+
+#ifdef USE_IO_URING
+
+static bool ring_setup(bbcutil_batch *b)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, b->depth * 2, &p);
+    if (fd < 0)
+        return false;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(fd);
+        return false;
+    }
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_len > sq_len)
+        sq_len = cq_len;
+    unsigned char *sq = mmap(NULL, sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    size_t sqe_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqe_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(sq, sq_len);
+        close(fd);
+        return false;
+    }
+    b->ring_fd = fd;
+    b->sq_entries = p.sq_entries;
+    b->sq_ptr = sq;
+    b->sq_len = sq_len;
+    b->sqes = sqes;
+    b->sqe_len = sqe_len;
+    b->sq_head = (unsigned *)(sq + p.sq_off.head);
+    b->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    b->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    b->sq_array = (unsigned *)(sq + p.sq_off.array);
+    b->cq_head = (unsigned *)(sq + p.cq_off.head);
+    b->cq_tail = (unsigned *)(sq + p.cq_off.tail);
+    b->cq_mask = (unsigned *)(sq + p.cq_off.ring_mask);
+    b->cqes = (struct io_uring_cqe *)(sq + p.cq_off.cqes);
+    return true;
+}
+
+static void ring_close(bbcutil_batch *b)
+{
+    munmap(b->sqes, b->sqe_len);
+    munmap(b->sq_ptr, b->sq_len);
+    close(b->ring_fd);
+    b->ring_fd = -1;
+}
+
+static int ring_enter(bbcutil_batch *b, unsigned wait)
+{
+    for (;;) {
+        int res = syscall(__NR_io_uring_enter, b->ring_fd, b->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (res >= 0) {
+            b->to_submit -= res;
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return -1;
+    }
+}
+
+static struct io_uring_sqe *ring_sqe(bbcutil_batch *b, unsigned ix, unsigned op)
+{
+    unsigned tail = *b->sq_tail;
+    if (tail - __atomic_load_n(b->sq_head, __ATOMIC_ACQUIRE) >= b->sq_entries) {
+        if (ring_enter(b, 0))
+            return NULL;
+        if (tail - __atomic_load_n(b->sq_head, __ATOMIC_ACQUIRE) >= b->sq_entries)
+            return NULL;
+    }
+    unsigned pos = tail & *b->sq_mask;
+    struct io_uring_sqe *sqe = b->sqes + pos;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = ((uint64_t)ix << 2) | op;
+    b->sq_array[pos] = pos;
+    __atomic_store_n(b->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    b->to_submit++;
+    return sqe;
+}
+
+static void ring_close_fd(bbcutil_batch *b, struct slot *s)
+{
+    if (s->fd >= 0) {
+        struct io_uring_sqe *sqe = ring_sqe(b, 0, OP_CLOSE);
+        if (sqe) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = s->fd;
+        }
+        else
+            close(s->fd);
+        s->fd = -1;
+    }
+}
+
+static void ring_read(bbcutil_batch *b, unsigned ix, struct slot *s)
+{
+    struct io_uring_sqe *sqe = ring_sqe(b, ix, OP_READ);
+    if (sqe) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = s->fd;
+        sqe->addr = (uintptr_t)(s->data + s->done);
+        sqe->len = s->size - s->done;
+        sqe->off = s->done;
+        s->pending++;
+    }
+    else
+        s->failed = true;
+}
+
+static void ring_open(bbcutil_batch *b, unsigned ix)
+{
+    struct slot *s = b->slots + ix % b->depth;
+    const char *fn = b->names[ix];
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    struct io_uring_sqe *sqe = ring_sqe(b, ix, OP_OPEN);
+    if (sqe) {
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)fn;
+        sqe->open_flags = O_RDONLY|O_CLOEXEC;
+        s->pending++;
+        if ((sqe = ring_sqe(b, ix, OP_STATX))) {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)fn;
+            sqe->len = STATX_SIZE;
+            sqe->off = (uintptr_t)&s->stx;
+            s->pending++;
+            return;
+        }
+    }
+    s->failed = true;
+    if (!s->pending)
+        s->ready = true;
+}
+
+static void ring_complete(bbcutil_batch *b, unsigned ix, unsigned op, int res)
+{
+    struct slot *s = b->slots + ix % b->depth;
+    s->pending--;
+    if (res < 0)
+        s->failed = true;
+    else if (op == OP_OPEN)
+        s->fd = res;
+    else if (op == OP_READ) {
+        if (res == 0)
+            s->failed = true;
+        else
+            s->done += res;
+    }
+    if (s->pending)
+        return;
+    if (!s->failed && !s->data) {
+        s->size = s->stx.stx_size;
+        if (s->size == 0 || !(s->data = malloc(s->size)))
+            s->failed = true;
+    }
+    if (!s->failed && s->done < s->size) {
+        ring_read(b, ix, s);
+        if (!s->failed)
+            return;
+    }
+    ring_close_fd(b, s);
+    s->ready = true;
+}
+
+static bool ring_reap(bbcutil_batch *b)
+{
+    if (ring_enter(b, 1))
+        return false;
+    unsigned head = *b->cq_head;
+    unsigned tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = b->cqes + (head & *b->cq_mask);
+        unsigned op = cqe->user_data & 3;
+        if (op != OP_CLOSE)
+            ring_complete(b, cqe->user_data >> 2, op, cqe->res);
+        head++;
+    }
+    __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void ring_abandon(bbcutil_batch *b)
+{
+    /* the kernel may still own the buffers of anything in flight so
+     * they are deliberately leaked rather than freed */
+    ring_close(b);
+    for (unsigned ix = b->next_take; ix < b->next_open; ix++) {
+        struct slot *s = b->slots + ix % b->depth;
+        if (s->fd >= 0)
+            close(s->fd);
+        s->fd = -1;
+        s->data = NULL;
+        s->failed = s->ready = true;
+    }
+}
+
+#endif
+
+bbcutil_batch *bbcutil_batch_open(const char *prog, char **names, unsigned count, unsigned depth)
+{
+    bbcutil_batch *b = calloc(1, sizeof(bbcutil_batch));
+    if (b) {
+        b->prog = prog;
+        b->names = names;
+        b->count = count;
+        b->depth = depth ? depth : 1;
+        b->ring_fd = -1;
+#ifdef USE_IO_URING
+        if (count > 1) {
+            if ((b->slots = calloc(b->depth, sizeof(struct slot)))) {
+                if (!ring_setup(b)) {
+                    free(b->slots);
+                    b->slots = NULL;
+                }
+            }
+        }
+#endif
+    }
+    return b;
+}
+
+unsigned char *bbcutil_batch_next(bbcutil_batch *b, const char **fn, unsigned char **end)
+{
+    if (b->next_take >= b->count) {
+        *fn = NULL;
+        return NULL;
+    }
+    unsigned ix = b->next_take;
+    *fn = b->names[ix];
+#ifdef USE_IO_URING
+    if (b->ring_fd >= 0) {
+        while (b->next_open < b->count && b->next_open < ix + b->depth)
+            ring_open(b, b->next_open++);
+        struct slot *s = b->slots + ix % b->depth;
+        while (!s->ready) {
+            if (!ring_reap(b)) {
+                ring_abandon(b);
+                break;
+            }
+        }
+        b->next_take++;
+        if (!s->failed) {
+            *end = s->data + s->size;
+            return s->data;
+        }
+        free(s->data);
+        s->data = NULL;
+        return bbcutil_load(b->prog, *fn, end);
+    }
+#endif
+    b->next_take++;
+    return bbcutil_load(b->prog, *fn, end);
+}
+
+void bbcutil_batch_close(bbcutil_batch *b)
+{
+#ifdef USE_IO_URING
+    if (b->ring_fd >= 0) {
+        for (unsigned ix = b->next_take; ix < b->next_open; ix++) {
+            struct slot *s = b->slots + ix % b->depth;
+            while (!s->ready) {
+                if (!ring_reap(b)) {
+                    ring_abandon(b);
+                    break;
+                }
+            }
+            free(s->data);
+            s->data = NULL;
+        }
+        if (b->ring_fd >= 0)
+            ring_close(b);
+    }
+#endif
+    free(b->slots);
+    free(b);
+}
@@ -0,0 +1,91 @@
+#include "bbcutil.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* HTML escaping for text copied from a program.  The markup characters
+ * and the BBC top-bit characters are replaced from a table and the clean
+ * runs between them are written with a single fwrite.  Top-bit characters
+ * from 0xA0 are written as Latin-1 character references.  Those from 0x80
+ * to 0x9F would be C1 controls, which HTML does not allow and browsers
+ * read as Windows-1252, so they are written as spaces, which is how MODE 7
+ * shows them as teletext control codes.  On SSE2 the search for the next
+ * byte needing an escape is done sixteen bytes at a time. */
+
+struct escape {
+    uint8_t len;
+    char text[7];
+};
+
+#define E(n) [n] = { 6, "&#" #n ";" }
+#define C(n) [n] = { 1, " " }
+
+static const struct escape html_escapes[256] = {
+    ['&'] = { 5, "&amp;" },
+    ['<'] = { 4, "&lt;" },
+    ['>'] = { 4, "&gt;" },
+    C(128), C(129), C(130), C(131), C(132), C(133), C(134), C(135),
+    C(136), C(137), C(138), C(139), C(140), C(141), C(142), C(143),
+    C(144), C(145), C(146), C(147), C(148), C(149), C(150), C(151),
+    C(152), C(153), C(154), C(155), C(156), C(157), C(158), C(159),
+    E(160), E(161), E(162), E(163), E(164), E(165), E(166), E(167),
+    E(168), E(169), E(170), E(171), E(172), E(173), E(174), E(175),
+    E(176), E(177), E(178), E(179), E(180), E(181), E(182), E(183),
+    E(184), E(185), E(186), E(187), E(188), E(189), E(190), E(191),
+    E(192), E(193), E(194), E(195), E(196), E(197), E(198), E(199),
+    E(200), E(201), E(202), E(203), E(204), E(205), E(206), E(207),
+    E(208), E(209), E(210), E(211), E(212), E(213), E(214), E(215),
+    E(216), E(217), E(218), E(219), E(220), E(221), E(222), E(223),
+    E(224), E(225), E(226), E(227), E(228), E(229), E(230), E(231),
+    E(232), E(233), E(234), E(235), E(236), E(237), E(238), E(239),
+    E(240), E(241), E(242), E(243), E(244), E(245), E(246), E(247),
+    E(248), E(249), E(250), E(251), E(252), E(253), E(254), E(255),
+};
+
+#undef E
+#undef C
+
+static size_t html_scan(const unsigned char *text, size_t len)
+{
+    size_t pos = 0;
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&');
+    while (pos + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)), _mm_cmpeq_epi8(v, amp));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(m, v));
+        if (mask)
+            return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+#endif
+    while (pos < len && !html_escapes[text[pos]].len)
+        pos++;
+    return pos;
+}
+
+int bbcutil_html_putc(int ch, FILE *fp)
+{
+    const struct escape *e = html_escapes + (ch & 0xff);
+    if (e->len)
+        return fwrite(e->text, e->len, 1, fp) == 1 ? ch : EOF;
+    return putc(ch, fp);
+}
+
+void bbcutil_html_write(const unsigned char *text, size_t len, FILE *fp)
+{
+    const unsigned char *end = text + len;
+    while (text < end) {
+        size_t run = html_scan(text, end - text);
+        if (run)
+            fwrite(text, run, 1, fp);
+        text += run;
+        while (text < end && html_escapes[*text].len) {
+            const struct escape *e = html_escapes + *text++;
+            fwrite(e->text, e->len, 1, fp);
+        }
+    }
+}
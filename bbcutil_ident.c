@@ -0,0 +1,129 @@
+#include "bbcutil.h"
+
+/* Identifiers are found in the untokenised text between keywords.  A
+ * name starts with a letter, underscore or backquote and may end in a
+ * % or $ suffix, an array name being followed by a bracket.  Numbers,
+ * including hex and exponents, are skipped so the E of 1E5 is not taken
+ * for a variable.  The name after PROC or FN is not tokenised and is
+ * taken whole, as a definition when DEF comes first. */
+
+#define TOK_FN   0xa4
+#define TOK_DEF  0xdd
+#define TOK_PROC 0xf2
+
+static inline bool name_start(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '_' || ch == '`';
+}
+
+static inline bool name_char(int ch)
+{
+    return name_start(ch) || (ch >= '0' && ch <= '9');
+}
+
+static inline bool digit(int ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static inline bool hex_digit(int ch)
+{
+    return digit(ch) || (ch >= 'A' && ch <= 'F');
+}
+
+void bbcutil_idents_init(bbcutil_idents *it, const bbcutil_line *line)
+{
+    bbcutil_toks_init(&it->toks, line, BBCUTIL_WILSON);
+    it->ptr = it->end = NULL;
+    it->name_tok = 0;
+    it->def = false;
+    it->name_def = false;
+}
+
+bool bbcutil_idents_next(bbcutil_idents *it, bbcutil_ident *id)
+{
+    bbcutil_tok tok;
+    for (;;) {
+        const unsigned char *ptr = it->ptr;
+        const unsigned char *end = it->end;
+        if (ptr < end) {
+            int ch = *ptr;
+            if (it->name_tok) {
+                const unsigned char *start = ptr;
+                while (ptr < end && name_char(*ptr))
+                    ptr++;
+                id->type = it->name_tok == TOK_PROC ? BBCUTIL_ID_PROC : BBCUTIL_ID_FN;
+                id->def = it->name_def;
+                it->name_tok = 0;
+                it->ptr = ptr;
+                if (ptr > start) {
+                    id->name = start;
+                    id->len = ptr - start;
+                    id->lineno = 0;
+                    return true;
+                }
+                continue;
+            }
+            if (name_start(ch)) {
+                const unsigned char *start = ptr;
+                while (ptr < end && name_char(*ptr))
+                    ptr++;
+                if (ptr < end && (*ptr == '%' || *ptr == '$'))
+                    ptr++;
+                id->type = ptr < end && *ptr == '(' ? BBCUTIL_ID_ARRAY : BBCUTIL_ID_VAR;
+                id->def = false;
+                id->name = start;
+                id->len = ptr - start;
+                id->lineno = 0;
+                it->ptr = ptr;
+                it->def = false;
+                return true;
+            }
+            ptr++;
+            if (ch == '&')
+                while (ptr < end && hex_digit(*ptr))
+                    ptr++;
+            else if (digit(ch) || ch == '.') {
+                while (ptr < end && (digit(*ptr) || *ptr == '.'))
+                    ptr++;
+                if (end - ptr >= 2 && *ptr == 'E'
+                    && (digit(ptr[1]) || ((ptr[1] == '-' || ptr[1] == '+') && end - ptr >= 3 && digit(ptr[2])))) {
+                    ptr += 2;
+                    while (ptr < end && digit(*ptr))
+                        ptr++;
+                }
+            }
+            if (ch != ' ')
+                it->def = false;
+            it->ptr = ptr;
+            continue;
+        }
+        if (!bbcutil_toks_next(&it->toks, &tok))
+            return false;
+        if (tok.type == BBCUTIL_TOK_PLAIN) {
+            it->ptr = tok.ptr;
+            it->end = tok.end;
+            continue;
+        }
+        it->name_tok = 0;
+        switch(tok.type) {
+            case BBCUTIL_TOK_LINENO:
+                it->def = false;
+                id->type = BBCUTIL_ID_LINEREF;
+                id->def = false;
+                id->name = NULL;
+                id->len = 0;
+                id->lineno = tok.lineno;
+                return true;
+            case BBCUTIL_TOK_KEYWORD:
+                if (tok.tok == TOK_PROC || tok.tok == TOK_FN) {
+                    it->name_tok = tok.tok;
+                    it->name_def = it->def;
+                }
+                it->def = tok.tok == TOK_DEF;
+                break;
+            default:
+                it->def = false;
+        }
+    }
+}
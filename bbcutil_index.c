@@ -0,0 +1,192 @@
+#include "bbcutil.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A line index holds the file offset of each line, with the offset of
+ * the end of program marker after the last, the line numbers and the
+ * indent depth at every interval'th line.  Saved as a sidecar file it is
+ * in native byte order, as a cache rather than an interchange format,
+ * and is loaded by mapping it so a lookup touches only the pages the
+ * binary search visits. */
+
+#define INTERVAL 64
+
+struct idx_header {
+    char magic[4];
+    uint32_t kind;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t count;
+    uint32_t interval;
+};
+
+static const char idx_magic[4] = { 'B', 'L', 'I', 'X' };
+
+static size_t idx_size(unsigned count, unsigned interval)
+{
+    return sizeof(struct idx_header) + (count + 1) * sizeof(uint32_t) + count * sizeof(uint16_t)
+        + (count + interval - 1) / interval * sizeof(uint16_t);
+}
+
+static void idx_arrays(bbcutil_index *idx, unsigned char *mem)
+{
+    struct idx_header *hdr = (struct idx_header *)mem;
+    idx->kind = hdr->kind;
+    idx->count = hdr->count;
+    idx->interval = hdr->interval;
+    idx->offsets = (uint32_t *)(mem + sizeof(struct idx_header));
+    idx->linenos = (uint16_t *)(idx->offsets + hdr->count + 1);
+    idx->depths = idx->linenos + hdr->count;
+}
+
+bbcutil_res bbcutil_index_build(bbcutil_index *idx, const unsigned char *prog, const unsigned char *prog_end,
+                                bbcutil_kind kind, bbcutil_depth_fn depth_fn)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned count = 0;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line))
+        count++;
+
+    size_t size = idx_size(count, INTERVAL);
+    unsigned char *mem = malloc(size);
+    if (!mem)
+        return BBCUTIL_NOMEM;
+    struct idx_header *hdr = (struct idx_header *)mem;
+    memset(hdr, 0, sizeof(struct idx_header));
+    memcpy(hdr->magic, idx_magic, sizeof(idx_magic));
+    hdr->kind = kind;
+    hdr->count = count;
+    hdr->interval = INTERVAL;
+    idx_arrays(idx, mem);
+    idx->mem = mem;
+    idx->mem_size = size;
+    idx->mapped = false;
+
+    uint32_t *offsets = (uint32_t *)idx->offsets;
+    uint16_t *linenos = (uint16_t *)idx->linenos;
+    uint16_t *depths = (uint16_t *)idx->depths;
+    unsigned ix = 0, depth = 0;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        if (ix % INTERVAL == 0)
+            depths[ix / INTERVAL] = depth;
+        offsets[ix] = line.start - prog;
+        linenos[ix] = line.lineno;
+        if (depth_fn)
+            depth = depth_fn(&line, depth);
+        ix++;
+    }
+    offsets[ix] = lines.ptr - prog;
+    return BBCUTIL_OK;
+}
+
+bbcutil_res bbcutil_index_save(const bbcutil_index *idx, const char *fn, uint64_t size, int64_t mtime)
+{
+    struct idx_header *hdr = idx->mem;
+    if (idx->mapped)
+        return BBCUTIL_OK;
+    hdr->size = size;
+    hdr->mtime = mtime;
+    FILE *fp = fopen(fn, "wb");
+    if (!fp)
+        return BBCUTIL_IOERR;
+    /* a short index would only be rejected by the size check on the
+     * next load, so remove it rather than leave it behind. */
+    bool ok = fwrite(idx->mem, idx->mem_size, 1, fp) == 1;
+    if (fclose(fp) || !ok) {
+        remove(fn);
+        return BBCUTIL_IOERR;
+    }
+    return BBCUTIL_OK;
+}
+
+/* a sidecar is trusted only once its offsets ascend within the program
+ * and its line numbers ascend, as the lookups rely on both. */
+
+static bool idx_valid(const bbcutil_index *idx, uint64_t size)
+{
+    if (idx->kind != BBCUTIL_WILSON && idx->kind != BBCUTIL_RUSSELL && idx->kind != BBCUTIL_COMAL)
+        return false;
+    if (idx->offsets[idx->count] > size)
+        return false;
+    for (unsigned ix = 0; ix < idx->count; ix++)
+        if (idx->offsets[ix] >= idx->offsets[ix+1] || (ix && idx->linenos[ix-1] > idx->linenos[ix]))
+            return false;
+    return true;
+}
+
+bbcutil_res bbcutil_index_load(bbcutil_index *idx, const char *fn, uint64_t size, int64_t mtime)
+{
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? BBCUTIL_EOF : BBCUTIL_IOERR;
+    struct stat stb;
+    if (fstat(fd, &stb) || stb.st_size < sizeof(struct idx_header)) {
+        close(fd);
+        return BBCUTIL_BADHDR;
+    }
+    void *mem = mmap(NULL, stb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        return BBCUTIL_IOERR;
+    const struct idx_header *hdr = mem;
+    if (memcmp(hdr->magic, idx_magic, sizeof(idx_magic)) || hdr->size != size || hdr->mtime != mtime
+        || !hdr->interval || hdr->count >= stb.st_size || idx_size(hdr->count, hdr->interval) != stb.st_size) {
+        munmap(mem, stb.st_size);
+        return BBCUTIL_BADHDR;
+    }
+    idx_arrays(idx, mem);
+    if (!idx_valid(idx, size)) {
+        munmap(mem, stb.st_size);
+        return BBCUTIL_BADHDR;
+    }
+    idx->mem = mem;
+    idx->mem_size = stb.st_size;
+    idx->mapped = true;
+    return BBCUTIL_OK;
+}
+
+unsigned bbcutil_index_find(const bbcutil_index *idx, unsigned lineno)
+{
+    unsigned lo = 0, hi = idx->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (idx->linenos[mid] < lineno)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+unsigned bbcutil_index_depth(const bbcutil_index *idx, const unsigned char *prog, unsigned ix, bbcutil_depth_fn depth_fn)
+{
+    if (ix >= idx->count)
+        return 0;
+    unsigned from = ix / idx->interval * idx->interval;
+    unsigned depth = idx->depths[ix / idx->interval];
+    if (depth_fn && from < ix) {
+        bbcutil_lines lines;
+        bbcutil_line line;
+        bbcutil_lines_init(&lines, prog + idx->offsets[from], prog + idx->offsets[ix], idx->kind);
+        while (bbcutil_lines_next(&lines, &line))
+            depth = depth_fn(&line, depth);
+    }
+    return depth;
+}
+
+void bbcutil_index_free(bbcutil_index *idx)
+{
+    if (idx->mapped)
+        munmap(idx->mem, idx->mem_size);
+    else
+        free(idx->mem);
+    idx->mem = NULL;
+}
@@ -0,0 +1,142 @@
+#include "bbcutil.h"
+
+/* Iteration over the lines of a program and the tokens within a line,
+ * directly over the program bytes.  Nothing is allocated or copied, the
+ * spans returned point into the program. */
+
+#define TOK_ELSE 0x8b
+#define TOK_THEN 0x8c
+
+void bbcutil_lines_init(bbcutil_lines *it, const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind)
+{
+    it->ptr = prog;
+    it->end = prog_end;
+    it->kind = kind;
+}
+
+bool bbcutil_lines_next(bbcutil_lines *it, bbcutil_line *line)
+{
+    const unsigned char *ptr = it->ptr;
+    size_t avail = it->end - ptr;
+    unsigned len;
+    if (it->kind == BBCUTIL_RUSSELL) {
+        if (avail < 4 || (len = ptr[0]) < 4 || len > avail)
+            return false;
+        line->lineno = ptr[1] | (ptr[2] << 8);
+        line->indent = 0;
+        line->text = ptr + 3;
+        line->text_end = ptr + len - 1;
+    }
+    else {
+        unsigned hdr = it->kind == BBCUTIL_COMAL ? 5 : 4;
+        if (avail < hdr || ptr[1] == 0xff || (len = ptr[3]) < hdr || len > avail)
+            return false;
+        line->lineno = (ptr[1] << 8) | ptr[2];
+        line->indent = hdr == 5 ? ptr[4] : 0;
+        line->text = ptr + hdr;
+        line->text_end = ptr + len;
+    }
+    line->start = ptr;
+    line->end = ptr + len;
+    it->ptr = ptr + len;
+    return true;
+}
+
+void bbcutil_toks_init(bbcutil_toks *it, const bbcutil_line *line, bbcutil_kind kind)
+{
+    it->ptr = line->text;
+    it->end = line->text_end;
+    it->classes = kind == BBCUTIL_COMAL ? bbcutil_comal_dialect.classes : bbcutil_basic_dialect.classes;
+}
+
+bool bbcutil_toks_next(bbcutil_toks *it, bbcutil_tok *tok)
+{
+    const unsigned char *ptr = it->ptr;
+    const unsigned char *end = it->end;
+    if (ptr >= end)
+        return false;
+    const uint8_t *classes = it->classes;
+    tok->ptr = ptr;
+    unsigned ch = *ptr++;
+    switch(classes[ch]) {
+        case BBCUTIL_CL_PLAIN:
+            while (ptr < end && classes[*ptr] == BBCUTIL_CL_PLAIN)
+                ptr++;
+            tok->type = BBCUTIL_TOK_PLAIN;
+            tok->tok = 0;
+            break;
+        case BBCUTIL_CL_LINENO:
+            if (end - ptr >= 3) {
+                tok->type = BBCUTIL_TOK_LINENO;
+                tok->tok = ch;
+                tok->lineno = bbcutil_lineno_decode(ptr);
+                ptr += 3;
+                break;
+            }
+            /* fall through */
+        case BBCUTIL_CL_KEYWORD:
+            tok->type = BBCUTIL_TOK_KEYWORD;
+            tok->tok = ch;
+            break;
+        case BBCUTIL_CL_SKIPTWO:
+            tok->type = BBCUTIL_TOK_KEYWORD;
+            tok->tok = ch;
+            ptr = (end - ptr) > 2 ? ptr + 2 : end;
+            break;
+        case BBCUTIL_CL_QUOTE:
+            while (ptr < end && *ptr != '"')
+                ptr++;
+            tok->type = BBCUTIL_TOK_STRING;
+            tok->tok = ptr < end;
+            if (ptr < end)
+                ptr++;
+            break;
+        case BBCUTIL_CL_TAIL:
+            tok->type = BBCUTIL_TOK_TAIL;
+            tok->tok = ch;
+            tok->ptr = ptr;
+            ptr = end;
+            break;
+    }
+    tok->end = ptr;
+    it->ptr = ptr;
+    return true;
+}
+
+unsigned bbcutil_lineno_decode(const unsigned char *ptr)
+{
+    unsigned b1 = ptr[0];
+    unsigned lsb = ((b1 & 0x30) << 2) ^ ptr[1];
+    unsigned msb = ((b1 & 0x0c) << 4) ^ ptr[2];
+    return (msb << 8) | lsb;
+}
+
+void bbcutil_lineno_encode(unsigned char *ptr, unsigned lineno)
+{
+    ptr[0] = (((lineno & 0xc0) ^ 0x40) >> 2) | (((lineno & 0xc000) ^ 0x4000) >> 12) | 0x40;
+    ptr[1] = (lineno & 0x3f) | 0x40;
+    ptr[2] = ((lineno >> 8) & 0x3f) | 0x40;
+}
+
+const unsigned char *bbcutil_star_command(const bbcutil_line *line)
+{
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    bool start = true;
+    bbcutil_toks_init(&it, line, BBCUTIL_WILSON);
+    while (bbcutil_toks_next(&it, &tok)) {
+        if (tok.type == BBCUTIL_TOK_PLAIN) {
+            for (const unsigned char *ptr = tok.ptr; ptr < tok.end; ptr++) {
+                if (*ptr == '*' && start)
+                    return ptr;
+                if (*ptr == ':')
+                    start = true;
+                else if (*ptr != ' ')
+                    start = false;
+            }
+        }
+        else
+            start = tok.type == BBCUTIL_TOK_KEYWORD && (tok.tok == TOK_THEN || tok.tok == TOK_ELSE);
+    }
+    return NULL;
+}
@@ -0,0 +1,52 @@
+#include "bbcutil.h"
+
+/* JSON string escaping for text copied from a program.  Quotes,
+ * backslashes and control characters are escaped as JSON requires.  The
+ * BBC top-bit characters have no defined encoding so they are written as
+ * \u00XX, i.e. taken as Latin-1, which unlike HTML JSON allows for all of
+ * them.  Clean runs are written with a single fwrite. */
+
+static const uint8_t json_escape[256] = {
+    [0 ... 0x1f] = 1,
+    ['"'] = 1,
+    ['\\'] = 1,
+    [0x7f ... 0xff] = 1
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+void bbcutil_json_write(const unsigned char *text, size_t len, FILE *fp)
+{
+    const unsigned char *end = text + len;
+    while (text < end) {
+        const unsigned char *run = text;
+        while (text < end && !json_escape[*text])
+            text++;
+        if (text > run)
+            fwrite(run, text - run, 1, fp);
+        if (text < end) {
+            int ch = *text++;
+            if (ch == '"' || ch == '\\') {
+                putc('\\', fp);
+                putc(ch, fp);
+            }
+            else if (ch == '\n')
+                fputs("\\n", fp);
+            else if (ch == '\r')
+                fputs("\\r", fp);
+            else if (ch == '\t')
+                fputs("\\t", fp);
+            else {
+                char esc[6] = { '\\', 'u', '0', '0', hex_digits[ch >> 4], hex_digits[ch & 0x0f] };
+                fwrite(esc, sizeof(esc), 1, fp);
+            }
+        }
+    }
+}
+
+int bbcutil_json_putc(int ch, FILE *fp)
+{
+    unsigned char byte = ch;
+    bbcutil_json_write(&byte, 1, fp);
+    return ferror(fp) ? EOF : ch;
+}
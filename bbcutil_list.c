@@ -0,0 +1,839 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+struct outcfg {
+    const char *fmt_lineno;
+    const char *fmt_token;
+    const char *str_prefix;
+    const char *fmt_skipeol;
+    const char *gen_suffix;
+    const char *eol;
+    int (*put_char)(int ch, FILE *ofp);
+    void (*put_text)(const unsigned char *text, size_t len, FILE *ofp);
+    bool links;
+};
+
+static void put_raw(const unsigned char *text, size_t len, FILE *ofp)
+{
+    fwrite(text, len, 1, ofp);
+}
+
+static const struct outcfg cfg_plain =
+{
+    "%5u",
+    "%s",
+    "",
+    "%s",
+    "",
+    "\n",
+    fputc,
+    put_raw
+};
+
+static const struct outcfg cfg_colour =
+{
+    "\e[38;5;160m%5u\e[0m",
+    "\e[38;5;45m%s\e[0m",
+    "\e[38;5;166m",
+    "\e[38;5;128m%s",
+    "\e[0m",
+    "\n",
+    fputc,
+    put_raw
+};
+
+static const struct outcfg cfg_dark =
+{
+    "\e[38;5;124m%5u\e[0m",
+    "\e[38;5;20m%s\e[0m",
+    "\e[38;5;94m",
+    "\e[38;5;128m%s",
+    "\e[0m",
+    "\n",
+    fputc,
+    put_raw
+};
+
+static const struct outcfg cfg_html =
+{
+    "<span class=\"lineno\">%5u</span> ",
+    "<span class=\"token\">%s</span>",
+    "<span class=\"string\">",
+    "<span class=\"skipeol\">%s",
+    "</span>",
+    "\n",
+    bbcutil_html_putc,
+    bbcutil_html_write,
+    true
+};
+
+/* A program is decoded once into a stream of events which can then be
+ * rendered in any number of output styles.  Events refer back to the
+ * program text by offset rather than copying it, off being the offset
+ * in the file of the bytes the event was decoded from. */
+
+#define EV_LINE    0 /* val = line number, len = indent, arg = indenting */
+#define EV_TOKEN   1 /* arg = token, len = bytes after it which are not text */
+#define EV_LOWTOK  2 /* arg = token */
+#define EV_LINENO  3 /* val = line number */
+#define EV_SPACE   4
+#define EV_TEXT    5 /* len = length */
+#define EV_STRING  6 /* len = length, arg = terminated */
+#define EV_SKIPEOL 7 /* arg = token, len = length after the token */
+#define EV_EOL     8
+#define EV_NAME    9 /* len = length, arg = resolution, val = chain when resolving */
+
+/* resolution of line number references and PROC/FN names. */
+
+#define RES_DANGLING 0
+#define RES_FOUND    1
+#define RES_DEF      2
+#define RES_REDEF    3
+
+#define TOK_FN   0xa4
+#define TOK_DEF  0xdd
+#define TOK_PROC 0xf2
+
+struct event {
+    uint8_t type;
+    uint8_t arg;
+    uint16_t len;
+    uint32_t val;
+    uint32_t off;
+};
+
+struct bbcutil_listing {
+    const unsigned char *base;
+    struct event *ev;
+    size_t count;
+    size_t size;
+    bool resolved;
+    bool comal;
+};
+
+static bool ev_reserve(bbcutil_listing *lst, size_t extra)
+{
+    if (lst->count + extra > lst->size) {
+        size_t size = lst->size ? lst->size : 1024;
+        while (size < lst->count + extra)
+            size *= 2;
+        struct event *ev = realloc(lst->ev, size * sizeof(struct event));
+        if (!ev)
+            return false;
+        lst->ev = ev;
+        lst->size = size;
+    }
+    return true;
+}
+
+static inline void ev_push(bbcutil_listing *lst, unsigned type, unsigned arg, unsigned len, uint32_t val, uint32_t off)
+{
+    struct event *e = lst->ev + lst->count++;
+    e->type = type;
+    e->arg = arg;
+    e->len = len;
+    e->val = val;
+    e->off = off;
+}
+
+static inline void ev_text(bbcutil_listing *lst, const unsigned char *base, const unsigned char **run, const unsigned char *stop)
+{
+    if (*run) {
+        ev_push(lst, EV_TEXT, 0, stop - *run, 0, *run - base);
+        *run = NULL;
+    }
+}
+
+static inline const bbcutil_dialect *dialect(bool comal)
+{
+    return comal ? &bbcutil_comal_dialect : &bbcutil_basic_dialect;
+}
+
+static inline bool name_char(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '`';
+}
+
+static int scan_indent(const bbcutil_line *line, unsigned indent)
+{
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    int new_indent = indent;
+    bbcutil_toks_init(&it, line, BBCUTIL_WILSON);
+    while (bbcutil_toks_next(&it, &tok)) {
+        if (tok.type == BBCUTIL_TOK_STRING || !(tok.tok & 0x80))
+            continue;
+        unsigned flags = bbcutil_basic_dialect.keywords[tok.tok].flags;
+        if (flags & BBCUTIL_KW_DEC_INDENT)
+            --new_indent;
+        if (flags & BBCUTIL_KW_INC_INDENT)
+            ++new_indent;
+    }
+    return new_indent;
+}
+
+/* the indent carried to the next line, as decode_line returns it. */
+
+unsigned bbcutil_basic_depth(const bbcutil_line *line, unsigned depth)
+{
+    int new_indent = scan_indent(line, depth);
+    return new_indent < 0 ? depth : new_indent;
+}
+
+static unsigned decode_line(bbcutil_listing *lst, const unsigned char *base, const bbcutil_line *line, bbcutil_kind kind,
+                            unsigned indent, bool doindent)
+{
+    const bbcutil_keyword *keywords = dialect(lst->comal)->keywords;
+    bbcutil_toks it;
+    bbcutil_tok tok;
+    unsigned next = indent;
+    if (lst->comal)
+        /* COMAL keeps the indent of each line in the program. */
+        indent = next = line->indent;
+    else if (doindent) {
+        /* pre-scan the line for the indent it leaves, a decrease in
+         * which is applied immediately. */
+        next = bbcutil_basic_depth(line, indent);
+        if (next < indent)
+            indent = next;
+    }
+    ev_push(lst, EV_LINE, doindent, doindent ? indent : 0, line->lineno, line->start - base);
+    /* now decode the line */
+    bool did_space = true;
+    bool need_space = false;
+    bool want_name = false;
+    const unsigned char *run = NULL;
+    bbcutil_toks_init(&it, line, kind);
+    while (bbcutil_toks_next(&it, &tok)) {
+        bool name_next = want_name;
+        want_name = false;
+        if (tok.type == BBCUTIL_TOK_STRING) {
+            ev_text(lst, base, &run, tok.ptr);
+            need_space = false;
+            ev_push(lst, EV_STRING, tok.tok, tok.end - tok.ptr, 0, tok.ptr - base);
+            BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_STRING);
+        }
+        else if (tok.type == BBCUTIL_TOK_PLAIN || !(tok.tok & 0x80)) {
+            const unsigned char *ptr = tok.ptr;
+            if (name_next && tok.type == BBCUTIL_TOK_PLAIN) {
+                /* the name of a procedure or function follows the token */
+                while (ptr < tok.end && name_char(*ptr))
+                    ptr++;
+                if (ptr > tok.ptr) {
+                    ev_push(lst, EV_NAME, RES_DANGLING, ptr - tok.ptr, 0, tok.ptr - base);
+                    did_space = false;
+                }
+            }
+            for (; ptr < tok.end; ptr++) {
+                int ch = *ptr;
+                if (ch == ' ' || ch == ':') {
+                    did_space = true;
+                    need_space = false;
+                }
+                else
+                    did_space = false;
+                if (need_space && !did_space) {
+                    ev_text(lst, base, &run, ptr);
+                    need_space = false;
+                    did_space = true;
+                    ev_push(lst, EV_SPACE, 0, 0, 0, ptr - base);
+                }
+                if (keywords[ch].text[0]) {
+                    ev_text(lst, base, &run, ptr);
+                    ev_push(lst, EV_LOWTOK, ch, 0, 0, ptr - base);
+                }
+                else if (!run)
+                    run = ptr;
+            }
+        }
+        else {
+            const unsigned char *start = tok.type == BBCUTIL_TOK_TAIL ? tok.ptr - 1 : tok.ptr;
+            ev_text(lst, base, &run, start);
+            unsigned flags = keywords[tok.tok].flags;
+            if (!did_space && (need_space || (flags & BBCUTIL_KW_SPC_BEFORE)))
+                ev_push(lst, EV_SPACE, 0, 0, 0, start - base);
+            if (tok.type == BBCUTIL_TOK_TAIL) {
+                ev_push(lst, EV_SKIPEOL, tok.tok, tok.end - tok.ptr, 0, tok.ptr - base);
+                BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_TAIL);
+                break;
+            }
+            else if (tok.type == BBCUTIL_TOK_LINENO) {
+                ev_push(lst, EV_LINENO, 0, 0, tok.lineno, start - base);
+                BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_LINEREF);
+            }
+            else if (flags & BBCUTIL_KW_LINEREF)
+                break; /* truncated line number */
+            else {
+                ev_push(lst, EV_TOKEN, tok.tok, tok.end - start - 1, 0, start - base);
+                BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_KEYWORD);
+            }
+            did_space = need_space = false;
+            if (flags & BBCUTIL_KW_SPC_AFTER)
+                need_space = true;
+            want_name = !lst->comal && (tok.tok == TOK_PROC || tok.tok == TOK_FN);
+        }
+    }
+    ev_text(lst, base, &run, it.ptr);
+    ev_push(lst, EV_EOL, 0, 0, 0, it.ptr - base);
+    /* an increase in indent is applied afterwards ready for the next line */
+    return next;
+}
+
+bbcutil_listing *bbcutil_listing_new(void)
+{
+    return calloc(1, sizeof(bbcutil_listing));
+}
+
+void bbcutil_listing_clear(bbcutil_listing *lst, const unsigned char *base)
+{
+    lst->base = base;
+    lst->count = 0;
+    lst->resolved = false;
+}
+
+bbcutil_res bbcutil_listing_decode(bbcutil_listing *lst, const unsigned char *prog, const unsigned char *prog_end,
+                                   bbcutil_kind kind, unsigned *indent, bool doindent)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned depth = indent ? *indent : 0;
+    lst->comal = kind == BBCUTIL_COMAL;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        if (!ev_reserve(lst, 2 * (line.end - line.start) + 4))
+            return BBCUTIL_NOMEM;
+        depth = decode_line(lst, lst->base, &line, kind, depth, doindent);
+    }
+    if (indent)
+        *indent = depth;
+    lst->resolved = false;
+    return BBCUTIL_OK;
+}
+
+/* only the lines in range, plus up to an index interval before them to
+ * recover the indent, are decoded. */
+
+bbcutil_res bbcutil_listing_range(bbcutil_listing *lst, const bbcutil_index *idx, unsigned first, unsigned last, bool doindent)
+{
+    unsigned from = bbcutil_index_find(idx, first);
+    unsigned to = last < 0xffff ? bbcutil_index_find(idx, last + 1) : idx->count;
+    if (from >= to)
+        return BBCUTIL_OK;
+    unsigned indent = doindent && idx->kind != BBCUTIL_COMAL ? bbcutil_index_depth(idx, lst->base, from, bbcutil_basic_depth) : 0;
+    return bbcutil_listing_decode(lst, lst->base + idx->offsets[from], lst->base + idx->offsets[to], idx->kind, &indent, doindent);
+}
+
+/* the tokens in the listing, counted from the events when asked for
+ * rather than as they are decoded. */
+
+size_t bbcutil_listing_tokens(const bbcutil_listing *lst)
+{
+    size_t count = 0;
+    for (const struct event *e = lst->ev; e < lst->ev + lst->count; e++)
+        if (e->type == EV_TOKEN || e->type == EV_LOWTOK || e->type == EV_LINENO || e->type == EV_SKIPEOL)
+            count++;
+    return count;
+}
+
+void bbcutil_listing_free(bbcutil_listing *lst)
+{
+    if (lst) {
+        free(lst->ev);
+        free(lst);
+    }
+}
+
+struct tokstr {
+    char *text;
+    int len;
+};
+
+typedef void (*renderer)(const bbcutil_listing *lst, const bbcutil_renderer *rend, FILE *ofp);
+
+struct bbcutil_renderer {
+    const struct outcfg *ocfg;
+    renderer render;
+    struct tokstr tokens[2][128];
+    struct tokstr skipeol[2][128];
+    struct tokstr lineno_prefix;
+    struct tokstr lineno_suffix;
+};
+
+static void put_uint(unsigned value, FILE *ofp)
+{
+    char digits[10];
+    char *ptr = digits + sizeof(digits);
+    do
+        *--ptr = '0' + value % 10;
+    while (value /= 10);
+    fwrite(ptr, digits + sizeof(digits) - ptr, 1, ofp);
+}
+
+/* the id of a definition is the keyword and name, e.g. PROCfoo, and
+ * goes only on the first of a name defined twice. */
+
+static void render_name(const struct event *e, const unsigned char *base, FILE *ofp)
+{
+    const char *keyword = bbcutil_basic_dialect.keywords[base[e->off - 1]].text;
+    const unsigned char *name = base + e->off;
+    if (e->arg == RES_DANGLING)
+        fputs("<span class=\"dangling\">", ofp);
+    else if (e->arg == RES_REDEF)
+        fputs("<span class=\"defname\">", ofp);
+    else {
+        fputs(e->arg == RES_DEF ? "<span class=\"defname\" id=\"" : "<a class=\"call\" href=\"#", ofp);
+        fputs(keyword, ofp);
+        fwrite(name, e->len, 1, ofp);
+        fputs("\">", ofp);
+    }
+    fwrite(name, e->len, 1, ofp);
+    fputs(e->arg == RES_FOUND ? "</a>" : "</span>", ofp);
+}
+
+static void render(const bbcutil_listing *lst, const bbcutil_renderer *rend, FILE *ofp)
+{
+    const unsigned char *base = lst->base;
+    const struct outcfg *ocfg = rend->ocfg;
+    const struct tokstr *tokens = rend->tokens[lst->comal];
+    const struct tokstr *skipeol = rend->skipeol[lst->comal];
+    bool links = ocfg->links && lst->resolved;
+    const struct event *e = lst->ev;
+    const struct event *end = e + lst->count;
+    for (; e < end; e++) {
+        switch(e->type) {
+            case EV_LINE:
+                if (links) {
+                    fputs("<a id=\"L", ofp);
+                    put_uint(e->val, ofp);
+                    fputs("\"></a>", ofp);
+                }
+                if (rend->lineno_prefix.len >= 0) {
+                    char digits[10];
+                    char *ptr = digits + sizeof(digits);
+                    unsigned value = e->val;
+                    do
+                        *--ptr = '0' + value % 10;
+                    while (value /= 10);
+                    while (ptr > digits + sizeof(digits) - 5)
+                        *--ptr = ' ';
+                    fwrite(rend->lineno_prefix.text, rend->lineno_prefix.len, 1, ofp);
+                    fwrite(ptr, digits + sizeof(digits) - ptr, 1, ofp);
+                    fwrite(rend->lineno_suffix.text, rend->lineno_suffix.len, 1, ofp);
+                }
+                else
+                    fprintf(ofp, ocfg->fmt_lineno, e->val);
+                if (e->arg) {
+                    putc(' ', ofp);
+                    for (int i = e->len; i; --i) {
+                        putc(' ', ofp);
+                        putc(' ', ofp);
+                    }
+                }
+                break;
+            case EV_TOKEN:
+                fwrite(tokens[e->arg & 0x7f].text, tokens[e->arg & 0x7f].len, 1, ofp);
+                break;
+            case EV_LOWTOK:
+                fputs(dialect(lst->comal)->keywords[e->arg].text, ofp);
+                break;
+            case EV_LINENO:
+                if (!links)
+                    put_uint(e->val, ofp);
+                else if (e->arg == RES_FOUND) {
+                    fputs("<a class=\"lineref\" href=\"#L", ofp);
+                    put_uint(e->val, ofp);
+                    fputs("\">", ofp);
+                    put_uint(e->val, ofp);
+                    fputs("</a>", ofp);
+                }
+                else {
+                    fputs("<span class=\"dangling\">", ofp);
+                    put_uint(e->val, ofp);
+                    fputs("</span>", ofp);
+                }
+                break;
+            case EV_NAME:
+                if (links)
+                    render_name(e, base, ofp);
+                else
+                    ocfg->put_text(base + e->off, e->len, ofp);
+                break;
+            case EV_SPACE:
+                putc(' ', ofp);
+                break;
+            case EV_TEXT:
+                ocfg->put_text(base + e->off, e->len, ofp);
+                break;
+            case EV_STRING:
+                fputs(ocfg->str_prefix, ofp);
+                ocfg->put_text(base + e->off, e->len, ofp);
+                if (e->arg)
+                    fputs(ocfg->gen_suffix, ofp);
+                break;
+            case EV_SKIPEOL:
+                fwrite(skipeol[e->arg & 0x7f].text, skipeol[e->arg & 0x7f].len, 1, ofp);
+                ocfg->put_text(base + e->off, e->len, ofp);
+                fputs(ocfg->gen_suffix, ofp);
+                break;
+            case EV_EOL:
+                putc('\n', ofp);
+                break;
+        }
+    }
+}
+
+/* The structured styles give each line with its tokens and their byte
+ * offsets in the file but without the spacing added for readability.
+ * jsonl writes one JSON object per line. */
+
+static void json_item(const char *type, unsigned off, bool *first, FILE *ofp)
+{
+    fputs(&",{\"type\":\""[*first], ofp);
+    *first = false;
+    fputs(type, ofp);
+    fputs("\",\"offset\":", ofp);
+    put_uint(off, ofp);
+}
+
+static void render_jsonl(const bbcutil_listing *lst, const bbcutil_renderer *rend, FILE *ofp)
+{
+    const unsigned char *base = lst->base;
+    const struct tokstr *tokens = rend->tokens[lst->comal];
+    const struct event *e = lst->ev;
+    const struct event *end = e + lst->count;
+    bool first = true;
+    for (; e < end; e++) {
+        switch(e->type) {
+            case EV_LINE:
+                first = true;
+                fputs("{\"line\":", ofp);
+                put_uint(e->val, ofp);
+                fputs(",\"indent\":", ofp);
+                put_uint(e->len, ofp);
+                fputs(",\"offset\":", ofp);
+                put_uint(e->off, ofp);
+                fputs(",\"tokens\":[", ofp);
+                break;
+            case EV_TOKEN:
+                json_item("keyword", e->off, &first, ofp);
+                fputs(",\"token\":", ofp);
+                put_uint(e->arg, ofp);
+                fputs(",\"text\":\"", ofp);
+                fwrite(tokens[e->arg & 0x7f].text, tokens[e->arg & 0x7f].len, 1, ofp);
+                putc('"', ofp);
+                if (e->len) {
+                    fputs(",\"payload\":[", ofp);
+                    for (unsigned i = 1; i <= e->len; i++) {
+                        put_uint(base[e->off + i], ofp);
+                        putc(i < e->len ? ',' : ']', ofp);
+                    }
+                }
+                putc('}', ofp);
+                break;
+            case EV_LOWTOK:
+                json_item("keyword", e->off, &first, ofp);
+                fputs(",\"token\":", ofp);
+                put_uint(e->arg, ofp);
+                fputs(",\"text\":\"", ofp);
+                fputs(dialect(lst->comal)->keywords[e->arg].text, ofp);
+                fputs("\"}", ofp);
+                break;
+            case EV_LINENO:
+                json_item("lineref", e->off, &first, ofp);
+                fputs(",\"line\":", ofp);
+                put_uint(e->val, ofp);
+                putc('}', ofp);
+                break;
+            case EV_TEXT:
+            case EV_STRING:
+            case EV_NAME:
+                json_item(e->type == EV_TEXT ? "text" : e->type == EV_NAME ? "name" : "string", e->off, &first, ofp);
+                fputs(",\"text\":\"", ofp);
+                bbcutil_json_write(base + e->off, e->len, ofp);
+                fputs("\"}", ofp);
+                break;
+            case EV_SKIPEOL:
+                json_item("tail", e->off - 1, &first, ofp);
+                fputs(",\"token\":", ofp);
+                put_uint(e->arg, ofp);
+                fputs(",\"text\":\"", ofp);
+                fwrite(tokens[e->arg & 0x7f].text, tokens[e->arg & 0x7f].len, 1, ofp);
+                fputs("\",\"rest\":\"", ofp);
+                bbcutil_json_write(base + e->off, e->len, ofp);
+                fputs("\"}", ofp);
+                break;
+            case EV_EOL:
+                fputs("]}\n", ofp);
+                break;
+        }
+    }
+}
+
+/* binary writes one record per line, all values little-endian:
+ *   u16 length of the rest of the record
+ *   u16 line number, u8 indent, u32 offset of the line in the file
+ *   u8 offset of the first item from the start of the line
+ * followed by items which are a type byte then:
+ *   BIN_KEYWORD   u8 token
+ *   BIN_LINEREF   u16 line number
+ *   BIN_TEXT      u16 length, text
+ *   BIN_STRING    u16 length, text including the quotes
+ *   BIN_TAIL      u8 token, u16 length, text after the token
+ *   BIN_PAYLOAD   u8 token, u8 length, the bytes after the token which
+ *                 are not text, as after COMAL PROC and FUNC
+ * The items cover the line text contiguously so the offset of each is
+ * found by adding up the bytes each covers: one for a keyword, four for
+ * a line number reference and one more than the length for a tail or a
+ * payload. */
+
+#define BIN_KEYWORD 1
+#define BIN_LINEREF 2
+#define BIN_TEXT    3
+#define BIN_STRING  4
+#define BIN_TAIL    5
+#define BIN_PAYLOAD 6
+
+static inline unsigned char *put16(unsigned char *ptr, unsigned value)
+{
+    *ptr++ = value;
+    *ptr++ = value >> 8;
+    return ptr;
+}
+
+static void render_binary(const bbcutil_listing *lst, const bbcutil_renderer *rend, FILE *ofp)
+{
+    const unsigned char *base = lst->base;
+    /* each byte of a line makes at most four bytes of record */
+    unsigned char rec[1100];
+    unsigned char *ptr = rec;
+    uint32_t line_off = 0;
+    const struct event *e = lst->ev;
+    const struct event *end = e + lst->count;
+    for (; e < end; e++) {
+        if (e->type != EV_LINE && e->type != EV_SPACE && e->type != EV_EOL && rec[9] == 0xff)
+            rec[9] = e->off - line_off - (e->type == EV_SKIPEOL);
+        switch(e->type) {
+            case EV_LINE:
+                line_off = e->off;
+                ptr = put16(rec + 2, e->val);
+                *ptr++ = e->len < 0xff ? e->len : 0xff;
+                ptr = put16(ptr, line_off);
+                ptr = put16(ptr, line_off >> 16);
+                *ptr++ = 0xff;
+                break;
+            case EV_TOKEN:
+            case EV_LOWTOK:
+                *ptr++ = e->type == EV_TOKEN && e->len ? BIN_PAYLOAD : BIN_KEYWORD;
+                *ptr++ = e->arg;
+                if (e->type == EV_TOKEN && e->len) {
+                    *ptr++ = e->len;
+                    memcpy(ptr, base + e->off + 1, e->len);
+                    ptr += e->len;
+                }
+                break;
+            case EV_LINENO:
+                *ptr++ = BIN_LINEREF;
+                ptr = put16(ptr, e->val);
+                break;
+            case EV_TEXT:
+            case EV_NAME:
+            case EV_STRING:
+                *ptr++ = e->type == EV_STRING ? BIN_STRING : BIN_TEXT;
+                ptr = put16(ptr, e->len);
+                memcpy(ptr, base + e->off, e->len);
+                ptr += e->len;
+                break;
+            case EV_SKIPEOL:
+                *ptr++ = BIN_TAIL;
+                *ptr++ = e->arg;
+                ptr = put16(ptr, e->len);
+                memcpy(ptr, base + e->off, e->len);
+                ptr += e->len;
+                break;
+            case EV_EOL:
+                if (rec[9] == 0xff)
+                    rec[9] = 0;
+                put16(rec, ptr - rec - 2);
+                fwrite(rec, ptr - rec, 1, ofp);
+                break;
+        }
+    }
+}
+
+/* Line number references and PROC/FN names are resolved against the
+ * lines and definitions of the listing in two passes over the events,
+ * the first indexing the line numbers and definitions, the second
+ * marking each reference so rendering needs no lookups of its own.
+ * Line numbers are sixteen bits so a bitmap serves as their index, the
+ * definitions go in a hash map from the hash of the name to the first
+ * definition with that hash, the rest with it chained through val. */
+
+static uint32_t name_hash(const unsigned char *name, unsigned len)
+{
+    uint32_t hash = 2166136261u;
+    while (len--)
+        hash = (hash ^ *name++) * 16777619u;
+    return hash == 0xffffffff ? 0 : hash;
+}
+
+/* names are compared with the PROC or FN token before them; chain
+ * entries are event numbers plus one so that 0 ends the chain. */
+
+static const struct event *find_def(const bbcutil_listing *lst, const bbcutil_map *defs, uint32_t key, const struct event *e)
+{
+    const unsigned char *base = lst->base;
+    uint32_t link;
+    if (!bbcutil_map_get(defs, key, &link))
+        return NULL;
+    for (; link; link = lst->ev[link-1].val) {
+        const struct event *def = lst->ev + link - 1;
+        if (def->len == e->len && !memcmp(base + def->off - 1, base + e->off - 1, e->len + 1))
+            return def;
+    }
+    return NULL;
+}
+
+bbcutil_res bbcutil_listing_resolve(bbcutil_listing *lst)
+{
+    const unsigned char *base = lst->base;
+    uint64_t lines[65536 / 64] = { 0 };
+    bbcutil_map defs;
+    struct event *e;
+    struct event *end = lst->ev + lst->count;
+    bool def = false;
+    bool worked = true;
+    if (lst->resolved)
+        return BBCUTIL_OK;
+    if (bbcutil_map_init(&defs, 64) != BBCUTIL_OK)
+        return BBCUTIL_NOMEM;
+    for (e = lst->ev; e < end && worked; e++) {
+        if (e->type == EV_LINE)
+            lines[e->val >> 6] |= 1ULL << (e->val & 63);
+        else if (e->type == EV_TOKEN)
+            def = e->arg == TOK_DEF || (def && (e->arg == TOK_PROC || e->arg == TOK_FN));
+        else if (e->type == EV_NAME) {
+            e->arg = RES_DANGLING;
+            e->val = 0;
+            if (def) {
+                uint32_t key = name_hash(base + e->off - 1, e->len + 1);
+                uint32_t first;
+                if (find_def(lst, &defs, key, e))
+                    e->arg = RES_REDEF;
+                else {
+                    /* a new name goes at the head of the chain for its hash */
+                    e->arg = RES_DEF;
+                    if (bbcutil_map_get(&defs, key, &first))
+                        e->val = first;
+                    worked = bbcutil_map_put(&defs, key, e - lst->ev + 1) == BBCUTIL_OK;
+                }
+            }
+            def = false;
+        }
+        else if (e->type == EV_EOL)
+            def = false;
+    }
+    for (e = lst->ev; e < end && worked; e++) {
+        if (e->type == EV_LINENO)
+            e->arg = lines[e->val >> 6] & 1ULL << (e->val & 63) ? RES_FOUND : RES_DANGLING;
+        else if (e->type == EV_NAME && e->arg == RES_DANGLING && find_def(lst, &defs, name_hash(base + e->off - 1, e->len + 1), e))
+            e->arg = RES_FOUND;
+    }
+    bbcutil_map_free(&defs);
+    if (!worked)
+        return BBCUTIL_NOMEM;
+    lst->resolved = true;
+    return BBCUTIL_OK;
+}
+
+/* a trailing open bracket may be left off the name. */
+
+unsigned bbcutil_keyword_tokens(const char *name, size_t len, unsigned char *toks)
+{
+    unsigned count = 0;
+    for (int i = 0; i < 128; i++) {
+        const char *text = bbcutil_basic_dialect.keywords[0x80 | i].text;
+        size_t text_len = strlen(text);
+        if ((text_len == len || (text_len == len + 1 && text[len] == '(')) && !strncasecmp(text, name, len))
+            toks[count++] = 0x80 | i;
+    }
+    return count;
+}
+
+struct style {
+    const char *name;
+    const struct outcfg *ocfg;
+    renderer render;
+};
+
+static const struct style styles[] = {
+    { "plain",  &cfg_plain,  render        },
+    { "colour", &cfg_colour, render        },
+    { "dark",   &cfg_dark,   render        },
+    { "html",   &cfg_html,   render        },
+    { "jsonl",  &cfg_plain,  render_jsonl  },
+    { "binary", &cfg_plain,  render_binary }
+};
+
+/* the keywords are formatted once per renderer rather than per use. */
+
+bbcutil_res bbcutil_renderer_new(const char *style, size_t len, bbcutil_renderer **rendp)
+{
+    const struct style *sp = NULL;
+    for (int i = 0; i < sizeof(styles)/sizeof(styles[0]); i++)
+        if (strlen(styles[i].name) == len && !strncmp(styles[i].name, style, len))
+            sp = styles + i;
+    if (!sp)
+        return BBCUTIL_BADSTYLE;
+    bbcutil_renderer *rend = calloc(1, sizeof(bbcutil_renderer));
+    if (!rend)
+        return BBCUTIL_NOMEM;
+    rend->ocfg = sp->ocfg;
+    rend->render = sp->render;
+    const char *fmt = rend->ocfg->fmt_lineno;
+    const char *num = strstr(fmt, "%5u");
+    rend->lineno_prefix.text = (char *)fmt;
+    rend->lineno_prefix.len = num ? num - fmt : -1;
+    if (num) {
+        rend->lineno_suffix.text = (char *)num + 3;
+        rend->lineno_suffix.len = strlen(num + 3);
+    }
+    for (int i = 0; i < 256; i++) {
+        struct tokstr *token = &rend->tokens[i >> 7][i & 0x7f];
+        struct tokstr *skipeol = &rend->skipeol[i >> 7][i & 0x7f];
+        const char *text = dialect(i >> 7)->keywords[0x80 | (i & 0x7f)].text;
+        if ((token->len = asprintf(&token->text, rend->ocfg->fmt_token, text)) < 0)
+            token->text = NULL;
+        else if ((skipeol->len = asprintf(&skipeol->text, rend->ocfg->fmt_skipeol, text)) < 0)
+            skipeol->text = NULL;
+        else
+            continue;
+        bbcutil_renderer_free(rend);
+        return BBCUTIL_NOMEM;
+    }
+    *rendp = rend;
+    return BBCUTIL_OK;
+}
+
+bool bbcutil_renderer_links(const bbcutil_renderer *rend)
+{
+    return rend->ocfg->links;
+}
+
+void bbcutil_render(const bbcutil_renderer *rend, const bbcutil_listing *lst, FILE *ofp)
+{
+    rend->render(lst, rend, ofp);
+}
+
+void bbcutil_renderer_free(bbcutil_renderer *rend)
+{
+    if (rend) {
+        for (int i = 0; i < 256; i++) {
+            free(rend->tokens[i >> 7][i & 0x7f].text);
+            free(rend->skipeol[i >> 7][i & 0x7f].text);
+        }
+        free(rend);
+    }
+}
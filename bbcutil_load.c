@@ -0,0 +1,70 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+unsigned char *bbcutil_load(const char *prog, const char *fn, unsigned char **end)
+{
+    FILE *fp = fopen(fn, "rb");
+    if (fp) {
+        if (!fseek(fp, 0L, SEEK_END)) {
+            long size = ftell(fp);
+            if (size == 0)
+                fprintf(stderr, "%s: %s is an empty file\n", prog, fn);
+            else {
+                unsigned char *data = malloc(size);
+                if (data) {
+                    rewind(fp);
+                    if (fread(data, size, 1, fp) == 1) {
+                        fclose(fp);
+                        *end = data + size;
+                        return data;
+                    }
+                    else
+                        fprintf(stderr, "%s: read error on %s: %s\n", prog, fn, strerror(errno));
+                    free(data);
+                }
+                else
+                    fprintf(stderr, "%s: out of memory reading %s\n", prog, fn);
+            }
+        }
+        else
+            fprintf(stderr, "%s: seek error on %s: %s\n", prog, fn, strerror(errno));
+        fclose(fp);
+    }
+    else
+        fprintf(stderr, "%s: unable to open '%s' for reading: %s\n", prog, fn, strerror(errno));
+    return NULL;
+}
+
+/* the file is written beside the one it replaces, with the same mode,
+ * and renamed over it only once it has been completely written. */
+
+bool bbcutil_save(const char *prog, const char *fn, const unsigned char *data, size_t size)
+{
+    char *tmp;
+    if (asprintf(&tmp, "%s.tmp", fn) < 0) {
+        fprintf(stderr, "%s: out of memory writing %s\n", prog, fn);
+        return false;
+    }
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        fprintf(stderr, "%s: unable to open '%s' for writing: %s\n", prog, tmp, strerror(errno));
+        free(tmp);
+        return false;
+    }
+    struct stat stb;
+    bool worked = (stat(fn, &stb) || !fchmod(fileno(fp), stb.st_mode & 07777)) && fwrite(data, size, 1, fp) == 1;
+    if (fclose(fp))
+        worked = false;
+    if (!worked || rename(tmp, fn)) {
+        fprintf(stderr, "%s: unable to write '%s': %s\n", prog, fn, strerror(errno));
+        remove(tmp);
+        free(tmp);
+        return false;
+    }
+    free(tmp);
+    return true;
+}
@@ -0,0 +1,112 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Open addressing with linear probing.  Each slot is a key and value
+ * pair held in adjacent words, an empty slot has the reserved key.  The
+ * table is kept at most half full. */
+
+#define EMPTY 0xffffffffu
+
+static inline unsigned map_hash(uint32_t key, unsigned mask)
+{
+    uint32_t hash = key * 0x9e3779b1u;
+    return (hash ^ hash >> 16) & mask;
+}
+
+static bbcutil_res map_alloc(bbcutil_map *map, unsigned size)
+{
+    uint32_t *slots = malloc(size * 2 * sizeof(uint32_t));
+    if (!slots)
+        return BBCUTIL_NOMEM;
+    memset(slots, 0xff, size * 2 * sizeof(uint32_t));
+    map->slots = slots;
+    map->mask = size - 1;
+    map->count = 0;
+    return BBCUTIL_OK;
+}
+
+bbcutil_res bbcutil_map_init(bbcutil_map *map, unsigned expected)
+{
+    unsigned size = 16;
+    while (size < expected * 2)
+        size *= 2;
+    return map_alloc(map, size);
+}
+
+static bbcutil_res map_grow(bbcutil_map *map)
+{
+    bbcutil_map old = *map;
+    bbcutil_res res = map_alloc(map, (old.mask + 1) * 2);
+    if (res != BBCUTIL_OK)
+        return res;
+    for (unsigned ix = 0; ix <= old.mask; ix++)
+        if (old.slots[ix*2] != EMPTY)
+            bbcutil_map_put(map, old.slots[ix*2], old.slots[ix*2+1]);
+    free(old.slots);
+    return BBCUTIL_OK;
+}
+
+bbcutil_res bbcutil_map_put(bbcutil_map *map, uint32_t key, uint32_t value)
+{
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        bbcutil_res res = map_grow(map);
+        if (res != BBCUTIL_OK)
+            return res;
+    }
+    unsigned ix = map_hash(key, map->mask);
+    uint32_t *slot;
+    while ((slot = map->slots + ix * 2)[0] != EMPTY) {
+        if (slot[0] == key) {
+            slot[1] = value;
+            return BBCUTIL_OK;
+        }
+        ix = (ix + 1) & map->mask;
+    }
+    slot[0] = key;
+    slot[1] = value;
+    map->count++;
+    return BBCUTIL_OK;
+}
+
+bool bbcutil_map_get(const bbcutil_map *map, uint32_t key, uint32_t *value)
+{
+    unsigned ix = map_hash(key, map->mask);
+    const uint32_t *slot;
+    while ((slot = map->slots + ix * 2)[0] != EMPTY) {
+        if (slot[0] == key) {
+            if (value)
+                *value = slot[1];
+            return true;
+        }
+        ix = (ix + 1) & map->mask;
+    }
+    return false;
+}
+
+void bbcutil_map_free(bbcutil_map *map)
+{
+    free(map->slots);
+    map->slots = NULL;
+}
+
+/* words are taken eight bytes at a time, each mixed in by a multiply
+ * and fold, the tail zero padded. */
+
+uint64_t bbcutil_hash(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *ptr = data;
+    uint64_t hash = seed ^ len * 0x9e3779b97f4a7c15ULL;
+    uint64_t word;
+    while (len >= 8) {
+        memcpy(&word, ptr, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+        ptr += 8;
+        len -= 8;
+    }
+    word = 0;
+    memcpy(&word, ptr, len);
+    hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ hash >> 29;
+}
@@ -0,0 +1,42 @@
+#include "bbcutil.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *bbcutil_msgs[] =
+{
+    "worked",
+    "EOF",
+    "bad archive header",
+    "out of memory",
+    "line number out of range",
+    "unknown style"
+};
+
+const char *bbcutil_rmsg(bbcutil_res res)
+{
+    assert(res <= BBCUTIL_IOERR);
+    if (res == BBCUTIL_IOERR)
+        return strerror(errno);
+    else
+        return bbcutil_msgs[res];
+}
+
+bool bbcutil_number_arg(const char *arg, int *argc, char ***argv, unsigned max, unsigned *value)
+{
+    if (!arg[2]) {
+        if (*argc <= 1)
+            return false;
+        --*argc;
+        arg = *++*argv;
+    }
+    else
+        arg += 2;
+    char *end;
+    unsigned long num = strtoul(arg, &end, 10);
+    if (*end || end == arg || num > max)
+        return false;
+    *value = num;
+    return true;
+}
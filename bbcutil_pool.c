@@ -0,0 +1,49 @@
+#include "bbcutil.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Items are handed out from a shared counter, so a thread which gets
+ * quick ones takes more of them and no lock is needed. */
+
+struct bbcutil_work {
+    atomic_uint next;
+    unsigned count;
+    bbcutil_worker_fn fn;
+    void *ctx;
+};
+
+bool bbcutil_work_next(bbcutil_work *work, unsigned *ix)
+{
+    *ix = atomic_fetch_add_explicit(&work->next, 1, memory_order_relaxed);
+    return *ix < work->count;
+}
+
+static void *run(void *arg)
+{
+    bbcutil_work *work = arg;
+    work->fn(work, work->ctx);
+    return NULL;
+}
+
+/* if threads cannot be started the work is done by those which were. */
+
+void bbcutil_parallel(unsigned count, int threads, bbcutil_worker_fn fn, void *ctx)
+{
+    bbcutil_work work = { 0, count, fn, ctx };
+    if (threads < 1)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned extra = threads > 1 ? threads - 1 : 0;
+    if (extra >= count)
+        extra = count ? count - 1 : 0;
+    pthread_t *tids = extra ? calloc(extra, sizeof(pthread_t)) : NULL;
+    unsigned started = 0;
+    if (tids)
+        while (started < extra && !pthread_create(tids + started, NULL, run, &work))
+            started++;
+    run(&work);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+}
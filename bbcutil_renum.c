@@ -0,0 +1,127 @@
+#include "bbcutil.h"
+#include <string.h>
+
+/* Renumbering in two linear passes over the program: the first assigns
+ * the new numbers, rewriting each line header and recording the old to
+ * new mapping, the second re-encodes the line number references.  Every
+ * reference is three bytes whatever the number so the program does not
+ * change size.  Where a line number occurs twice a reference goes to the
+ * first, as it would when the program is run. */
+
+#define MAX_LINENO 32767
+
+#define TOK_ELSE    0x8b
+#define TOK_GOSUB   0xe4
+#define TOK_GOTO    0xe5
+#define TOK_RESTORE 0xf7
+
+bbcutil_res bbcutil_renumber(unsigned char *prog, unsigned char *prog_end, bbcutil_kind kind,
+                             unsigned start, unsigned step, bbcutil_dangling_cb dangling, void *ctx)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned count = 0;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line))
+        count++;
+    if (count && start + (unsigned long)step * (count - 1) > MAX_LINENO)
+        return BBCUTIL_RANGE;
+
+    bbcutil_map map;
+    bbcutil_res res = bbcutil_map_init(&map, count);
+    if (res != BBCUTIL_OK)
+        return res;
+    unsigned lineno = start;
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        if (!bbcutil_map_get(&map, line.lineno, NULL) && (res = bbcutil_map_put(&map, line.lineno, lineno)) != BBCUTIL_OK) {
+            bbcutil_map_free(&map);
+            return res;
+        }
+        unsigned char *hdr = prog + (line.start - prog);
+        if (kind == BBCUTIL_RUSSELL) {
+            hdr[1] = lineno;
+            hdr[2] = lineno >> 8;
+        }
+        else {
+            hdr[1] = lineno >> 8;
+            hdr[2] = lineno;
+        }
+        lineno += step;
+    }
+
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        bbcutil_toks toks;
+        bbcutil_tok tok;
+        bbcutil_toks_init(&toks, &line, kind);
+        while (bbcutil_toks_next(&toks, &tok)) {
+            if (tok.type == BBCUTIL_TOK_LINENO) {
+                uint32_t target;
+                if (bbcutil_map_get(&map, tok.lineno, &target))
+                    bbcutil_lineno_encode(prog + (tok.ptr - prog) + 1, target);
+                else if (dangling)
+                    dangling(ctx, line.lineno, tok.lineno);
+            }
+        }
+    }
+    bbcutil_map_free(&map);
+    return BBCUTIL_OK;
+}
+
+/* GOTO and GOSUB must be followed by a reference and RESTORE by one or
+ * nothing.  Each in a list, as after ON, should be a reference too; if
+ * a comma is followed by digits the rest were not tokenised. */
+
+bool bbcutil_line_targets(const unsigned char *prog, const unsigned char *prog_end, bbcutil_kind kind, uint8_t *refs)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bool known = true;
+    memset(refs, 0, BBCUTIL_REFS_SIZE);
+    bbcutil_lines_init(&lines, prog, prog_end, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        const unsigned char *star = bbcutil_star_command(&line);
+        const unsigned char *end = star ? star : line.text_end;
+        bbcutil_toks it;
+        bbcutil_tok tok;
+        unsigned jump = 0;
+        bool after_ref = false;
+        bbcutil_toks_init(&it, &line, kind);
+        while (bbcutil_toks_next(&it, &tok) && tok.ptr < end) {
+            if (tok.type == BBCUTIL_TOK_PLAIN) {
+                const unsigned char *ptr = tok.ptr;
+                const unsigned char *stop = tok.end < end ? tok.end : end;
+                while (ptr < stop && *ptr == ' ')
+                    ptr++;
+                if (ptr < stop) {
+                    if (jump && !(jump == TOK_RESTORE && *ptr == ':'))
+                        known = false;
+                    if (after_ref && *ptr == ',') {
+                        do
+                            ptr++;
+                        while (ptr < stop && *ptr == ' ');
+                        if (ptr < stop && *ptr >= '0' && *ptr <= '9')
+                            known = false;
+                    }
+                    jump = 0;
+                    after_ref = false;
+                }
+                continue;
+            }
+            if (jump && !(tok.type == BBCUTIL_TOK_LINENO || (jump == TOK_RESTORE && tok.tok == TOK_ELSE)))
+                known = false;
+            jump = 0;
+            after_ref = false;
+            if (tok.type == BBCUTIL_TOK_LINENO) {
+                refs[tok.lineno >> 3] |= 1 << (tok.lineno & 7);
+                after_ref = true;
+            }
+            else if (tok.type == BBCUTIL_TOK_KEYWORD && (tok.tok == TOK_GOTO || tok.tok == TOK_GOSUB || tok.tok == TOK_RESTORE))
+                jump = tok.tok;
+        }
+        if (jump && jump != TOK_RESTORE)
+            known = false;
+    }
+    return known;
+}
@@ -0,0 +1,126 @@
+#include "bbcutil.h"
+#include <string.h>
+
+/* Classify a file in a single bounded pass.  The Wilson (also used by
+ * COMAL), Russell and data file layouts are each followed by their own
+ * cursor, all advanced together, and the pass finishes as soon as every
+ * cursor has either reached its end marker or found a mismatch.  Every
+ * step advances at least one byte so a corrupt length cannot loop. */
+
+struct walker {
+    size_t pos;
+    unsigned lines;
+    bool alive;
+    bool done;
+};
+
+static const char *kind_names[] = {
+    "unknown",
+    "Wilson BASIC",
+    "Russell BASIC",
+    "COMAL",
+    "BBC data file"
+};
+
+const char *bbcutil_kind_name(bbcutil_kind kind)
+{
+    return kind_names[kind];
+}
+
+bbcutil_kind bbcutil_sniff(const unsigned char *data, size_t size, bbcutil_fmt *fmt)
+{
+    struct walker wil = { 0, 0, true, false };
+    struct walker rus = { 0, 0, true, false };
+    struct walker dat = { 0, 0, true, false };
+    unsigned basic_votes = 0, comal_votes = 0;
+
+    while (wil.alive || rus.alive || dat.alive) {
+        if (wil.alive) {
+            size_t p = wil.pos;
+            if (p + 1 >= size || data[p] != 0x0d)
+                wil.alive = false;
+            else if (data[p+1] == 0xff) {
+                wil.alive = false;
+                wil.done = true;
+            }
+            else if (p + 4 > size || data[p+3] < 4 || p + data[p+3] > size)
+                wil.alive = false;
+            else {
+                /* the byte after the header is the indent level in COMAL
+                 * but the start of the text in BASIC. */
+                if (data[p+3] > 4) {
+                    unsigned ch = data[p+4];
+                    if (ch >= 0x80)
+                        basic_votes++;
+                    else if (ch < 0x20)
+                        comal_votes++;
+                }
+                wil.pos = p + data[p+3];
+                wil.lines++;
+            }
+        }
+        if (rus.alive) {
+            size_t p = rus.pos;
+            if (p + 2 < size && data[p] == 0x00 && data[p+1] == 0xff && data[p+2] == 0xff) {
+                rus.alive = false;
+                rus.done = true;
+            }
+            else if (p >= size || data[p] < 4 || p + data[p] > size || data[p + data[p] - 1] != 0x0d)
+                rus.alive = false;
+            else {
+                rus.pos = p + data[p];
+                rus.lines++;
+            }
+        }
+        if (dat.alive) {
+            size_t p = dat.pos;
+            size_t len;
+            if (p == size) {
+                dat.alive = false;
+                dat.done = dat.lines > 0;
+                continue;
+            }
+            if (data[p] == 0x00)
+                len = (p + 1 < size) ? 2 + data[p+1] : size + 1;
+            else if (data[p] == 0x40)
+                len = 5;
+            else if (data[p] == 0xff)
+                len = 6;
+            else
+                len = size + 1;
+            if (p + len > size)
+                dat.alive = false;
+            else {
+                dat.pos = p + len;
+                dat.lines++;
+            }
+        }
+    }
+
+    bbcutil_fmt res = { BBCUTIL_UNKNOWN, 0, 0, 0 };
+    if (wil.done) {
+        unsigned votes = basic_votes + comal_votes;
+        res.kind = comal_votes > basic_votes ? BBCUTIL_COMAL : BBCUTIL_WILSON;
+        res.prog_len = wil.pos;
+        res.lines = wil.lines;
+        if (votes)
+            res.confidence = 50 + 50 * (comal_votes > basic_votes ? comal_votes : basic_votes) / votes;
+        else
+            res.confidence = wil.lines ? 50 : 10;
+    }
+    else if (rus.done) {
+        res.kind = BBCUTIL_RUSSELL;
+        res.prog_len = rus.pos;
+        res.lines = rus.lines;
+        res.confidence = rus.lines ? 95 : 10;
+    }
+    else if (dat.done) {
+        res.kind = BBCUTIL_DATA;
+        res.prog_len = size;
+        res.lines = dat.lines;
+        res.confidence = dat.lines >= 5 ? 90 : 40 + 10 * dat.lines;
+    }
+    if (fmt)
+        *fmt = res;
+    return res.kind;
+}
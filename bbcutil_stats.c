@@ -0,0 +1,113 @@
+#include "bbcutil.h"
+#include <inttypes.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#ifdef BBCUTIL_TOKEN_STATS
+_Thread_local uint64_t bbcutil_token_counts[BBCUTIL_TOKCLASSES];
+#endif
+
+static const char *phase_names[BBCUTIL_PHASES] = { "load", "sniff", "decode", "render", "write" };
+
+#ifdef BBCUTIL_TOKEN_STATS
+static const char *class_names[BBCUTIL_TOKCLASSES] = { "keywords", "strings", "tails", "linerefs" };
+#endif
+
+uint64_t bbcutil_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the report wanted, if arg asks for one. */
+
+int bbcutil_stats_option(const char *arg)
+{
+    if (!strcmp(arg, "--stats"))
+        return BBCUTIL_STATS_TEXT;
+    if (!strcmp(arg, "--stats=json"))
+        return BBCUTIL_STATS_JSON;
+    return 0;
+}
+
+void bbcutil_stats_init(bbcutil_stats *st)
+{
+    memset(st, 0, sizeof(bbcutil_stats));
+    st->start = bbcutil_clock();
+}
+
+/* the time since mark is added to the phase and the time now returned
+ * to mark the start of the next. */
+
+uint64_t bbcutil_stats_lap(bbcutil_stats *st, bbcutil_phase phase, uint64_t mark)
+{
+    uint64_t now = bbcutil_clock();
+    st->ns[phase] += now - mark;
+    return now;
+}
+
+void bbcutil_stats_collect(bbcutil_stats *st)
+{
+#ifdef BBCUTIL_TOKEN_STATS
+    for (unsigned ix = 0; ix < BBCUTIL_TOKCLASSES; ix++) {
+        st->classes[ix] += bbcutil_token_counts[ix];
+        bbcutil_token_counts[ix] = 0;
+    }
+#endif
+}
+
+void bbcutil_stats_merge(bbcutil_stats *st, const bbcutil_stats *from)
+{
+    for (unsigned ix = 0; ix < BBCUTIL_PHASES; ix++)
+        st->ns[ix] += from->ns[ix];
+    st->files += from->files;
+    st->bytes_in += from->bytes_in;
+    st->bytes_out += from->bytes_out;
+    st->lines += from->lines;
+    st->tokens += from->tokens;
+    for (unsigned ix = 0; ix < BBCUTIL_TOKCLASSES; ix++)
+        st->classes[ix] += from->classes[ix];
+}
+
+/* With several threads the phase times are the sum over them so can
+ * add up to more than the time elapsed. */
+
+void bbcutil_stats_report(const char *prog, bbcutil_stats *st, int mode, FILE *fp)
+{
+    bbcutil_stats_collect(st);
+    double secs = (bbcutil_clock() - st->start) / 1e9;
+    double rate = secs > 0 ? st->files / secs : 0;
+    struct rusage ru;
+    long rss = getrusage(RUSAGE_SELF, &ru) ? 0 : ru.ru_maxrss;
+    if (mode == BBCUTIL_STATS_JSON) {
+        fprintf(fp, "{\"program\":\"%s\",\"seconds\":%.6f,\"files\":%" PRIu64 ",\"files_per_second\":%.1f,\"phases\":{",
+                prog, secs, st->files, rate);
+        for (unsigned ix = 0; ix < BBCUTIL_PHASES; ix++)
+            fprintf(fp, "%s\"%s\":%.6f", ix ? "," : "", phase_names[ix], st->ns[ix] / 1e9);
+        fprintf(fp, "},\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64 ",\"lines\":%" PRIu64 ",\"tokens\":%" PRIu64 ",",
+                st->bytes_in, st->bytes_out, st->lines, st->tokens);
+#ifdef BBCUTIL_TOKEN_STATS
+        fputs("\"token_classes\":{", fp);
+        for (unsigned ix = 0; ix < BBCUTIL_TOKCLASSES; ix++)
+            fprintf(fp, "%s\"%s\":%" PRIu64, ix ? "," : "", class_names[ix], st->classes[ix]);
+        fputs("},", fp);
+#endif
+        fprintf(fp, "\"peak_rss_kb\":%ld}\n", rss);
+    }
+    else {
+        fprintf(fp, "%s: %" PRIu64 " files in %.3fs, %.1f files/s\n%s:", prog, st->files, secs, rate, prog);
+        for (unsigned ix = 0; ix < BBCUTIL_PHASES; ix++)
+            fprintf(fp, " %s %.3fms", phase_names[ix], st->ns[ix] / 1e6);
+        fprintf(fp, "\n%s: %" PRIu64 " bytes in, %" PRIu64 " bytes out, %" PRIu64 " lines, %" PRIu64 " tokens\n",
+                prog, st->bytes_in, st->bytes_out, st->lines, st->tokens);
+#ifdef BBCUTIL_TOKEN_STATS
+        fprintf(fp, "%s:", prog);
+        for (unsigned ix = 0; ix < BBCUTIL_TOKCLASSES; ix++)
+            fprintf(fp, " %" PRIu64 " %s", st->classes[ix], class_names[ix]);
+        putc('\n', fp);
+#endif
+        fprintf(fp, "%s: peak RSS %ld KB\n", prog, rss);
+    }
+}
@@ -0,0 +1,823 @@
+/* Generated by mktables from dialects.txt, do not edit. */
+
+#include "bbcutil.h"
+
+static const bbcutil_keyword basic_keywords[256] = {
+    [0x01] = { "Missing", 0x00 },
+    [0x02] = { "No such", 0x00 },
+    [0x03] = { "Bad", 0x00 },
+    [0x04] = { "range", 0x00 },
+    [0x05] = { "variable", 0x00 },
+    [0x06] = { "Out of", 0x00 },
+    [0x07] = { "No", 0x00 },
+    [0x08] = { "space", 0x00 },
+    [0x80] = { "AND", 0x03 },
+    [0x81] = { "DIV", 0x03 },
+    [0x82] = { "EOR", 0x03 },
+    [0x83] = { "MOD", 0x03 },
+    [0x84] = { "OR", 0x03 },
+    [0x85] = { "ERROR", 0x02 },
+    [0x86] = { "LINE", 0x02 },
+    [0x87] = { "OFF", 0x02 },
+    [0x88] = { "STEP", 0x03 },
+    [0x89] = { "SPC", 0x02 },
+    [0x8A] = { "TAB(", 0x00 },
+    [0x8B] = { "ELSE", 0x03 },
+    [0x8C] = { "THEN", 0x03 },
+    [0x8D] = { "", 0x43 },
+    [0x8E] = { "OPENIN", 0x02 },
+    [0x8F] = { "PTR", 0x00 },
+    [0x90] = { "PAGE", 0x00 },
+    [0x91] = { "TIME", 0x00 },
+    [0x92] = { "LOMEM", 0x00 },
+    [0x93] = { "HIMEM", 0x00 },
+    [0x94] = { "ABS", 0x00 },
+    [0x95] = { "ACS", 0x00 },
+    [0x96] = { "ADVAL", 0x00 },
+    [0x97] = { "ASC", 0x00 },
+    [0x98] = { "ASN", 0x00 },
+    [0x99] = { "ATN", 0x00 },
+    [0x9A] = { "BGET", 0x00 },
+    [0x9B] = { "COS", 0x00 },
+    [0x9C] = { "COUNT", 0x00 },
+    [0x9D] = { "DEG", 0x00 },
+    [0x9E] = { "ERL", 0x00 },
+    [0x9F] = { "ERR", 0x00 },
+    [0xA0] = { "EVAL", 0x00 },
+    [0xA1] = { "EXP", 0x00 },
+    [0xA2] = { "EXT", 0x00 },
+    [0xA3] = { "FALSE", 0x00 },
+    [0xA4] = { "FN", 0x00 },
+    [0xA5] = { "GET", 0x00 },
+    [0xA6] = { "INKEY", 0x00 },
+    [0xA7] = { "INSTR(", 0x00 },
+    [0xA8] = { "INT", 0x00 },
+    [0xA9] = { "LEN", 0x00 },
+    [0xAA] = { "LN", 0x00 },
+    [0xAB] = { "LOG", 0x00 },
+    [0xAC] = { "NOT", 0x00 },
+    [0xAD] = { "OPENUP", 0x00 },
+    [0xAE] = { "OPENOUT", 0x00 },
+    [0xAF] = { "PI", 0x00 },
+    [0xB0] = { "POINT(", 0x00 },
+    [0xB1] = { "POS", 0x00 },
+    [0xB2] = { "RAD", 0x00 },
+    [0xB3] = { "RND", 0x00 },
+    [0xB4] = { "SGN", 0x00 },
+    [0xB5] = { "SIN", 0x00 },
+    [0xB6] = { "SQR", 0x00 },
+    [0xB7] = { "TAN", 0x00 },
+    [0xB8] = { "TO", 0x03 },
+    [0xB9] = { "TRUE", 0x00 },
+    [0xBA] = { "USR", 0x00 },
+    [0xBB] = { "VAL", 0x00 },
+    [0xBC] = { "VPOS", 0x00 },
+    [0xBD] = { "CHR$", 0x00 },
+    [0xBE] = { "GET$", 0x00 },
+    [0xBF] = { "INKEY$", 0x00 },
+    [0xC0] = { "LEFT$(", 0x00 },
+    [0xC1] = { "MID$(", 0x00 },
+    [0xC2] = { "RIGHT$(", 0x00 },
+    [0xC3] = { "STR$", 0x00 },
+    [0xC4] = { "STRING$(", 0x00 },
+    [0xC5] = { "EOF", 0x00 },
+    [0xC6] = { "AUTO", 0x00 },
+    [0xC7] = { "DELETE", 0x00 },
+    [0xC8] = { "LOAD", 0x00 },
+    [0xC9] = { "LIST", 0x00 },
+    [0xCA] = { "NEW", 0x00 },
+    [0xCB] = { "OLD", 0x00 },
+    [0xCC] = { "RENUMBER", 0x00 },
+    [0xCD] = { "SAVE", 0x00 },
+    [0xCE] = { "", 0x00 },
+    [0xCF] = { "PTR", 0x00 },
+    [0xD0] = { "PAGE", 0x00 },
+    [0xD1] = { "TIME", 0x00 },
+    [0xD2] = { "LOMEM", 0x00 },
+    [0xD3] = { "HIMEM", 0x00 },
+    [0xD4] = { "SOUND", 0x02 },
+    [0xD5] = { "BPUT", 0x02 },
+    [0xD6] = { "CALL", 0x02 },
+    [0xD7] = { "CHAIN", 0x02 },
+    [0xD8] = { "CLEAR", 0x02 },
+    [0xD9] = { "CLOSE", 0x02 },
+    [0xDA] = { "CLG", 0x02 },
+    [0xDB] = { "CLS", 0x02 },
+    [0xDC] = { "DATA", 0x12 },
+    [0xDD] = { "DEF", 0x02 },
+    [0xDE] = { "DIM", 0x02 },
+    [0xDF] = { "DRAW", 0x02 },
+    [0xE0] = { "END", 0x02 },
+    [0xE1] = { "ENDPROC", 0x02 },
+    [0xE2] = { "ENVELOPE", 0x02 },
+    [0xE3] = { "FOR", 0x06 },
+    [0xE4] = { "GOSUB", 0x02 },
+    [0xE5] = { "GOTO", 0x02 },
+    [0xE6] = { "GCOL", 0x02 },
+    [0xE7] = { "IF", 0x02 },
+    [0xE8] = { "INPUT", 0x02 },
+    [0xE9] = { "LET", 0x02 },
+    [0xEA] = { "LOCAL", 0x02 },
+    [0xEB] = { "MODE", 0x02 },
+    [0xEC] = { "MOVE", 0x02 },
+    [0xED] = { "NEXT", 0x0a },
+    [0xEE] = { "ON", 0x02 },
+    [0xEF] = { "VDU", 0x02 },
+    [0xF0] = { "PLOT", 0x02 },
+    [0xF1] = { "PRINT", 0x02 },
+    [0xF2] = { "PROC", 0x00 },
+    [0xF3] = { "READ", 0x02 },
+    [0xF4] = { "REM", 0x12 },
+    [0xF5] = { "REPEAT", 0x06 },
+    [0xF6] = { "REPORT", 0x02 },
+    [0xF7] = { "RESTORE", 0x02 },
+    [0xF8] = { "RETURN", 0x02 },
+    [0xF9] = { "RUN", 0x02 },
+    [0xFA] = { "STOP", 0x02 },
+    [0xFB] = { "COLOUR", 0x02 },
+    [0xFC] = { "TRACE", 0x02 },
+    [0xFD] = { "UNTIL", 0x0a },
+    [0xFE] = { "WIDTH", 0x02 },
+    [0xFF] = { "OSCLI", 0x02 },
+};
+
+static const uint8_t basic_classes[256] = {
+    [0x01] = BBCUTIL_CL_KEYWORD,
+    [0x02] = BBCUTIL_CL_KEYWORD,
+    [0x03] = BBCUTIL_CL_KEYWORD,
+    [0x04] = BBCUTIL_CL_KEYWORD,
+    [0x05] = BBCUTIL_CL_KEYWORD,
+    [0x06] = BBCUTIL_CL_KEYWORD,
+    [0x07] = BBCUTIL_CL_KEYWORD,
+    [0x08] = BBCUTIL_CL_KEYWORD,
+    [0x22] = BBCUTIL_CL_QUOTE,
+    [0x80] = BBCUTIL_CL_KEYWORD,
+    [0x81] = BBCUTIL_CL_KEYWORD,
+    [0x82] = BBCUTIL_CL_KEYWORD,
+    [0x83] = BBCUTIL_CL_KEYWORD,
+    [0x84] = BBCUTIL_CL_KEYWORD,
+    [0x85] = BBCUTIL_CL_KEYWORD,
+    [0x86] = BBCUTIL_CL_KEYWORD,
+    [0x87] = BBCUTIL_CL_KEYWORD,
+    [0x88] = BBCUTIL_CL_KEYWORD,
+    [0x89] = BBCUTIL_CL_KEYWORD,
+    [0x8A] = BBCUTIL_CL_KEYWORD,
+    [0x8B] = BBCUTIL_CL_KEYWORD,
+    [0x8C] = BBCUTIL_CL_KEYWORD,
+    [0x8D] = BBCUTIL_CL_LINENO,
+    [0x8E] = BBCUTIL_CL_KEYWORD,
+    [0x8F] = BBCUTIL_CL_KEYWORD,
+    [0x90] = BBCUTIL_CL_KEYWORD,
+    [0x91] = BBCUTIL_CL_KEYWORD,
+    [0x92] = BBCUTIL_CL_KEYWORD,
+    [0x93] = BBCUTIL_CL_KEYWORD,
+    [0x94] = BBCUTIL_CL_KEYWORD,
+    [0x95] = BBCUTIL_CL_KEYWORD,
+    [0x96] = BBCUTIL_CL_KEYWORD,
+    [0x97] = BBCUTIL_CL_KEYWORD,
+    [0x98] = BBCUTIL_CL_KEYWORD,
+    [0x99] = BBCUTIL_CL_KEYWORD,
+    [0x9A] = BBCUTIL_CL_KEYWORD,
+    [0x9B] = BBCUTIL_CL_KEYWORD,
+    [0x9C] = BBCUTIL_CL_KEYWORD,
+    [0x9D] = BBCUTIL_CL_KEYWORD,
+    [0x9E] = BBCUTIL_CL_KEYWORD,
+    [0x9F] = BBCUTIL_CL_KEYWORD,
+    [0xA0] = BBCUTIL_CL_KEYWORD,
+    [0xA1] = BBCUTIL_CL_KEYWORD,
+    [0xA2] = BBCUTIL_CL_KEYWORD,
+    [0xA3] = BBCUTIL_CL_KEYWORD,
+    [0xA4] = BBCUTIL_CL_KEYWORD,
+    [0xA5] = BBCUTIL_CL_KEYWORD,
+    [0xA6] = BBCUTIL_CL_KEYWORD,
+    [0xA7] = BBCUTIL_CL_KEYWORD,
+    [0xA8] = BBCUTIL_CL_KEYWORD,
+    [0xA9] = BBCUTIL_CL_KEYWORD,
+    [0xAA] = BBCUTIL_CL_KEYWORD,
+    [0xAB] = BBCUTIL_CL_KEYWORD,
+    [0xAC] = BBCUTIL_CL_KEYWORD,
+    [0xAD] = BBCUTIL_CL_KEYWORD,
+    [0xAE] = BBCUTIL_CL_KEYWORD,
+    [0xAF] = BBCUTIL_CL_KEYWORD,
+    [0xB0] = BBCUTIL_CL_KEYWORD,
+    [0xB1] = BBCUTIL_CL_KEYWORD,
+    [0xB2] = BBCUTIL_CL_KEYWORD,
+    [0xB3] = BBCUTIL_CL_KEYWORD,
+    [0xB4] = BBCUTIL_CL_KEYWORD,
+    [0xB5] = BBCUTIL_CL_KEYWORD,
+    [0xB6] = BBCUTIL_CL_KEYWORD,
+    [0xB7] = BBCUTIL_CL_KEYWORD,
+    [0xB8] = BBCUTIL_CL_KEYWORD,
+    [0xB9] = BBCUTIL_CL_KEYWORD,
+    [0xBA] = BBCUTIL_CL_KEYWORD,
+    [0xBB] = BBCUTIL_CL_KEYWORD,
+    [0xBC] = BBCUTIL_CL_KEYWORD,
+    [0xBD] = BBCUTIL_CL_KEYWORD,
+    [0xBE] = BBCUTIL_CL_KEYWORD,
+    [0xBF] = BBCUTIL_CL_KEYWORD,
+    [0xC0] = BBCUTIL_CL_KEYWORD,
+    [0xC1] = BBCUTIL_CL_KEYWORD,
+    [0xC2] = BBCUTIL_CL_KEYWORD,
+    [0xC3] = BBCUTIL_CL_KEYWORD,
+    [0xC4] = BBCUTIL_CL_KEYWORD,
+    [0xC5] = BBCUTIL_CL_KEYWORD,
+    [0xC6] = BBCUTIL_CL_KEYWORD,
+    [0xC7] = BBCUTIL_CL_KEYWORD,
+    [0xC8] = BBCUTIL_CL_KEYWORD,
+    [0xC9] = BBCUTIL_CL_KEYWORD,
+    [0xCA] = BBCUTIL_CL_KEYWORD,
+    [0xCB] = BBCUTIL_CL_KEYWORD,
+    [0xCC] = BBCUTIL_CL_KEYWORD,
+    [0xCD] = BBCUTIL_CL_KEYWORD,
+    [0xCE] = BBCUTIL_CL_KEYWORD,
+    [0xCF] = BBCUTIL_CL_KEYWORD,
+    [0xD0] = BBCUTIL_CL_KEYWORD,
+    [0xD1] = BBCUTIL_CL_KEYWORD,
+    [0xD2] = BBCUTIL_CL_KEYWORD,
+    [0xD3] = BBCUTIL_CL_KEYWORD,
+    [0xD4] = BBCUTIL_CL_KEYWORD,
+    [0xD5] = BBCUTIL_CL_KEYWORD,
+    [0xD6] = BBCUTIL_CL_KEYWORD,
+    [0xD7] = BBCUTIL_CL_KEYWORD,
+    [0xD8] = BBCUTIL_CL_KEYWORD,
+    [0xD9] = BBCUTIL_CL_KEYWORD,
+    [0xDA] = BBCUTIL_CL_KEYWORD,
+    [0xDB] = BBCUTIL_CL_KEYWORD,
+    [0xDC] = BBCUTIL_CL_TAIL,
+    [0xDD] = BBCUTIL_CL_KEYWORD,
+    [0xDE] = BBCUTIL_CL_KEYWORD,
+    [0xDF] = BBCUTIL_CL_KEYWORD,
+    [0xE0] = BBCUTIL_CL_KEYWORD,
+    [0xE1] = BBCUTIL_CL_KEYWORD,
+    [0xE2] = BBCUTIL_CL_KEYWORD,
+    [0xE3] = BBCUTIL_CL_KEYWORD,
+    [0xE4] = BBCUTIL_CL_KEYWORD,
+    [0xE5] = BBCUTIL_CL_KEYWORD,
+    [0xE6] = BBCUTIL_CL_KEYWORD,
+    [0xE7] = BBCUTIL_CL_KEYWORD,
+    [0xE8] = BBCUTIL_CL_KEYWORD,
+    [0xE9] = BBCUTIL_CL_KEYWORD,
+    [0xEA] = BBCUTIL_CL_KEYWORD,
+    [0xEB] = BBCUTIL_CL_KEYWORD,
+    [0xEC] = BBCUTIL_CL_KEYWORD,
+    [0xED] = BBCUTIL_CL_KEYWORD,
+    [0xEE] = BBCUTIL_CL_KEYWORD,
+    [0xEF] = BBCUTIL_CL_KEYWORD,
+    [0xF0] = BBCUTIL_CL_KEYWORD,
+    [0xF1] = BBCUTIL_CL_KEYWORD,
+    [0xF2] = BBCUTIL_CL_KEYWORD,
+    [0xF3] = BBCUTIL_CL_KEYWORD,
+    [0xF4] = BBCUTIL_CL_TAIL,
+    [0xF5] = BBCUTIL_CL_KEYWORD,
+    [0xF6] = BBCUTIL_CL_KEYWORD,
+    [0xF7] = BBCUTIL_CL_KEYWORD,
+    [0xF8] = BBCUTIL_CL_KEYWORD,
+    [0xF9] = BBCUTIL_CL_KEYWORD,
+    [0xFA] = BBCUTIL_CL_KEYWORD,
+    [0xFB] = BBCUTIL_CL_KEYWORD,
+    [0xFC] = BBCUTIL_CL_KEYWORD,
+    [0xFD] = BBCUTIL_CL_KEYWORD,
+    [0xFE] = BBCUTIL_CL_KEYWORD,
+    [0xFF] = BBCUTIL_CL_KEYWORD,
+};
+
+static const bbcutil_match basic_match[121] = {
+    { "AND", 3, 0x80, 0x00 },
+    { "ABS", 3, 0x94, 0x00 },
+    { "ACS", 3, 0x95, 0x00 },
+    { "ADVAL", 5, 0x96, 0x00 },
+    { "ASC", 3, 0x97, 0x00 },
+    { "ASN", 3, 0x98, 0x00 },
+    { "ATN", 3, 0x99, 0x00 },
+    { "AUTO", 4, 0xC6, 0x10 },
+    { "BGET", 4, 0x9A, 0x01 },
+    { "BPUT", 4, 0xD5, 0x03 },
+    { "COLOUR", 6, 0xFB, 0x02 },
+    { "CALL", 4, 0xD6, 0x02 },
+    { "CHAIN", 5, 0xD7, 0x02 },
+    { "CHR$", 4, 0xBD, 0x00 },
+    { "CLEAR", 5, 0xD8, 0x01 },
+    { "CLOSE", 5, 0xD9, 0x03 },
+    { "CLG", 3, 0xDA, 0x01 },
+    { "CLS", 3, 0xDB, 0x01 },
+    { "COS", 3, 0x9B, 0x00 },
+    { "COUNT", 5, 0x9C, 0x01 },
+    { "DATA", 4, 0xDC, 0x20 },
+    { "DEG", 3, 0x9D, 0x00 },
+    { "DEF", 3, 0xDD, 0x00 },
+    { "DELETE", 6, 0xC7, 0x10 },
+    { "DIV", 3, 0x81, 0x00 },
+    { "DIM", 3, 0xDE, 0x02 },
+    { "DRAW", 4, 0xDF, 0x02 },
+    { "ENDPROC", 7, 0xE1, 0x01 },
+    { "END", 3, 0xE0, 0x01 },
+    { "ENVELOPE", 8, 0xE2, 0x02 },
+    { "ELSE", 4, 0x8B, 0x14 },
+    { "EVAL", 4, 0xA0, 0x00 },
+    { "ERL", 3, 0x9E, 0x01 },
+    { "ERROR", 5, 0x85, 0x04 },
+    { "EOF", 3, 0xC5, 0x01 },
+    { "EOR", 3, 0x82, 0x00 },
+    { "ERR", 3, 0x9F, 0x01 },
+    { "EXP", 3, 0xA1, 0x00 },
+    { "EXT", 3, 0xA2, 0x01 },
+    { "FOR", 3, 0xE3, 0x02 },
+    { "FALSE", 5, 0xA3, 0x01 },
+    { "FN", 2, 0xA4, 0x08 },
+    { "GOTO", 4, 0xE5, 0x12 },
+    { "GET$", 4, 0xBE, 0x00 },
+    { "GET", 3, 0xA5, 0x00 },
+    { "GOSUB", 5, 0xE4, 0x12 },
+    { "GCOL", 4, 0xE6, 0x02 },
+    { "HIMEM", 5, 0x93, 0x43 },
+    { "INPUT", 5, 0xE8, 0x02 },
+    { "IF", 2, 0xE7, 0x02 },
+    { "INKEY$", 6, 0xBF, 0x00 },
+    { "INKEY", 5, 0xA6, 0x00 },
+    { "INT", 3, 0xA8, 0x00 },
+    { "INSTR(", 6, 0xA7, 0x00 },
+    { "LIST", 4, 0xC9, 0x10 },
+    { "LINE", 4, 0x86, 0x00 },
+    { "LOAD", 4, 0xC8, 0x02 },
+    { "LOMEM", 5, 0x92, 0x43 },
+    { "LOCAL", 5, 0xEA, 0x02 },
+    { "LEFT$(", 6, 0xC0, 0x00 },
+    { "LEN", 3, 0xA9, 0x00 },
+    { "LET", 3, 0xE9, 0x04 },
+    { "LOG", 3, 0xAB, 0x00 },
+    { "LN", 2, 0xAA, 0x00 },
+    { "MID$(", 5, 0xC1, 0x00 },
+    { "MODE", 4, 0xEB, 0x02 },
+    { "MOD", 3, 0x83, 0x00 },
+    { "MOVE", 4, 0xEC, 0x02 },
+    { "NEXT", 4, 0xED, 0x02 },
+    { "NEW", 3, 0xCA, 0x01 },
+    { "NOT", 3, 0xAC, 0x00 },
+    { "OLD", 3, 0xCB, 0x01 },
+    { "ON", 2, 0xEE, 0x02 },
+    { "OFF", 3, 0x87, 0x00 },
+    { "OR", 2, 0x84, 0x00 },
+    { "OPENIN", 6, 0x8E, 0x00 },
+    { "OPENOUT", 7, 0xAE, 0x00 },
+    { "OPENUP", 6, 0xAD, 0x00 },
+    { "OSCLI", 5, 0xFF, 0x02 },
+    { "PRINT", 5, 0xF1, 0x02 },
+    { "PAGE", 4, 0x90, 0x43 },
+    { "PTR", 3, 0x8F, 0x43 },
+    { "PI", 2, 0xAF, 0x01 },
+    { "PLOT", 4, 0xF0, 0x02 },
+    { "POINT(", 6, 0xB0, 0x00 },
+    { "PROC", 4, 0xF2, 0x0a },
+    { "POS", 3, 0xB1, 0x01 },
+    { "RETURN", 6, 0xF8, 0x01 },
+    { "REPEAT", 6, 0xF5, 0x00 },
+    { "REPORT", 6, 0xF6, 0x01 },
+    { "READ", 4, 0xF3, 0x02 },
+    { "REM", 3, 0xF4, 0x20 },
+    { "RUN", 3, 0xF9, 0x01 },
+    { "RAD", 3, 0xB2, 0x00 },
+    { "RESTORE", 7, 0xF7, 0x12 },
+    { "RIGHT$(", 7, 0xC2, 0x00 },
+    { "RND", 3, 0xB3, 0x01 },
+    { "RENUMBER", 8, 0xCC, 0x10 },
+    { "STEP", 4, 0x88, 0x00 },
+    { "SAVE", 4, 0xCD, 0x02 },
+    { "SGN", 3, 0xB4, 0x00 },
+    { "SIN", 3, 0xB5, 0x00 },
+    { "SQR", 3, 0xB6, 0x00 },
+    { "SPC", 3, 0x89, 0x00 },
+    { "STR$", 4, 0xC3, 0x00 },
+    { "STRING$(", 8, 0xC4, 0x00 },
+    { "SOUND", 5, 0xD4, 0x02 },
+    { "STOP", 4, 0xFA, 0x01 },
+    { "TAN", 3, 0xB7, 0x00 },
+    { "THEN", 4, 0x8C, 0x14 },
+    { "TO", 2, 0xB8, 0x00 },
+    { "TAB(", 4, 0x8A, 0x00 },
+    { "TRACE", 5, 0xFC, 0x12 },
+    { "TIME", 4, 0x91, 0x43 },
+    { "TRUE", 4, 0xB9, 0x01 },
+    { "UNTIL", 5, 0xFD, 0x02 },
+    { "USR", 3, 0xBA, 0x00 },
+    { "VDU", 3, 0xEF, 0x02 },
+    { "VAL", 3, 0xBB, 0x00 },
+    { "VPOS", 4, 0xBC, 0x01 },
+    { "WIDTH", 5, 0xFE, 0x02 },
+};
+
+static const uint16_t basic_starts[129] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 8, 10, 20, 27, 39, 42, 47, 48, 54, 54, 54, 64, 68, 71,
+    79, 87, 87, 98, 108, 115, 117, 120, 121, 121, 121, 121, 121, 121, 121, 121,
+    121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121,
+    121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121,
+    121,
+};
+
+const bbcutil_dialect bbcutil_basic_dialect = {
+    basic_keywords,
+    basic_classes,
+    basic_match,
+    basic_starts
+};
+
+static const bbcutil_keyword comal_keywords[256] = {
+    [0x85] = { "AND", 0x03 },
+    [0x86] = { "DIV", 0x03 },
+    [0x87] = { "EOR", 0x03 },
+    [0x88] = { "MOD", 0x03 },
+    [0x89] = { "OR", 0x03 },
+    [0x8A] = { "IN", 0x03 },
+    [0x8B] = { "APPEND", 0x03 },
+    [0x8C] = { "DO", 0x03 },
+    [0x8D] = { "FILE", 0x03 },
+    [0x8E] = { "OF", 0x03 },
+    [0x8F] = { "RANDOM", 0x03 },
+    [0x90] = { "REF", 0x03 },
+    [0x91] = { "STEP", 0x03 },
+    [0x92] = { "TAB(", 0x00 },
+    [0x93] = { "THEN", 0x03 },
+    [0x94] = { "TO", 0x03 },
+    [0x95] = { "USING", 0x03 },
+    [0x96] = { ":", 0x00 },
+    [0x97] = { "FALSE", 0x00 },
+    [0x98] = { "PI", 0x00 },
+    [0x99] = { "TRUE", 0x00 },
+    [0x9A] = { "COUNT", 0x00 },
+    [0x9B] = { "EOD", 0x00 },
+    [0x9C] = { "GET", 0x00 },
+    [0x9D] = { "POS", 0x00 },
+    [0x9E] = { "SIZE", 0x00 },
+    [0x9F] = { "FREE", 0x00 },
+    [0xA0] = { "VPOS", 0x00 },
+    [0xA1] = { "GET$", 0x00 },
+    [0xA2] = { "LEN", 0x02 },
+    [0xA3] = { "ORD", 0x00 },
+    [0xA4] = { "VAL", 0x00 },
+    [0xA5] = { "ACS", 0x00 },
+    [0xA6] = { "ASN", 0x00 },
+    [0xA7] = { "ATN", 0x00 },
+    [0xA8] = { "COS", 0x00 },
+    [0xA9] = { "DEG", 0x00 },
+    [0xAA] = { "EXP", 0x00 },
+    [0xAB] = { "LN", 0x00 },
+    [0xAC] = { "LOG", 0x00 },
+    [0xAD] = { "RAD", 0x00 },
+    [0xAE] = { "SIN", 0x00 },
+    [0xAF] = { "SQR", 0x00 },
+    [0xB0] = { "TAN", 0x00 },
+    [0xB1] = { "INT", 0x00 },
+    [0xB2] = { "SGN", 0x00 },
+    [0xB3] = { "ABS", 0x00 },
+    [0xB4] = { "ADVAL", 0x00 },
+    [0xB5] = { "EOF", 0x00 },
+    [0xB6] = { "EXT", 0x00 },
+    [0xB7] = { "INKEY", 0x00 },
+    [0xB8] = { "NOT", 0x00 },
+    [0xB9] = { "USR", 0x00 },
+    [0xBA] = { "CHR$", 0x00 },
+    [0xBB] = { "INKEY$", 0x00 },
+    [0xBC] = { "STR$", 0x00 },
+    [0xBD] = { "RND", 0x00 },
+    [0xBE] = { "POINT(", 0x00 },
+    [0xBF] = { "MODE", 0x00 },
+    [0xC0] = { "PAGE", 0x00 },
+    [0xC1] = { "TIME", 0x00 },
+    [0xC2] = { "WIDTH", 0x02 },
+    [0xC3] = { "ZONE", 0x02 },
+    [0xC4] = { "CLEAR", 0x02 },
+    [0xC5] = { "NULL", 0x02 },
+    [0xC6] = { "CLG", 0x02 },
+    [0xC7] = { "CLS", 0x02 },
+    [0xC8] = { "NEW", 0x00 },
+    [0xC9] = { "STOP", 0x02 },
+    [0xCA] = { "RESTORE", 0x02 },
+    [0xCB] = { "EXEC", 0x02 },
+    [0xCC] = { "GOTO", 0x02 },
+    [0xCD] = { "DEL", 0x00 },
+    [0xCE] = { "//", 0x12 },
+    [0xCF] = { "DATA", 0x12 },
+    [0xD0] = { "RUN", 0x02 },
+    [0xD1] = { "SAVE", 0x00 },
+    [0xD2] = { "LOAD", 0x00 },
+    [0xD3] = { "DELETE", 0x00 },
+    [0xD4] = { "SELECT OUTPUT", 0x02 },
+    [0xD5] = { "VDU", 0x02 },
+    [0xD6] = { "DIM", 0x02 },
+    [0xD7] = { "OSCLI", 0x02 },
+    [0xD8] = { "OPEN", 0x02 },
+    [0xD9] = { "INPUT", 0x02 },
+    [0xDA] = { "WRITE", 0x02 },
+    [0xDB] = { "READ", 0x02 },
+    [0xDC] = { "CLOSE", 0x02 },
+    [0xDD] = { "DRAW", 0x02 },
+    [0xDE] = { "GCOL", 0x02 },
+    [0xDF] = { "MOVE", 0x02 },
+    [0xE0] = { "PLOT", 0x02 },
+    [0xE1] = { "SOUND", 0x02 },
+    [0xE2] = { "ENVELOPE", 0x02 },
+    [0xE3] = { "COLOUR", 0x02 },
+    [0xE4] = { "UNTIL", 0x0a },
+    [0xE5] = { "END", 0x02 },
+    [0xE6] = { "NEXT", 0x0a },
+    [0xE7] = { "RETURN", 0x02 },
+    [0xE8] = { "IMPORT", 0x02 },
+    [0xE9] = { "OTHERWISE", 0x02 },
+    [0xEA] = { "ELSE", 0x03 },
+    [0xEB] = { "WHEN", 0x03 },
+    [0xEC] = { "ELIF", 0x03 },
+    [0xED] = { "FUNC", 0x22 },
+    [0xEE] = { "PROC", 0x22 },
+    [0xEF] = { "CASE", 0x02 },
+    [0xF0] = { "REPEAT", 0x06 },
+    [0xF1] = { "IF", 0x02 },
+    [0xF2] = { "WHILE", 0x00 },
+    [0xF3] = { "FOR", 0x06 },
+    [0xF4] = { "PRINT", 0x02 },
+    [0xF5] = { "AUTO", 0x00 },
+    [0xF6] = { "RENUMBER", 0x00 },
+    [0xF7] = { "EDIT", 0x00 },
+    [0xF8] = { "LIST", 0x00 },
+    [0xF9] = { "CONT", 0x00 },
+    [0xFA] = { "DEBUG", 0x00 },
+    [0xFB] = { "OLD", 0x00 },
+    [0xFC] = { "READ ONLY", 0x02 },
+    [0xFD] = { "CLOSED", 0x02 },
+};
+
+static const uint8_t comal_classes[256] = {
+    [0x22] = BBCUTIL_CL_QUOTE,
+    [0x80] = BBCUTIL_CL_KEYWORD,
+    [0x81] = BBCUTIL_CL_KEYWORD,
+    [0x82] = BBCUTIL_CL_KEYWORD,
+    [0x83] = BBCUTIL_CL_KEYWORD,
+    [0x84] = BBCUTIL_CL_KEYWORD,
+    [0x85] = BBCUTIL_CL_KEYWORD,
+    [0x86] = BBCUTIL_CL_KEYWORD,
+    [0x87] = BBCUTIL_CL_KEYWORD,
+    [0x88] = BBCUTIL_CL_KEYWORD,
+    [0x89] = BBCUTIL_CL_KEYWORD,
+    [0x8A] = BBCUTIL_CL_KEYWORD,
+    [0x8B] = BBCUTIL_CL_KEYWORD,
+    [0x8C] = BBCUTIL_CL_KEYWORD,
+    [0x8D] = BBCUTIL_CL_KEYWORD,
+    [0x8E] = BBCUTIL_CL_KEYWORD,
+    [0x8F] = BBCUTIL_CL_KEYWORD,
+    [0x90] = BBCUTIL_CL_KEYWORD,
+    [0x91] = BBCUTIL_CL_KEYWORD,
+    [0x92] = BBCUTIL_CL_KEYWORD,
+    [0x93] = BBCUTIL_CL_KEYWORD,
+    [0x94] = BBCUTIL_CL_KEYWORD,
+    [0x95] = BBCUTIL_CL_KEYWORD,
+    [0x96] = BBCUTIL_CL_KEYWORD,
+    [0x97] = BBCUTIL_CL_KEYWORD,
+    [0x98] = BBCUTIL_CL_KEYWORD,
+    [0x99] = BBCUTIL_CL_KEYWORD,
+    [0x9A] = BBCUTIL_CL_KEYWORD,
+    [0x9B] = BBCUTIL_CL_KEYWORD,
+    [0x9C] = BBCUTIL_CL_KEYWORD,
+    [0x9D] = BBCUTIL_CL_KEYWORD,
+    [0x9E] = BBCUTIL_CL_KEYWORD,
+    [0x9F] = BBCUTIL_CL_KEYWORD,
+    [0xA0] = BBCUTIL_CL_KEYWORD,
+    [0xA1] = BBCUTIL_CL_KEYWORD,
+    [0xA2] = BBCUTIL_CL_KEYWORD,
+    [0xA3] = BBCUTIL_CL_KEYWORD,
+    [0xA4] = BBCUTIL_CL_KEYWORD,
+    [0xA5] = BBCUTIL_CL_KEYWORD,
+    [0xA6] = BBCUTIL_CL_KEYWORD,
+    [0xA7] = BBCUTIL_CL_KEYWORD,
+    [0xA8] = BBCUTIL_CL_KEYWORD,
+    [0xA9] = BBCUTIL_CL_KEYWORD,
+    [0xAA] = BBCUTIL_CL_KEYWORD,
+    [0xAB] = BBCUTIL_CL_KEYWORD,
+    [0xAC] = BBCUTIL_CL_KEYWORD,
+    [0xAD] = BBCUTIL_CL_KEYWORD,
+    [0xAE] = BBCUTIL_CL_KEYWORD,
+    [0xAF] = BBCUTIL_CL_KEYWORD,
+    [0xB0] = BBCUTIL_CL_KEYWORD,
+    [0xB1] = BBCUTIL_CL_KEYWORD,
+    [0xB2] = BBCUTIL_CL_KEYWORD,
+    [0xB3] = BBCUTIL_CL_KEYWORD,
+    [0xB4] = BBCUTIL_CL_KEYWORD,
+    [0xB5] = BBCUTIL_CL_KEYWORD,
+    [0xB6] = BBCUTIL_CL_KEYWORD,
+    [0xB7] = BBCUTIL_CL_KEYWORD,
+    [0xB8] = BBCUTIL_CL_KEYWORD,
+    [0xB9] = BBCUTIL_CL_KEYWORD,
+    [0xBA] = BBCUTIL_CL_KEYWORD,
+    [0xBB] = BBCUTIL_CL_KEYWORD,
+    [0xBC] = BBCUTIL_CL_KEYWORD,
+    [0xBD] = BBCUTIL_CL_KEYWORD,
+    [0xBE] = BBCUTIL_CL_KEYWORD,
+    [0xBF] = BBCUTIL_CL_KEYWORD,
+    [0xC0] = BBCUTIL_CL_KEYWORD,
+    [0xC1] = BBCUTIL_CL_KEYWORD,
+    [0xC2] = BBCUTIL_CL_KEYWORD,
+    [0xC3] = BBCUTIL_CL_KEYWORD,
+    [0xC4] = BBCUTIL_CL_KEYWORD,
+    [0xC5] = BBCUTIL_CL_KEYWORD,
+    [0xC6] = BBCUTIL_CL_KEYWORD,
+    [0xC7] = BBCUTIL_CL_KEYWORD,
+    [0xC8] = BBCUTIL_CL_KEYWORD,
+    [0xC9] = BBCUTIL_CL_KEYWORD,
+    [0xCA] = BBCUTIL_CL_KEYWORD,
+    [0xCB] = BBCUTIL_CL_KEYWORD,
+    [0xCC] = BBCUTIL_CL_KEYWORD,
+    [0xCD] = BBCUTIL_CL_KEYWORD,
+    [0xCE] = BBCUTIL_CL_TAIL,
+    [0xCF] = BBCUTIL_CL_TAIL,
+    [0xD0] = BBCUTIL_CL_KEYWORD,
+    [0xD1] = BBCUTIL_CL_KEYWORD,
+    [0xD2] = BBCUTIL_CL_KEYWORD,
+    [0xD3] = BBCUTIL_CL_KEYWORD,
+    [0xD4] = BBCUTIL_CL_KEYWORD,
+    [0xD5] = BBCUTIL_CL_KEYWORD,
+    [0xD6] = BBCUTIL_CL_KEYWORD,
+    [0xD7] = BBCUTIL_CL_KEYWORD,
+    [0xD8] = BBCUTIL_CL_KEYWORD,
+    [0xD9] = BBCUTIL_CL_KEYWORD,
+    [0xDA] = BBCUTIL_CL_KEYWORD,
+    [0xDB] = BBCUTIL_CL_KEYWORD,
+    [0xDC] = BBCUTIL_CL_KEYWORD,
+    [0xDD] = BBCUTIL_CL_KEYWORD,
+    [0xDE] = BBCUTIL_CL_KEYWORD,
+    [0xDF] = BBCUTIL_CL_KEYWORD,
+    [0xE0] = BBCUTIL_CL_KEYWORD,
+    [0xE1] = BBCUTIL_CL_KEYWORD,
+    [0xE2] = BBCUTIL_CL_KEYWORD,
+    [0xE3] = BBCUTIL_CL_KEYWORD,
+    [0xE4] = BBCUTIL_CL_KEYWORD,
+    [0xE5] = BBCUTIL_CL_KEYWORD,
+    [0xE6] = BBCUTIL_CL_KEYWORD,
+    [0xE7] = BBCUTIL_CL_KEYWORD,
+    [0xE8] = BBCUTIL_CL_KEYWORD,
+    [0xE9] = BBCUTIL_CL_KEYWORD,
+    [0xEA] = BBCUTIL_CL_KEYWORD,
+    [0xEB] = BBCUTIL_CL_KEYWORD,
+    [0xEC] = BBCUTIL_CL_KEYWORD,
+    [0xED] = BBCUTIL_CL_SKIPTWO,
+    [0xEE] = BBCUTIL_CL_SKIPTWO,
+    [0xEF] = BBCUTIL_CL_KEYWORD,
+    [0xF0] = BBCUTIL_CL_KEYWORD,
+    [0xF1] = BBCUTIL_CL_KEYWORD,
+    [0xF2] = BBCUTIL_CL_KEYWORD,
+    [0xF3] = BBCUTIL_CL_KEYWORD,
+    [0xF4] = BBCUTIL_CL_KEYWORD,
+    [0xF5] = BBCUTIL_CL_KEYWORD,
+    [0xF6] = BBCUTIL_CL_KEYWORD,
+    [0xF7] = BBCUTIL_CL_KEYWORD,
+    [0xF8] = BBCUTIL_CL_KEYWORD,
+    [0xF9] = BBCUTIL_CL_KEYWORD,
+    [0xFA] = BBCUTIL_CL_KEYWORD,
+    [0xFB] = BBCUTIL_CL_KEYWORD,
+    [0xFC] = BBCUTIL_CL_KEYWORD,
+    [0xFD] = BBCUTIL_CL_KEYWORD,
+    [0xFE] = BBCUTIL_CL_KEYWORD,
+    [0xFF] = BBCUTIL_CL_KEYWORD,
+};
+
+static const bbcutil_match comal_match[120] = {
+    { "//", 2, 0xCE, 0x00 },
+    { "APPEND", 6, 0x8B, 0x00 },
+    { "ADVAL", 5, 0xB4, 0x00 },
+    { "AUTO", 4, 0xF5, 0x00 },
+    { "AND", 3, 0x85, 0x00 },
+    { "ACS", 3, 0xA5, 0x00 },
+    { "ASN", 3, 0xA6, 0x00 },
+    { "ATN", 3, 0xA7, 0x00 },
+    { "ABS", 3, 0xB3, 0x00 },
+    { "COLOUR", 6, 0xE3, 0x00 },
+    { "CLOSED", 6, 0xFD, 0x00 },
+    { "COUNT", 5, 0x9A, 0x00 },
+    { "CLEAR", 5, 0xC4, 0x00 },
+    { "CLOSE", 5, 0xDC, 0x00 },
+    { "CHR$", 4, 0xBA, 0x00 },
+    { "CASE", 4, 0xEF, 0x00 },
+    { "CONT", 4, 0xF9, 0x00 },
+    { "COS", 3, 0xA8, 0x00 },
+    { "CLG", 3, 0xC6, 0x00 },
+    { "CLS", 3, 0xC7, 0x00 },
+    { "DELETE", 6, 0xD3, 0x00 },
+    { "DEBUG", 5, 0xFA, 0x00 },
+    { "DATA", 4, 0xCF, 0x00 },
+    { "DRAW", 4, 0xDD, 0x00 },
+    { "DIV", 3, 0x86, 0x00 },
+    { "DEG", 3, 0xA9, 0x00 },
+    { "DEL", 3, 0xCD, 0x00 },
+    { "DIM", 3, 0xD6, 0x00 },
+    { "DO", 2, 0x8C, 0x00 },
+    { "ENVELOPE", 8, 0xE2, 0x00 },
+    { "EXEC", 4, 0xCB, 0x00 },
+    { "ELSE", 4, 0xEA, 0x00 },
+    { "ELIF", 4, 0xEC, 0x00 },
+    { "EDIT", 4, 0xF7, 0x00 },
+    { "EOR", 3, 0x87, 0x00 },
+    { "EOD", 3, 0x9B, 0x00 },
+    { "EXP", 3, 0xAA, 0x00 },
+    { "EOF", 3, 0xB5, 0x00 },
+    { "EXT", 3, 0xB6, 0x00 },
+    { "END", 3, 0xE5, 0x00 },
+    { "FALSE", 5, 0x97, 0x00 },
+    { "FILE", 4, 0x8D, 0x00 },
+    { "FREE", 4, 0x9F, 0x00 },
+    { "FUNC", 4, 0xED, 0x00 },
+    { "FOR", 3, 0xF3, 0x00 },
+    { "GET$", 4, 0xA1, 0x00 },
+    { "GOTO", 4, 0xCC, 0x00 },
+    { "GCOL", 4, 0xDE, 0x00 },
+    { "GET", 3, 0x9C, 0x00 },
+    { "INKEY$", 6, 0xBB, 0x00 },
+    { "IMPORT", 6, 0xE8, 0x00 },
+    { "INKEY", 5, 0xB7, 0x00 },
+    { "INPUT", 5, 0xD9, 0x00 },
+    { "INT", 3, 0xB1, 0x00 },
+    { "IN", 2, 0x8A, 0x00 },
+    { "IF", 2, 0xF1, 0x00 },
+    { "LOAD", 4, 0xD2, 0x00 },
+    { "LIST", 4, 0xF8, 0x00 },
+    { "LEN", 3, 0xA2, 0x00 },
+    { "LOG", 3, 0xAC, 0x00 },
+    { "LN", 2, 0xAB, 0x00 },
+    { "MODE", 4, 0xBF, 0x00 },
+    { "MOVE", 4, 0xDF, 0x00 },
+    { "MOD", 3, 0x88, 0x00 },
+    { "NULL", 4, 0xC5, 0x00 },
+    { "NEXT", 4, 0xE6, 0x00 },
+    { "NOT", 3, 0xB8, 0x00 },
+    { "NEW", 3, 0xC8, 0x00 },
+    { "OTHERWISE", 9, 0xE9, 0x00 },
+    { "OSCLI", 5, 0xD7, 0x00 },
+    { "OPEN", 4, 0xD8, 0x00 },
+    { "ORD", 3, 0xA3, 0x00 },
+    { "OLD", 3, 0xFB, 0x00 },
+    { "OR", 2, 0x89, 0x00 },
+    { "OF", 2, 0x8E, 0x00 },
+    { "POINT(", 6, 0xBE, 0x00 },
+    { "PRINT", 5, 0xF4, 0x00 },
+    { "PAGE", 4, 0xC0, 0x00 },
+    { "PLOT", 4, 0xE0, 0x00 },
+    { "PROC", 4, 0xEE, 0x00 },
+    { "POS", 3, 0x9D, 0x00 },
+    { "PI", 2, 0x98, 0x00 },
+    { "READ ONLY", 9, 0xFC, 0x00 },
+    { "RENUMBER", 8, 0xF6, 0x00 },
+    { "RESTORE", 7, 0xCA, 0x00 },
+    { "RANDOM", 6, 0x8F, 0x00 },
+    { "RETURN", 6, 0xE7, 0x00 },
+    { "REPEAT", 6, 0xF0, 0x00 },
+    { "READ", 4, 0xDB, 0x00 },
+    { "REF", 3, 0x90, 0x00 },
+    { "RAD", 3, 0xAD, 0x00 },
+    { "RND", 3, 0xBD, 0x00 },
+    { "RUN", 3, 0xD0, 0x00 },
+    { "SELECT OUTPUT", 13, 0xD4, 0x00 },
+    { "SOUND", 5, 0xE1, 0x00 },
+    { "STEP", 4, 0x91, 0x00 },
+    { "SIZE", 4, 0x9E, 0x00 },
+    { "STR$", 4, 0xBC, 0x00 },
+    { "STOP", 4, 0xC9, 0x00 },
+    { "SAVE", 4, 0xD1, 0x00 },
+    { "SIN", 3, 0xAE, 0x00 },
+    { "SQR", 3, 0xAF, 0x00 },
+    { "SGN", 3, 0xB2, 0x00 },
+    { "TAB(", 4, 0x92, 0x00 },
+    { "THEN", 4, 0x93, 0x00 },
+    { "TRUE", 4, 0x99, 0x00 },
+    { "TIME", 4, 0xC1, 0x00 },
+    { "TAN", 3, 0xB0, 0x00 },
+    { "TO", 2, 0x94, 0x00 },
+    { "USING", 5, 0x95, 0x00 },
+    { "UNTIL", 5, 0xE4, 0x00 },
+    { "USR", 3, 0xB9, 0x00 },
+    { "VPOS", 4, 0xA0, 0x00 },
+    { "VAL", 3, 0xA4, 0x00 },
+    { "VDU", 3, 0xD5, 0x00 },
+    { "WIDTH", 5, 0xC2, 0x00 },
+    { "WRITE", 5, 0xDA, 0x00 },
+    { "WHILE", 5, 0xF2, 0x00 },
+    { "WHEN", 4, 0xEB, 0x00 },
+    { "ZONE", 4, 0xC3, 0x00 },
+};
+
+static const uint16_t comal_starts[129] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 9, 9, 20, 29, 40, 45, 49, 49, 56, 56, 56, 61, 64, 68,
+    75, 82, 82, 93, 103, 109, 112, 115, 119, 119, 119, 120, 120, 120, 120, 120,
+    120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120,
+    120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120,
+    120,
+};
+
+const bbcutil_dialect bbcutil_comal_dialect = {
+    comal_keywords,
+    comal_classes,
+    comal_match,
+    comal_starts
+};
@@ -0,0 +1,280 @@
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Streaming reader and writer for ustar archives with the pax and GNU
+ * long name extensions.  Only regular files are returned by the reader,
+ * other member types are skipped. */
+
+#define TAR_BLOCK 512
+
+static const unsigned char zero_block[TAR_BLOCK];
+
+static uint64_t tar_number(const unsigned char *field, size_t len)
+{
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        /* GNU base-256 encoding for large values */
+        value = field[0] & 0x3f;
+        for (size_t i = 1; i < len; i++)
+            value = (value << 8) | field[i];
+        return value;
+    }
+    while (len && *field == ' ') {
+        field++;
+        len--;
+    }
+    while (len && *field >= '0' && *field <= '7') {
+        value = (value << 3) | (*field++ - '0');
+        len--;
+    }
+    return value;
+}
+
+static bool tar_cksum_ok(const unsigned char *hdr)
+{
+    unsigned sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++)
+        sum += (i >= 148 && i < 156) ? ' ' : hdr[i];
+    return sum == tar_number(hdr + 148, 8);
+}
+
+static bbcutil_res tar_skip(FILE *fp, uint64_t size)
+{
+    unsigned char buf[TAR_BLOCK];
+    size = (size + TAR_BLOCK - 1) & ~(uint64_t)(TAR_BLOCK - 1);
+    while (size) {
+        if (fread(buf, TAR_BLOCK, 1, fp) != 1)
+            return ferror(fp) ? BBCUTIL_IOERR : BBCUTIL_BADHDR;
+        size -= TAR_BLOCK;
+    }
+    return BBCUTIL_OK;
+}
+
+static bbcutil_res tar_data(FILE *fp, unsigned char *data, size_t size)
+{
+    unsigned char pad[TAR_BLOCK];
+    size_t plen = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    if ((size && fread(data, size, 1, fp) != 1) || (plen && fread(pad, plen, 1, fp) != 1))
+        return ferror(fp) ? BBCUTIL_IOERR : BBCUTIL_BADHDR;
+    return BBCUTIL_OK;
+}
+
+static char *tar_header_name(const unsigned char *hdr)
+{
+    const char *name = (const char *)hdr;
+    const char *prefix = (const char *)hdr + 345;
+    size_t nlen = strnlen(name, 100);
+    size_t plen = memcmp(hdr + 257, "ustar", 5) ? 0 : strnlen(prefix, 155);
+    char *full = malloc(plen + nlen + 2);
+    if (full) {
+        char *ptr = full;
+        if (plen) {
+            memcpy(ptr, prefix, plen);
+            ptr += plen;
+            *ptr++ = '/';
+        }
+        memcpy(ptr, name, nlen);
+        ptr[nlen] = 0;
+    }
+    return full;
+}
+
+static void pax_parse(char *rec, char *end, char **path, uint64_t *size, long *mtime)
+{
+    while (rec < end) {
+        char *key;
+        unsigned long len = strtoul(rec, &key, 10);
+        if (len == 0 || *key != ' ' || len > (unsigned long)(end - rec))
+            break;
+        char *next = rec + len;
+        /* a record must hold a key after its length and end the line */
+        if (++key + 1 >= next || next[-1] != '\n')
+            break;
+        char *value = memchr(key, '=', next - key);
+        if (value) {
+            *value++ = 0;
+            next[-1] = 0;
+            if (!strcmp(key, "path")) {
+                free(*path);
+                *path = strdup(value);
+            }
+            else if (!strcmp(key, "size"))
+                *size = strtoull(value, NULL, 10);
+            else if (!strcmp(key, "mtime"))
+                *mtime = strtol(value, NULL, 10);
+        }
+        rec = next;
+    }
+}
+
+bbcutil_res bbcutil_tar_read(FILE *fp, bbcutil_member *mem)
+{
+    unsigned char hdr[TAR_BLOCK];
+    char *ext_path = NULL;
+    uint64_t ext_size = UINT64_MAX;
+    long ext_mtime = -1;
+    bbcutil_res res;
+
+    for (;;) {
+        if (fread(hdr, TAR_BLOCK, 1, fp) != 1) {
+            res = ferror(fp) ? BBCUTIL_IOERR : BBCUTIL_EOF;
+            break;
+        }
+        if (!memcmp(hdr, zero_block, TAR_BLOCK)) {
+            res = BBCUTIL_EOF;
+            break;
+        }
+        if (!tar_cksum_ok(hdr)) {
+            res = BBCUTIL_BADHDR;
+            break;
+        }
+        uint64_t size = tar_number(hdr + 124, 12);
+        int type = hdr[156];
+        if (type == 'x' || type == 'L') {
+            /* extended header applying to the next member */
+            char *ext = malloc(size + 1);
+            if (!ext) {
+                res = BBCUTIL_NOMEM;
+                break;
+            }
+            if ((res = tar_data(fp, (unsigned char *)ext, size)) != BBCUTIL_OK) {
+                free(ext);
+                break;
+            }
+            ext[size] = 0;
+            if (type == 'L') {
+                free(ext_path);
+                ext_path = ext;
+            }
+            else {
+                pax_parse(ext, ext + size, &ext_path, &ext_size, &ext_mtime);
+                free(ext);
+            }
+        }
+        else if (type == '0' || type == 0 || type == '7') {
+            if (ext_size != UINT64_MAX)
+                size = ext_size;
+            if (size > SIZE_MAX) {
+                res = BBCUTIL_NOMEM;
+                break;
+            }
+            if (size > mem->cap) {
+                unsigned char *data = realloc(mem->data, size);
+                if (!data) {
+                    res = BBCUTIL_NOMEM;
+                    break;
+                }
+                mem->data = data;
+                mem->cap = size;
+            }
+            free(mem->name);
+            mem->name = ext_path ? ext_path : tar_header_name(hdr);
+            ext_path = NULL;
+            if (!mem->name) {
+                res = BBCUTIL_NOMEM;
+                break;
+            }
+            mem->size = size;
+            mem->mtime = ext_mtime >= 0 ? ext_mtime : (long)tar_number(hdr + 136, 12);
+            return tar_data(fp, mem->data, size);
+        }
+        else {
+            if ((res = tar_skip(fp, size)) != BBCUTIL_OK)
+                break;
+            free(ext_path);
+            ext_path = NULL;
+            ext_size = UINT64_MAX;
+            ext_mtime = -1;
+        }
+    }
+    free(ext_path);
+    return res;
+}
+
+void bbcutil_tar_free(bbcutil_member *mem)
+{
+    free(mem->name);
+    free(mem->data);
+    mem->name = NULL;
+    mem->data = NULL;
+    mem->size = mem->cap = 0;
+}
+
+static bbcutil_res tar_put(FILE *fp, const char *name, size_t nlen, const char *prefix, size_t plen, uint64_t size, long mtime, int type)
+{
+    unsigned char hdr[TAR_BLOCK];
+    memset(hdr, 0, TAR_BLOCK);
+    memcpy(hdr, name, nlen);
+    memcpy(hdr + 345, prefix, plen);
+    memcpy(hdr + 100, "0000644", 7);
+    memcpy(hdr + 108, "0000000", 7);
+    memcpy(hdr + 116, "0000000", 7);
+    snprintf((char *)hdr + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf((char *)hdr + 136, 12, "%011lo", (unsigned long)mtime);
+    memset(hdr + 148, ' ', 8);
+    hdr[156] = type;
+    memcpy(hdr + 257, "ustar", 6);
+    memcpy(hdr + 263, "00", 2);
+    unsigned sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++)
+        sum += hdr[i];
+    snprintf((char *)hdr + 148, 8, "%06o", sum);
+    if (fwrite(hdr, TAR_BLOCK, 1, fp) != 1)
+        return BBCUTIL_IOERR;
+    return BBCUTIL_OK;
+}
+
+static bbcutil_res tar_pad(FILE *fp, size_t size)
+{
+    size_t pad = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    if (pad && fwrite(zero_block, pad, 1, fp) != 1)
+        return BBCUTIL_IOERR;
+    return BBCUTIL_OK;
+}
+
+bbcutil_res bbcutil_tar_write(FILE *fp, const char *name, const void *data, size_t size, long mtime)
+{
+    size_t len = strlen(name);
+    bbcutil_res res;
+    if (len <= 100)
+        res = tar_put(fp, name, len, "", 0, size, mtime, '0');
+    else {
+        /* try a ustar prefix split before falling back to pax */
+        const char *end = name + len;
+        const char *slash = memchr(name, '/', len);
+        while (slash && end - slash - 1 > 100)
+            slash = memchr(slash + 1, '/', end - slash - 1);
+        if (slash && slash > name && slash - name <= 155 && slash[1])
+            res = tar_put(fp, slash + 1, end - slash - 1, name, slash - name, size, mtime, '0');
+        else {
+            char rec[32];
+            size_t rlen = len + 7;
+            size_t digits = snprintf(rec, sizeof(rec), "%zu", rlen);
+            if (snprintf(rec, sizeof(rec), "%zu", rlen + digits) > (int)digits)
+                digits++;
+            rlen += digits;
+            snprintf(rec, sizeof(rec), "%zu path=", rlen);
+            if ((res = tar_put(fp, "././@PaxHeader", 14, "", 0, rlen, mtime, 'x')) != BBCUTIL_OK)
+                return res;
+            if (fputs(rec, fp) == EOF || fwrite(name, len, 1, fp) != 1 || putc('\n', fp) == EOF)
+                return BBCUTIL_IOERR;
+            if ((res = tar_pad(fp, rlen)) != BBCUTIL_OK)
+                return res;
+            res = tar_put(fp, name, 100, "", 0, size, mtime, '0');
+        }
+    }
+    if (res == BBCUTIL_OK) {
+        if (size && fwrite(data, size, 1, fp) != 1)
+            return BBCUTIL_IOERR;
+        res = tar_pad(fp, size);
+    }
+    return res;
+}
+
+bbcutil_res bbcutil_tar_end(FILE *fp)
+{
+    if (fwrite(zero_block, TAR_BLOCK, 1, fp) != 1 || fwrite(zero_block, TAR_BLOCK, 1, fp) != 1)
+        return BBCUTIL_IOERR;
+    return BBCUTIL_OK;
+}
@@ -0,0 +1,752 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* 10 PRINT "HI";:REM X
+ * 20 GOTO 10
+ * 30 DATA 1,2 */
+
+static const unsigned char wilson[] = {
+    0x0d, 0x00, 0x0a, 0x0f, 0xf1, ' ', '"', 'H', 'I', '"', ';', ':', 0xf4, ' ', 'X',
+    0x0d, 0x00, 0x14, 0x0a, 0xe5, ' ', 0x8d, 0x54, 0x4a, 0x40,
+    0x0d, 0x00, 0x1e, 0x09, 0xdc, '1', ',', '2', ' ',
+    0x0d, 0xff
+};
+
+/* the same with the Russell layout */
+
+static const unsigned char russell[] = {
+    0x0f, 0x0a, 0x00, 0xf1, ' ', '"', 'H', 'I', '"', ';', ':', 0xf4, ' ', 'X', 0x0d,
+    0x0a, 0x14, 0x00, 0xe5, ' ', 0x8d, 0x54, 0x4a, 0x40, 0x0d,
+    0x09, 0x1e, 0x00, 0xdc, '1', ',', '2', ' ', 0x0d,
+    0x00, 0xff, 0xff
+};
+
+/* 10 PRINT "A" // C with an indent byte and a two byte payload token */
+
+static const unsigned char comal[] = {
+    0x0d, 0x00, 0x0a, 0x0c, 0x01, 0xed, 0x12, 0x34, 0x22, 'A', 0x22, 0xce,
+    0x0d, 0xff
+};
+
+struct expect {
+    bbcutil_toktype type;
+    unsigned tok;
+    unsigned lineno;
+    const char *text;
+};
+
+static const struct expect basic_expect[] = {
+    { BBCUTIL_TOK_KEYWORD, 0xf1, 0,  NULL       },
+    { BBCUTIL_TOK_PLAIN,   0,    0,  " "        },
+    { BBCUTIL_TOK_STRING,  1,    0,  "\"HI\""   },
+    { BBCUTIL_TOK_PLAIN,   0,    0,  ";:"       },
+    { BBCUTIL_TOK_TAIL,    0xf4, 0,  " X"       },
+    { BBCUTIL_TOK_KEYWORD, 0xe5, 0,  NULL       },
+    { BBCUTIL_TOK_PLAIN,   0,    0,  " "        },
+    { BBCUTIL_TOK_LINENO,  0x8d, 10, NULL       },
+    { BBCUTIL_TOK_TAIL,    0xdc, 0,  "1,2 "     }
+};
+
+static const struct expect comal_expect[] = {
+    { BBCUTIL_TOK_KEYWORD, 0xed, 0,  NULL       },
+    { BBCUTIL_TOK_STRING,  1,    0,  "\"A\""    },
+    { BBCUTIL_TOK_TAIL,    0xce, 0,  ""         }
+};
+
+static bool check_prog(const char *name, const unsigned char *prog, size_t size, bbcutil_kind kind,
+                       const struct expect *exp, unsigned nexp, unsigned nlines)
+{
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bbcutil_toks toks;
+    bbcutil_tok tok;
+    unsigned lineno = 0, count = 0, ix = 0;
+    bool worked = true;
+
+    bbcutil_lines_init(&lines, prog, prog + size, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        if (line.lineno != (count + 1) * 10) {
+            printf("Line number mismatch in %s\nExpected: %u\nGot:      %u\n\n", name, (count + 1) * 10, line.lineno);
+            worked = false;
+        }
+        count++;
+        bbcutil_toks_init(&toks, &line, kind);
+        while (bbcutil_toks_next(&toks, &tok)) {
+            if (ix >= nexp) {
+                printf("Extra token in %s line %u\n\n", name, line.lineno);
+                return false;
+            }
+            const struct expect *e = exp + ix++;
+            bool match = tok.type == e->type && tok.tok == e->tok;
+            if (e->type == BBCUTIL_TOK_LINENO && tok.lineno != e->lineno)
+                match = false;
+            if (e->text && ((size_t)(tok.end - tok.ptr) != strlen(e->text) || memcmp(tok.ptr, e->text, tok.end - tok.ptr)))
+                match = false;
+            if (!match) {
+                printf("Token mismatch in %s line %u token %u\nExpected: %d %02X\nGot:      %d %02X\n\n",
+                       name, line.lineno, ix, e->type, e->tok, tok.type, tok.tok);
+                worked = false;
+            }
+        }
+        lineno = line.lineno;
+    }
+    if (count != nlines || ix != nexp) {
+        printf("Count mismatch in %s after line %u\nExpected: %u lines, %u tokens\nGot:      %u lines, %u tokens\n\n",
+               name, lineno, nlines, nexp, count, ix);
+        worked = false;
+    }
+    return worked;
+}
+
+static bool check_lineno(void)
+{
+    unsigned char enc[3];
+    for (unsigned lineno = 0; lineno <= 32767; lineno++) {
+        bbcutil_lineno_encode(enc, lineno);
+        unsigned got = bbcutil_lineno_decode(enc);
+        if (got != lineno || (enc[0] & 0xc0) != 0x40 || (enc[1] & 0xc0) != 0x40 || (enc[2] & 0xc0) != 0x40) {
+            printf("Line number encoding mismatch\nExpected: %u\nGot:      %u (%02X %02X %02X)\n\n", lineno, got, enc[0], enc[1], enc[2]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_map(void)
+{
+    bbcutil_map map;
+    bool worked = true;
+    if (bbcutil_map_init(&map, 4) != BBCUTIL_OK) {
+        fputs("bbcutil_test: out of memory\n", stderr);
+        return false;
+    }
+    for (uint32_t key = 0; key < 100000; key += 3)
+        if (bbcutil_map_put(&map, key, key ^ 0x5555) != BBCUTIL_OK) {
+            fputs("bbcutil_test: out of memory\n", stderr);
+            bbcutil_map_free(&map);
+            return false;
+        }
+    for (uint32_t key = 0; key < 100000; key++) {
+        uint32_t value;
+        bool found = bbcutil_map_get(&map, key, &value);
+        if (found != (key % 3 == 0) || (found && value != (key ^ 0x5555))) {
+            printf("Map mismatch for key %u\n\n", key);
+            worked = false;
+            break;
+        }
+    }
+    bbcutil_map_free(&map);
+    return worked;
+}
+
+static void count_dangling(void *ctx, unsigned lineno, unsigned target)
+{
+    ++*(unsigned *)ctx;
+}
+
+static bool check_renumber(const char *name, const unsigned char *prog, size_t size, bbcutil_kind kind)
+{
+    unsigned char copy[64];
+    unsigned dangling = 0;
+    bool worked = true;
+    memcpy(copy, prog, size);
+    bbcutil_res res = bbcutil_renumber(copy, copy + size, kind, 1000, 1000, count_dangling, &dangling);
+    if (res != BBCUTIL_OK) {
+        printf("Renumber failed in %s: %s\n\n", name, bbcutil_rmsg(res));
+        return false;
+    }
+    bbcutil_lines lines;
+    bbcutil_line line;
+    unsigned expected = 1000;
+    bbcutil_lines_init(&lines, copy, copy + size, kind);
+    while (bbcutil_lines_next(&lines, &line)) {
+        if (line.lineno != expected) {
+            printf("Renumber mismatch in %s\nExpected: %u\nGot:      %u\n\n", name, expected, line.lineno);
+            worked = false;
+        }
+        expected += 1000;
+        bbcutil_toks toks;
+        bbcutil_tok tok;
+        bbcutil_toks_init(&toks, &line, kind);
+        while (bbcutil_toks_next(&toks, &tok))
+            if (tok.type == BBCUTIL_TOK_LINENO && tok.lineno != 1000) {
+                printf("Renumbered reference mismatch in %s\nExpected: 1000\nGot:      %u\n\n", name, tok.lineno);
+                worked = false;
+            }
+    }
+    if (dangling) {
+        printf("Unexpected dangling references in %s: %u\n\n", name, dangling);
+        worked = false;
+    }
+    if (bbcutil_renumber(copy, copy + size, kind, 32767, 1, NULL, NULL) != BBCUTIL_RANGE) {
+        printf("Out of range renumber not detected in %s\n\n", name);
+        worked = false;
+    }
+    return worked;
+}
+
+/* 10 OPEN FILE 1,"X" 20 PRINT FILE 1,"A" 30 CLOSE FILE 1 in COMAL, where
+ * the FILE token is the BASIC line number token */
+
+static const unsigned char comal_file[] = {
+    0x0d, 0x00, 0x0a, 0x0c, 0x00, 0xd8, 0x8d, '1', ',', '"', 'X', '"',
+    0x0d, 0x00, 0x14, 0x0c, 0x00, 0xf4, 0x8d, '1', ',', '"', 'A', '"',
+    0x0d, 0x00, 0x1e, 0x08, 0x00, 0xdc, 0x8d, '1',
+    0x0d, 0xff
+};
+
+/* renumbering COMAL changes the line headers and nothing else */
+
+static bool check_comal_renumber(void)
+{
+    unsigned char copy[sizeof(comal_file)];
+    unsigned dangling = 0;
+    memcpy(copy, comal_file, sizeof(copy));
+    bbcutil_res res = bbcutil_renumber(copy, copy + sizeof(copy), BBCUTIL_COMAL, 100, 5, count_dangling, &dangling);
+    bool worked = res == BBCUTIL_OK && !dangling;
+    for (size_t i = 0; worked && i < sizeof(copy); i++) {
+        unsigned expect = comal_file[i];
+        if (i == 2 || i == 14 || i == 26)
+            expect = 100 + 5 * (i / 12);
+        worked = copy[i] == expect;
+    }
+    if (!worked)
+        printf("COMAL renumber mismatch: %s, %u dangling\n\n", bbcutil_rmsg(res), dangling);
+    return worked;
+}
+
+/* 10 A%=1E5+&FF+.5E-3+E:B$(1)=C:GOTO10:PROCfoo_1:DEFFNbar */
+
+static const unsigned char idents[] = {
+    0x0d, 0x00, 0x0a, 0x31, 'A', '%', '=', '1', 'E', '5', '+', '&', 'F', 'F', '+', '.', '5', 'E', '-', '3', '+', 'E', ':',
+    'B', '$', '(', '1', ')', '=', 'C', ':', 0xe5, 0x8d, 0x54, 0x4a, 0x40, ':',
+    0xf2, 'f', 'o', 'o', '_', '1', ':', 0xdd, 0xa4, 'b', 'a', 'r',
+    0x0d, 0xff
+};
+
+/* the digits and exponents of numbers are not taken for names */
+
+static bool check_idents(void)
+{
+    static const struct {
+        bbcutil_idtype type;
+        bool def;
+        const char *name;
+        unsigned lineno;
+    } expect[] = {
+        { BBCUTIL_ID_VAR, false, "A%", 0 },
+        { BBCUTIL_ID_VAR, false, "E", 0 },
+        { BBCUTIL_ID_ARRAY, false, "B$", 0 },
+        { BBCUTIL_ID_VAR, false, "C", 0 },
+        { BBCUTIL_ID_LINEREF, false, "", 10 },
+        { BBCUTIL_ID_PROC, false, "foo_1", 0 },
+        { BBCUTIL_ID_FN, true, "bar", 0 }
+    };
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bbcutil_idents it;
+    bbcutil_ident id;
+    unsigned count = 0;
+    bool worked = true;
+    bbcutil_lines_init(&lines, idents, idents + sizeof(idents) - 2, BBCUTIL_WILSON);
+    while (bbcutil_lines_next(&lines, &line)) {
+        bbcutil_idents_init(&it, &line);
+        while (bbcutil_idents_next(&it, &id)) {
+            if (count < 7 && (id.type != expect[count].type || id.def != expect[count].def
+                              || id.len != strlen(expect[count].name) || (id.len && memcmp(id.name, expect[count].name, id.len))
+                              || id.lineno != expect[count].lineno)) {
+                printf("Identifier %u mismatch\nExpected: %d %d %s %u\nGot:      %d %d %.*s %u\n\n", count,
+                       expect[count].type, expect[count].def, expect[count].name, expect[count].lineno,
+                       id.type, id.def, (int)id.len, id.name ? (const char *)id.name : "", id.lineno);
+                worked = false;
+            }
+            count++;
+        }
+    }
+    if (count != 7) {
+        printf("Identifier count mismatch\nExpected: 7\nGot:      %u\n\n", count);
+        worked = false;
+    }
+    return worked;
+}
+
+/* 10 ON X GOTO 20,30 */
+
+static const unsigned char computed[] = {
+    0x0d, 0x00, 0x0a, 0x0e, 0xee, 'X', 0xe5, 0x8d, 0x54, 0x54, 0x40, ',', '3', '0',
+    0x0d, 0xff
+};
+
+static bool check_targets(void)
+{
+    uint8_t refs[BBCUTIL_REFS_SIZE];
+    bool worked = true;
+    if (!bbcutil_line_targets(wilson, wilson + sizeof(wilson) - 2, BBCUTIL_WILSON, refs)) {
+        printf("Line targets of wilson not all known\n\n");
+        worked = false;
+    }
+    for (unsigned lineno = 0; lineno < 65536; lineno++)
+        if (!(refs[lineno >> 3] & (1 << (lineno & 7))) != (lineno != 10)) {
+            printf("Line target mismatch for line %u\n\n", lineno);
+            worked = false;
+        }
+    if (bbcutil_line_targets(computed, computed + sizeof(computed) - 2, BBCUTIL_WILSON, refs)) {
+        printf("Untokenised line number in ON GOTO not detected\n\n");
+        worked = false;
+    }
+    return worked;
+}
+
+/* 10 NEXT
+ * 20 PRINT"x"
+ * 30 PRINT"y" */
+
+static const unsigned char unbalanced[] = {
+    0x0d, 0x00, 0x0a, 0x05, 0xed,
+    0x0d, 0x00, 0x14, 0x08, 0xf1, '"', 'x', '"',
+    0x0d, 0x00, 0x1e, 0x08, 0xf1, '"', 'y', '"',
+    0x0d, 0xff
+};
+
+/* An index saved and loaded back is accepted, but not once its kind,
+ * the order of its offsets or line numbers or its end are damaged. */
+
+static bool check_index(void)
+{
+    char fn[] = "/tmp/bbcutil_testXXXXXX";
+    int fd = mkstemp(fn);
+    if (fd < 0) {
+        perror("bbcutil_test: mkstemp");
+        return false;
+    }
+    close(fd);
+    static const char *damage[] = { "none", "kind", "offsets", "end", "line numbers" };
+    bool worked = true;
+    for (int i = 0; i < 5; i++) {
+        bbcutil_index idx;
+        size_t size = sizeof(wilson);
+        if (bbcutil_index_build(&idx, wilson, wilson + size - 2, BBCUTIL_WILSON, bbcutil_basic_depth) != BBCUTIL_OK) {
+            fputs("bbcutil_test: out of memory\n", stderr);
+            worked = false;
+            break;
+        }
+        uint32_t *kind = (uint32_t *)((char *)idx.mem + 4);
+        uint32_t *offsets = (uint32_t *)idx.offsets;
+        uint16_t *linenos = (uint16_t *)idx.linenos;
+        if (i == 1)
+            *kind = 9;
+        else if (i == 2)
+            offsets[1] = offsets[2];
+        else if (i == 3)
+            offsets[idx.count] = size + 1;
+        else if (i == 4)
+            linenos[1] = 5;
+        bbcutil_res res = bbcutil_index_save(&idx, fn, size, 1);
+        bbcutil_index_free(&idx);
+        if (res == BBCUTIL_OK && (res = bbcutil_index_load(&idx, fn, size, 1)) == BBCUTIL_OK)
+            bbcutil_index_free(&idx);
+        if (res != (i ? BBCUTIL_BADHDR : BBCUTIL_OK)) {
+            printf("Index load mismatch with %s damaged\nExpected: %s\nGot:      %s\n\n", damage[i],
+                   bbcutil_rmsg(i ? BBCUTIL_BADHDR : BBCUTIL_OK), bbcutil_rmsg(res));
+            worked = false;
+        }
+    }
+    unlink(fn);
+    return worked;
+}
+
+/* An indented listing of a range of lines should be the tail of the full
+ * one, even where a NEXT without a FOR would take the indent below 0. */
+
+static char *list_text(const unsigned char *prog, size_t size, bbcutil_kind kind, bool range, size_t *len)
+{
+    bbcutil_listing *lst = bbcutil_listing_new();
+    bbcutil_renderer *rend = NULL;
+    bbcutil_index idx;
+    char *text = NULL;
+    FILE *ofp;
+    if (lst && bbcutil_renderer_new("plain", 5, &rend) == BBCUTIL_OK && (ofp = open_memstream(&text, len))) {
+        bbcutil_listing_clear(lst, prog);
+        if (!range)
+            bbcutil_listing_decode(lst, prog, prog + size - 2, kind, NULL, true);
+        else if (bbcutil_index_build(&idx, prog, prog + size - 2, kind, bbcutil_basic_depth) == BBCUTIL_OK) {
+            bbcutil_listing_range(lst, &idx, 20, 30, true);
+            bbcutil_index_free(&idx);
+        }
+        bbcutil_render(rend, lst, ofp);
+        fclose(ofp);
+    }
+    bbcutil_renderer_free(rend);
+    bbcutil_listing_free(lst);
+    return text;
+}
+
+static bool check_range(void)
+{
+    size_t full_len = 0, range_len = 0;
+    char *full = list_text(unbalanced, sizeof(unbalanced), BBCUTIL_WILSON, false, &full_len);
+    char *range = list_text(unbalanced, sizeof(unbalanced), BBCUTIL_WILSON, true, &range_len);
+    bool worked = full && range && range_len > 0 && range_len < full_len
+        && !memcmp(full + full_len - range_len, range, range_len);
+    if (!worked)
+        printf("Range listing mismatch\nFull:  %s\nRange: %s\n", full ? full : "", range ? range : "");
+    free(full);
+    free(range);
+    return worked;
+}
+
+/* COMAL is listed with the indent from each line and the bytes after
+ * FUNC left out. */
+
+static bool check_comal_list(void)
+{
+    static const char expect[] = "   10   FUNC\"A\"//\n";
+    size_t len = 0;
+    char *text = list_text(comal, sizeof(comal), BBCUTIL_COMAL, false, &len);
+    bool worked = text && len == sizeof(expect) - 1 && !memcmp(text, expect, len);
+    if (!worked)
+        printf("COMAL listing mismatch\nExpected: %sGot:      %s\n", expect, text ? text : "");
+    free(text);
+    return worked;
+}
+
+/* The markup characters and the top-bit characters are escaped, those
+ * from 0x80 to 0x9F, which HTML does not allow as references, as spaces. */
+
+static bool check_html(void)
+{
+    static const unsigned char text[] = "0123456789abcdef<&>\x81\x9f\xa0\xe9z";
+    static const char expect[] = "0123456789abcdef&lt;&amp;&gt;  &#160;&#233;z ";
+    char *out = NULL;
+    size_t len = 0;
+    FILE *ofp = open_memstream(&out, &len);
+    if (!ofp)
+        return false;
+    bbcutil_html_write(text, sizeof(text) - 1, ofp);
+    bbcutil_html_putc(0x80, ofp);
+    fclose(ofp);
+    bool worked = len == sizeof(expect) - 1 && !memcmp(out, expect, len);
+    if (!worked)
+        printf("HTML escape mismatch\nExpected: %s\nGot:      %s\n\n", expect, out);
+    free(out);
+    return worked;
+}
+
+/* 10 PROCabpwu:PROCa05fa
+ * 20 DEFPROCabpwu
+ * 30 DEFPROCa05fa
+ * 40 DEFPROCabpwu
+ * where the two names hash alike with the PROC token */
+
+static const unsigned char procs[] = {
+    0x0d, 0x00, 0x0a, 0x11, 0xf2, 'a', 'b', 'p', 'w', 'u', ':', 0xf2, 'a', '0', '5', 'f', 'a',
+    0x0d, 0x00, 0x14, 0x0b, 0xdd, 0xf2, 'a', 'b', 'p', 'w', 'u',
+    0x0d, 0x00, 0x1e, 0x0b, 0xdd, 0xf2, 'a', '0', '5', 'f', 'a',
+    0x0d, 0x00, 0x28, 0x0b, 0xdd, 0xf2, 'a', 'b', 'p', 'w', 'u',
+    0x0d, 0xff
+};
+
+static unsigned count_text(const char *text, const char *find)
+{
+    unsigned count = 0;
+    for (const char *ptr = text; (ptr = strstr(ptr, find)); ptr++)
+        count++;
+    return count;
+}
+
+/* Both calls link to their definitions despite the hashes colliding
+ * and the name defined twice has one id. */
+
+static bool check_resolve(void)
+{
+    bbcutil_listing *lst = bbcutil_listing_new();
+    bbcutil_renderer *rend = NULL;
+    char *text = NULL;
+    size_t len;
+    FILE *ofp;
+    if (lst && bbcutil_renderer_new("html", 4, &rend) == BBCUTIL_OK && (ofp = open_memstream(&text, &len))) {
+        bbcutil_listing_clear(lst, procs);
+        if (bbcutil_listing_decode(lst, procs, procs + sizeof(procs) - 2, BBCUTIL_WILSON, NULL, true) == BBCUTIL_OK
+            && bbcutil_listing_resolve(lst) == BBCUTIL_OK)
+            bbcutil_render(rend, lst, ofp);
+        fclose(ofp);
+    }
+    bbcutil_renderer_free(rend);
+    bbcutil_listing_free(lst);
+    bool worked = text && count_text(text, "href=\"#PROCabpwu\"") == 1 && count_text(text, "href=\"#PROCa05fa\"") == 1
+        && count_text(text, "id=\"PROCabpwu\"") == 1 && count_text(text, "id=\"PROCa05fa\"") == 1
+        && count_text(text, "defname") == 3 && !count_text(text, "dangling");
+    if (!worked)
+        printf("PROC resolution mismatch\nGot: %s\n\n", text ? text : "");
+    free(text);
+    return worked;
+}
+
+/* Write an archive with a short name, a long name the ustar prefix can
+ * hold and one only a pax header can, then read it back, both as written
+ * and with the pax record damaged. */
+
+static bool check_tar(void)
+{
+    char split[200], pax[160];
+    memset(split, 'd', 120);
+    split[120] = '/';
+    memset(split + 121, 'f', 60);
+    split[181] = 0;
+    memset(pax, 'p', 150);
+    pax[150] = 0;
+    const struct {
+        const char *name;
+        const char *data;
+        long mtime;
+    } members[] = {
+        { "short", "10 PRINT\n", 1000000000 },
+        { split, "", 1234567890 },
+        { pax, "20 END\n", 0 }
+    };
+    char *archive;
+    size_t size;
+    FILE *fp = open_memstream(&archive, &size);
+    if (!fp) {
+        fputs("bbcutil_test: out of memory\n", stderr);
+        return false;
+    }
+    bbcutil_res res = BBCUTIL_OK;
+    for (int i = 0; i < 3 && res == BBCUTIL_OK; i++)
+        res = bbcutil_tar_write(fp, members[i].name, members[i].data, strlen(members[i].data), members[i].mtime);
+    if (res == BBCUTIL_OK)
+        res = bbcutil_tar_end(fp);
+    fclose(fp);
+    bool worked = res == BBCUTIL_OK && size % 512 == 0;
+    if (!worked)
+        printf("Tar write failed: %s (%zu bytes)\n\n", bbcutil_rmsg(res), size);
+    /* the second pass declares the pax path record shorter than its
+     * own length prefix, which must be ignored for the header name */
+    for (int pass = 0; worked && pass < 2; pass++) {
+        if (pass) {
+            char *rec = memmem(archive, size, " path=", 6);
+            if (!rec) {
+                printf("Tar pax path record missing\n\n");
+                worked = false;
+                break;
+            }
+            while (rec[-1] >= '0' && rec[-1] <= '9')
+                *--rec = ' ';
+            *rec = '1';
+            pax[100] = 0;
+        }
+        if (!(fp = fmemopen(archive, size, "r"))) {
+            fputs("bbcutil_test: out of memory\n", stderr);
+            worked = false;
+            break;
+        }
+        bbcutil_member mem = { 0 };
+        for (int i = 0; i < 3; i++) {
+            size_t len = strlen(members[i].data);
+            if ((res = bbcutil_tar_read(fp, &mem)) != BBCUTIL_OK || strcmp(mem.name, members[i].name)
+                || mem.size != len || memcmp(mem.data, members[i].data, len) || mem.mtime != members[i].mtime) {
+                printf("Tar member %d mismatch\nExpected: %s %zu %ld\nGot:      %s %zu %ld (%s)\n\n", i,
+                       members[i].name, len, members[i].mtime, res == BBCUTIL_OK ? mem.name : "-",
+                       mem.size, mem.mtime, bbcutil_rmsg(res));
+                worked = false;
+                break;
+            }
+        }
+        if (worked && (res = bbcutil_tar_read(fp, &mem)) != BBCUTIL_EOF) {
+            printf("Tar end mismatch\nExpected: %s\nGot:      %s\n\n", bbcutil_rmsg(BBCUTIL_EOF), bbcutil_rmsg(res));
+            worked = false;
+        }
+        bbcutil_tar_free(&mem);
+        fclose(fp);
+    }
+    free(archive);
+    return worked;
+}
+
+/* Load more files than the batch keeps in flight, one of them missing,
+ * and check each comes back in the order named. */
+
+static bool check_batch(void)
+{
+    enum { NFILES = 40 };
+    char dir[] = "/tmp/bbcutil_testXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("bbcutil_test: mkdtemp");
+        return false;
+    }
+    char *names[NFILES];
+    char text[NFILES][32];
+    bool worked = true;
+    for (int i = 0; i < NFILES; i++) {
+        names[i] = malloc(sizeof(dir) + 16);
+        sprintf(names[i], "%s/%d", dir, i);
+        snprintf(text[i], sizeof(text[i]), "file %d %.*s\n", i, i % 20, "....................");
+        FILE *fp;
+        if (i != NFILES / 2 && (fp = fopen(names[i], "w"))) {
+            fputs(text[i], fp);
+            fclose(fp);
+        }
+    }
+    bbcutil_batch *batch = bbcutil_batch_open("bbcutil_test", names, NFILES, 4);
+    for (int i = 0; batch && i < NFILES; i++) {
+        const char *fn;
+        unsigned char *end;
+        unsigned char *data = bbcutil_batch_next(batch, &fn, &end);
+        bool missing = i == NFILES / 2;
+        size_t len = strlen(text[i]);
+        if (fn != names[i] || missing != !data || (data && ((size_t)(end - data) != len || memcmp(data, text[i], len)))) {
+            printf("Batch order mismatch at %d\nExpected: %s\nGot:      %s\n\n", i, names[i], fn ? fn : "-");
+            worked = false;
+        }
+        free(data);
+    }
+    if (!batch) {
+        fputs("bbcutil_test: out of memory\n", stderr);
+        worked = false;
+    }
+    else
+        bbcutil_batch_close(batch);
+    for (int i = 0; i < NFILES; i++) {
+        unlink(names[i]);
+        free(names[i]);
+    }
+    rmdir(dir);
+    return worked;
+}
+
+/* Sniff each test program and every truncation of it placed hard
+ * against an unreadable page, so any read past the end of the buffer
+ * faults.  Only the whole program may be taken for its kind. */
+
+static bool check_sniff(const char *name, const unsigned char *prog, size_t size, bbcutil_kind kind)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned char *map = mmap(NULL, 2 * page, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED || mprotect(map + page, page, PROT_NONE)) {
+        perror("bbcutil_test: mmap");
+        return false;
+    }
+    bool worked = true;
+    for (size_t len = 0; len <= size; len++) {
+        unsigned char *data = map + page - len;
+        memcpy(data, prog, len);
+        bbcutil_fmt fmt;
+        bbcutil_kind got = bbcutil_sniff(data, len, &fmt);
+        if (len == size ? got != kind || fmt.prog_len > size : got == kind) {
+            printf("Sniff mismatch for %s truncated to %zu bytes\nExpected: %s%s\nGot:      %s\n\n", name, len,
+                   len == size ? "" : "not ", bbcutil_kind_name(kind), bbcutil_kind_name(got));
+            worked = false;
+        }
+    }
+    munmap(map, 2 * page);
+    return worked;
+}
+
+/* Walk a large program built from copies of the Wilson test lines and
+ * report the throughput.  The token spans are summed so the walk cannot
+ * be optimised away. */
+
+static bool check_speed(void)
+{
+    size_t body = sizeof(wilson) - 2;
+    size_t copies = (64 << 20) / body;
+    size_t size = copies * body + 2;
+    unsigned char *prog = malloc(size);
+    if (!prog) {
+        fputs("bbcutil_test: out of memory\n", stderr);
+        return false;
+    }
+    for (size_t i = 0; i < copies; i++)
+        memcpy(prog + i * body, wilson, body);
+    prog[size-2] = 0x0d;
+    prog[size-1] = 0xff;
+
+    struct timespec t0, t1, t2;
+    bbcutil_lines lines;
+    bbcutil_line line;
+    bbcutil_toks toks;
+    bbcutil_tok tok;
+    size_t bytes = 0, nlines = 0, ntoks = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bbcutil_lines_init(&lines, prog, prog + size, BBCUTIL_WILSON);
+    while (bbcutil_lines_next(&lines, &line))
+        nlines++;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bbcutil_lines_init(&lines, prog, prog + size, BBCUTIL_WILSON);
+    while (bbcutil_lines_next(&lines, &line)) {
+        bbcutil_toks_init(&toks, &line, BBCUTIL_WILSON);
+        while (bbcutil_toks_next(&toks, &tok)) {
+            bytes += tok.end - tok.ptr;
+            ntoks++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    free(prog);
+
+    double lsecs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double tsecs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+    printf("line walk:  %zu bytes, %zu lines in %.3fs, %.0f MB/s\n", size, nlines, lsecs, size / lsecs / 1e6);
+    printf("token walk: %zu bytes, %zu tokens in %.3fs, %.0f MB/s\n", size, ntoks, tsecs, size / tsecs / 1e6);
+    if (nlines != copies * 3) {
+        printf("Line count mismatch in walk\nExpected: %zu\nGot:      %zu\n\n", copies * 3, nlines);
+        return false;
+    }
+    if (ntoks != copies * 9) {
+        printf("Token count mismatch in walk\nExpected: %zu\nGot:      %zu (%zu bytes)\n\n", copies * 9, ntoks, bytes);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int status = 0;
+    if (!check_prog("wilson", wilson, sizeof(wilson), BBCUTIL_WILSON, basic_expect, 9, 3))
+        status++;
+    if (!check_prog("russell", russell, sizeof(russell), BBCUTIL_RUSSELL, basic_expect, 9, 3))
+        status++;
+    if (!check_prog("comal", comal, sizeof(comal), BBCUTIL_COMAL, comal_expect, 3, 1))
+        status++;
+    if (!check_lineno())
+        status++;
+    if (!check_map())
+        status++;
+    if (!check_renumber("wilson", wilson, sizeof(wilson), BBCUTIL_WILSON))
+        status++;
+    if (!check_renumber("russell", russell, sizeof(russell), BBCUTIL_RUSSELL))
+        status++;
+    if (!check_comal_renumber())
+        status++;
+    if (!check_targets())
+        status++;
+    if (!check_idents())
+        status++;
+    if (!check_range())
+        status++;
+    if (!check_index())
+        status++;
+    if (!check_comal_list())
+        status++;
+    if (!check_html())
+        status++;
+    if (!check_resolve())
+        status++;
+    if (!check_tar())
+        status++;
+    if (!check_batch())
+        status++;
+    if (!check_sniff("wilson", wilson, sizeof(wilson), BBCUTIL_WILSON))
+        status++;
+    if (!check_sniff("russell", russell, sizeof(russell), BBCUTIL_RUSSELL))
+        status++;
+    if (!check_sniff("comal", comal, sizeof(comal), BBCUTIL_COMAL))
+        status++;
+    if (!check_speed())
+        status++;
+    return status;
+}
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* A template is compiled into runs of literal text, with any escaped
+ * characters already in place, and the substitutions between them, so
+ * writing one is a write per segment with no scanning. */
+
+#define SEG_TEXT 0
+
+struct segment {
+    int type;
+    size_t off;
+    size_t len;
+};
+
+struct bbcutil_template {
+    char *text;
+    struct segment *segs;
+    unsigned nsegs;
+    unsigned uses;
+};
+
+static const char substs[] = "fplsdt";
+
+static inline unsigned subst_bit(int ch)
+{
+    const char *ptr = ch ? strchr(substs, ch) : NULL;
+    return ptr ? 1u << (ptr - substs) : 0;
+}
+
+bbcutil_template *bbcutil_template_compile(const unsigned char *data, size_t size)
+{
+    bbcutil_template *tmpl = calloc(1, sizeof(bbcutil_template));
+    if (!tmpl)
+        return NULL;
+    tmpl->text = malloc(size + 1);
+    tmpl->segs = malloc((size + 1) * sizeof(struct segment));
+    if (!tmpl->text || !tmpl->segs) {
+        bbcutil_template_free(tmpl);
+        return NULL;
+    }
+    const unsigned char *end = data + size;
+    size_t len = 0;
+    size_t start = 0;
+    while (data < end) {
+        int ch = *data++;
+        if (ch == '%' && data < end) {
+            ch = *data++;
+            unsigned bit = subst_bit(ch);
+            if (bit) {
+                if (len > start)
+                    tmpl->segs[tmpl->nsegs++] = (struct segment){ SEG_TEXT, start, len - start };
+                tmpl->segs[tmpl->nsegs++] = (struct segment){ ch, 0, 0 };
+                tmpl->uses |= bit;
+                start = len;
+                continue;
+            }
+        }
+        tmpl->text[len++] = ch;
+    }
+    if (len > start)
+        tmpl->segs[tmpl->nsegs++] = (struct segment){ SEG_TEXT, start, len - start };
+    return tmpl;
+}
+
+bool bbcutil_template_uses(const bbcutil_template *tmpl, int subst)
+{
+    return tmpl->uses & subst_bit(subst);
+}
+
+static void put_time(int64_t mtime, FILE *ofp)
+{
+    char buf[32];
+    struct tm tm;
+    time_t secs = mtime < 0 ? time(NULL) : (time_t)mtime;
+    if (gmtime_r(&secs, &tm) && strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm))
+        fputs_unlocked(buf, ofp);
+}
+
+void bbcutil_template_write(const bbcutil_template *tmpl, const bbcutil_tmpl_vars *vars, FILE *ofp)
+{
+    flockfile(ofp);
+    for (const struct segment *seg = tmpl->segs; seg < tmpl->segs + tmpl->nsegs; seg++) {
+        switch(seg->type) {
+            case SEG_TEXT:
+                fwrite_unlocked(tmpl->text + seg->off, seg->len, 1, ofp);
+                break;
+            case 'f':
+                if (vars->html)
+                    bbcutil_html_write((const unsigned char *)vars->name, strlen(vars->name), ofp);
+                else
+                    fputs_unlocked(vars->name, ofp);
+                break;
+            case 'p':
+                vars->program(vars->ctx, ofp);
+                break;
+            case 'l':
+                fprintf(ofp, "%u", vars->lines);
+                break;
+            case 's':
+                fprintf(ofp, "%zu", vars->size);
+                break;
+            case 'd':
+                fputs_unlocked(bbcutil_kind_name(vars->kind), ofp);
+                break;
+            case 't':
+                put_time(vars->mtime, ofp);
+                break;
+        }
+    }
+    funlockfile(ofp);
+}
+
+void bbcutil_template_free(bbcutil_template *tmpl)
+{
+    if (tmpl) {
+        free(tmpl->segs);
+        free(tmpl->text);
+        free(tmpl);
+    }
+}
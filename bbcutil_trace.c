@@ -0,0 +1,182 @@
+#include "bbcutil.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Each thread records its spans into a ring of its own, allocated when
+ * it records the first, so recording takes no lock.  A ring is added to
+ * the list of rings with a compare and swap and is only read when the
+ * trace is written, after the threads are done, when the spans of all
+ * the rings are merged in order of time.  A ring starts small and grows
+ * as it fills, up to RING_MAX spans or as far as memory allows, and
+ * then keeps the latest spans. */
+
+#define RING_MIN  256
+#define RING_MAX  (1u << 20)
+#define FILE_LEN  47
+
+struct span {
+    uint64_t start;
+    uint64_t end;
+    uint8_t phase;
+    char file[FILE_LEN];
+};
+
+struct ring {
+    struct ring *next;
+    unsigned tid;
+    unsigned size;
+    bool full;
+    uint64_t count;
+    struct span *spans;
+};
+
+static const char *phase_names[BBCUTIL_PHASES] = { "load", "sniff", "decode", "render", "write" };
+
+static char *trace_fn;
+static uint64_t trace_start;
+static _Atomic unsigned next_tid;
+static struct ring *_Atomic rings;
+static _Thread_local struct ring *ring;
+static _Thread_local bool ring_failed;
+
+bool bbcutil_trace_open(const char *fn)
+{
+    if (!(trace_fn = strdup(fn)))
+        return false;
+    trace_start = bbcutil_clock();
+    return true;
+}
+
+bool bbcutil_tracing(void)
+{
+    return trace_fn != NULL;
+}
+
+static struct ring *ring_new(void)
+{
+    struct ring *r = malloc(sizeof(struct ring));
+    if (!r || !(r->spans = malloc(RING_MIN * sizeof(struct span)))) {
+        free(r);
+        ring_failed = true;
+        return NULL;
+    }
+    r->tid = ++next_tid;
+    r->size = RING_MIN;
+    r->full = false;
+    r->count = 0;
+    r->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+        ;
+    return r;
+}
+
+/* the end of a long file name is kept as it says the most. */
+
+void bbcutil_trace_span(bbcutil_phase phase, const char *file, uint64_t start, uint64_t end)
+{
+    struct ring *r = ring;
+    if (!r && (ring_failed || !(r = ring = ring_new())))
+        return;
+    if (r->count == r->size && !r->full) {
+        struct span *spans = r->size < RING_MAX ? realloc(r->spans, 2 * r->size * sizeof(struct span)) : NULL;
+        if (spans) {
+            r->spans = spans;
+            r->size *= 2;
+        }
+        else
+            r->full = true;
+    }
+    struct span *sp = r->spans + (r->count++ & (r->size - 1));
+    sp->start = start;
+    sp->end = end;
+    sp->phase = phase;
+    size_t len = file ? strlen(file) : 0;
+    if (len >= FILE_LEN) {
+        file += len - FILE_LEN + 1;
+        len = FILE_LEN - 1;
+    }
+    memcpy(sp->file, file ? file : "", len);
+    sp->file[len] = 0;
+}
+
+static void put_span(const struct span *sp, unsigned tid, FILE *fp)
+{
+    fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"file\":\"",
+            phase_names[sp->phase], (sp->start - trace_start) / 1e3, (sp->end - sp->start) / 1e3, tid);
+    bbcutil_json_write((const unsigned char *)sp->file, strlen(sp->file), fp);
+    fputs("\"}}", fp);
+}
+
+/* the rings are merged by taking the earliest of the next span of each
+ * in turn; there are only as many rings as threads. */
+
+static void write_trace(const char *prog, FILE *fp)
+{
+    fprintf(fp, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"%s\"}}", prog);
+    unsigned nrings = 0;
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                r->tid, r->tid);
+        nrings++;
+    }
+    uint64_t *next = calloc(nrings ? nrings : 1, sizeof(uint64_t));
+    struct ring **all = calloc(nrings ? nrings : 1, sizeof(struct ring *));
+    if (next && all) {
+        unsigned ix = 0;
+        for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+            all[ix] = r;
+            next[ix++] = r->count > r->size ? r->count - r->size : 0;
+        }
+        for (;;) {
+            const struct span *first = NULL;
+            unsigned which = 0;
+            for (ix = 0; ix < nrings; ix++) {
+                if (next[ix] < all[ix]->count) {
+                    const struct span *sp = all[ix]->spans + (next[ix] & (all[ix]->size - 1));
+                    if (!first || sp->start < first->start) {
+                        first = sp;
+                        which = ix;
+                    }
+                }
+            }
+            if (!first)
+                break;
+            put_span(first, all[which]->tid, fp);
+            next[which]++;
+        }
+    }
+    else
+        fprintf(stderr, "%s: out of memory writing trace\n", prog);
+    free(next);
+    free(all);
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+}
+
+bool bbcutil_trace_close(const char *prog)
+{
+    if (!trace_fn)
+        return true;
+    bool worked = false;
+    FILE *fp = fopen(trace_fn, "w");
+    if (!fp)
+        fprintf(stderr, "%s: unable to open '%s' for writing: %s\n", prog, trace_fn, strerror(errno));
+    else {
+        write_trace(prog, fp);
+        if (fclose(fp))
+            fprintf(stderr, "%s: write error on '%s': %s\n", prog, trace_fn, strerror(errno));
+        else
+            worked = true;
+    }
+    for (struct ring *r = atomic_exchange(&rings, NULL); r; ) {
+        struct ring *after = r->next;
+        free(r->spans);
+        free(r);
+        r = after;
+    }
+    ring = NULL;
+    free(trace_fn);
+    trace_fn = NULL;
+    return worked;
+}
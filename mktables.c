@@ -0,0 +1,262 @@
+#include "bbcutil.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Generates the keyword tables of each dialect described in the input,
+ * dialects.txt, as C source for the library.  Run at build time. */
+
+#define MAX_DIALECTS 4
+#define MAX_MATCH    256
+
+struct entry {
+    char text[14];
+    unsigned len;
+    unsigned token;
+    unsigned flags;
+};
+
+struct dialect {
+    char name[16];
+    bool longest;
+    bbcutil_keyword keywords[256];
+    bool present[256];
+    struct entry match[MAX_MATCH];
+    unsigned nmatch;
+};
+
+struct flag {
+    const char *name;
+    unsigned list;
+    unsigned match;
+};
+
+static const struct flag flags[] = {
+    { "before",  BBCUTIL_KW_SPC_BEFORE, 0                  },
+    { "after",   BBCUTIL_KW_SPC_AFTER,  0                  },
+    { "indent",  BBCUTIL_KW_INC_INDENT, 0                  },
+    { "outdent", BBCUTIL_KW_DEC_INDENT, 0                  },
+    { "tail",    BBCUTIL_KW_SKIP_EOL,   0                  },
+    { "two",     BBCUTIL_KW_SKIP_TWO,   0                  },
+    { "lineref", BBCUTIL_KW_LINEREF,    0                  },
+    { "cond",    0,                     BBCUTIL_MT_COND    },
+    { "mid",     0,                     BBCUTIL_MT_MID     },
+    { "start",   0,                     BBCUTIL_MT_START   },
+    { "fnproc",  0,                     BBCUTIL_MT_FNPROC  },
+    { "lineno",  0,                     BBCUTIL_MT_LINENO  },
+    { "rem",     0,                     BBCUTIL_MT_REM     },
+    { "pseudo",  0,                     BBCUTIL_MT_PSEUDO  },
+    { "nomatch", 0,                     0                  }
+};
+
+static const char *class_names[] = {
+    "BBCUTIL_CL_PLAIN",
+    "BBCUTIL_CL_KEYWORD",
+    "BBCUTIL_CL_LINENO",
+    "BBCUTIL_CL_QUOTE",
+    "BBCUTIL_CL_TAIL",
+    "BBCUTIL_CL_SKIPTWO"
+};
+
+static struct dialect dialects[MAX_DIALECTS];
+static unsigned ndialects;
+
+static bool parse_line(char *line, const char *fn, unsigned lineno)
+{
+    char *ptr = line + strspn(line, " \t");
+    if (!*ptr || *ptr == '#' || *ptr == '\n')
+        return true;
+    if (!strncmp(ptr, "dialect ", 8)) {
+        char name[16], opt[16];
+        int count = sscanf(ptr + 8, "%15s %15s", name, opt);
+        if (count < 1 || ndialects == MAX_DIALECTS || (count == 2 && strcmp(opt, "longest"))) {
+            fprintf(stderr, "mktables: %s:%u: invalid dialect\n", fn, lineno);
+            return false;
+        }
+        struct dialect *d = dialects + ndialects++;
+        strcpy(d->name, name);
+        d->longest = count == 2;
+        return true;
+    }
+    if (!ndialects) {
+        fprintf(stderr, "mktables: %s:%u: keyword before any dialect\n", fn, lineno);
+        return false;
+    }
+    struct dialect *d = dialects + ndialects - 1;
+    char *end;
+    unsigned long token = strtoul(ptr, &end, 16);
+    char *text = end + strspn(end, " \t");
+    char *close = *text == '"' ? strchr(text + 1, '"') : NULL;
+    if (end == ptr || token > 0xff || !close || close - text - 1 >= sizeof(d->keywords[0].text)) {
+        fprintf(stderr, "mktables: %s:%u: invalid keyword\n", fn, lineno);
+        return false;
+    }
+    if (d->present[token]) {
+        fprintf(stderr, "mktables: %s:%u: token %02lX given twice\n", fn, lineno, token);
+        return false;
+    }
+    unsigned list_flags = 0, match_flags = 0;
+    bool nomatch = close == text + 1;
+    for (char *word = strtok(close + 1, " \t\n"); word; word = strtok(NULL, " \t\n")) {
+        unsigned ix = 0;
+        while (ix < sizeof(flags)/sizeof(flags[0]) && strcmp(flags[ix].name, word))
+            ix++;
+        if (ix == sizeof(flags)/sizeof(flags[0])) {
+            fprintf(stderr, "mktables: %s:%u: unknown flag '%s'\n", fn, lineno, word);
+            return false;
+        }
+        list_flags |= flags[ix].list;
+        match_flags |= flags[ix].match;
+        if (!strcmp(word, "nomatch"))
+            nomatch = true;
+    }
+    *close = 0;
+    d->present[token] = true;
+    strcpy(d->keywords[token].text, text + 1);
+    d->keywords[token].flags = list_flags;
+    if (match_flags & BBCUTIL_MT_PSEUDO) {
+        if (token + 0x40 > 0xff || d->present[token + 0x40]) {
+            fprintf(stderr, "mktables: %s:%u: no room for the statement token\n", fn, lineno);
+            return false;
+        }
+        d->present[token + 0x40] = true;
+        d->keywords[token + 0x40] = d->keywords[token];
+    }
+    if (!nomatch) {
+        if (d->nmatch == MAX_MATCH) {
+            fprintf(stderr, "mktables: %s:%u: too many keywords\n", fn, lineno);
+            return false;
+        }
+        struct entry *e = d->match + d->nmatch++;
+        strcpy(e->text, text + 1);
+        e->len = strlen(e->text);
+        e->token = token;
+        e->flags = match_flags;
+    }
+    return true;
+}
+
+/* keywords are kept in the order given within each first character,
+ * other than longest first if the dialect asks, so a stable sort. */
+
+static bool match_before(const struct dialect *d, const struct entry *a, const struct entry *b)
+{
+    if ((unsigned char)a->text[0] != (unsigned char)b->text[0])
+        return (unsigned char)a->text[0] < (unsigned char)b->text[0];
+    return d->longest && a->len > b->len;
+}
+
+static void sort_match(struct dialect *d)
+{
+    for (unsigned i = 1; i < d->nmatch; i++) {
+        struct entry e = d->match[i];
+        unsigned j = i;
+        while (j > 0 && match_before(d, &e, d->match + j - 1)) {
+            d->match[j] = d->match[j - 1];
+            j--;
+        }
+        d->match[j] = e;
+    }
+}
+
+static unsigned byte_class(const struct dialect *d, unsigned byte)
+{
+    unsigned flags = d->keywords[byte].flags;
+    if (byte == '"')
+        return BBCUTIL_CL_QUOTE;
+    if (!d->present[byte] && byte < 0x80)
+        return BBCUTIL_CL_PLAIN;
+    if (flags & BBCUTIL_KW_LINEREF)
+        return BBCUTIL_CL_LINENO;
+    if (flags & BBCUTIL_KW_SKIP_EOL)
+        return BBCUTIL_CL_TAIL;
+    if (flags & BBCUTIL_KW_SKIP_TWO)
+        return BBCUTIL_CL_SKIPTWO;
+    return BBCUTIL_CL_KEYWORD;
+}
+
+static void put_string(const char *text, FILE *ofp)
+{
+    putc('"', ofp);
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\')
+            putc('\\', ofp);
+        putc(*text, ofp);
+    }
+    putc('"', ofp);
+}
+
+static void write_dialect(const struct dialect *d, FILE *ofp)
+{
+    fprintf(ofp, "\nstatic const bbcutil_keyword %s_keywords[256] = {\n", d->name);
+    for (unsigned byte = 0; byte < 256; byte++) {
+        if (d->present[byte]) {
+            fprintf(ofp, "    [0x%02X] = { ", byte);
+            put_string(d->keywords[byte].text, ofp);
+            fprintf(ofp, ", 0x%02x },\n", d->keywords[byte].flags);
+        }
+    }
+    fprintf(ofp, "};\n\nstatic const uint8_t %s_classes[256] = {\n", d->name);
+    for (unsigned byte = 0; byte < 256; byte++) {
+        unsigned class = byte_class(d, byte);
+        if (class != BBCUTIL_CL_PLAIN)
+            fprintf(ofp, "    [0x%02X] = %s,\n", byte, class_names[class]);
+    }
+    fprintf(ofp, "};\n\nstatic const bbcutil_match %s_match[%u] = {\n", d->name, d->nmatch);
+    for (unsigned ix = 0; ix < d->nmatch; ix++) {
+        const struct entry *e = d->match + ix;
+        fputs("    { ", ofp);
+        put_string(e->text, ofp);
+        fprintf(ofp, ", %u, 0x%02X, 0x%02x },\n", e->len, e->token, e->flags);
+    }
+    fprintf(ofp, "};\n\nstatic const uint16_t %s_starts[129] = {", d->name);
+    unsigned ix = 0;
+    for (unsigned ch = 0; ch <= 128; ch++) {
+        while (ix < d->nmatch && (unsigned char)d->match[ix].text[0] < ch)
+            ix++;
+        fprintf(ofp, "%s%u,", ch % 16 ? " " : "\n    ", ix);
+    }
+    fprintf(ofp, "\n};\n\nconst bbcutil_dialect bbcutil_%s_dialect = {\n"
+            "    %s_keywords,\n    %s_classes,\n    %s_match,\n    %s_starts\n};\n",
+            d->name, d->name, d->name, d->name, d->name);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fputs("Usage: mktables <dialects> <c-out>\n", stderr);
+        return 1;
+    }
+    const char *in_fn = argv[1];
+    const char *out_fn = argv[2];
+    FILE *ifp = fopen(in_fn, "r");
+    if (!ifp) {
+        fprintf(stderr, "mktables: unable to open '%s': %s\n", in_fn, strerror(errno));
+        return 2;
+    }
+    char line[256];
+    unsigned lineno = 0;
+    while (fgets(line, sizeof(line), ifp)) {
+        if (!parse_line(line, in_fn, ++lineno)) {
+            fclose(ifp);
+            return 3;
+        }
+    }
+    fclose(ifp);
+    FILE *ofp = fopen(out_fn, "w");
+    if (!ofp) {
+        fprintf(stderr, "mktables: unable to open '%s' for writing: %s\n", out_fn, strerror(errno));
+        return 2;
+    }
+    fprintf(ofp, "/* Generated by mktables from %s, do not edit. */\n\n#include \"bbcutil.h\"\n", in_fn);
+    for (unsigned ix = 0; ix < ndialects; ix++) {
+        sort_match(dialects + ix);
+        write_dialect(dialects + ix, ofp);
+    }
+    if (fclose(ofp)) {
+        fprintf(stderr, "mktables: unable to write '%s': %s\n", out_fn, strerror(errno));
+        remove(out_fn);
+        return 2;
+    }
+    return 0;
+}
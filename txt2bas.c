@@ -1,149 +1,14 @@
+#define _GNU_SOURCE
+#include "bbcutil.h"
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-
-#define TOK_COND   0x01
-#define TOK_MID    0x02
-#define TOK_START  0x04
-#define TOK_FNPROC 0x08
-#define TOK_LINENO 0x10
-#define TOK_REM    0x20
-#define TOK_PSEUDO 0x40
-
-struct token {
-    char    text[9];
-    uint8_t token;
-    uint8_t flags;
-};
-
-static const struct token tokens[] = {
-    { "AND",      0x80, 0                           },
-    { "ABS",      0x94, 0                           },
-    { "ACS",      0x95, 0                           },
-    { "ADVAL",    0x96, 0                           },
-    { "ASC",      0x97, 0                           },
-    { "ASN",      0x98, 0                           },
-    { "ATN",      0x99, 0                           },
-    { "AUTO",     0xc6, TOK_LINENO                  },
-    { "BGET",     0x9a, TOK_COND                    },
-    { "BPUT",     0xd5, TOK_MID|TOK_COND            },
-    { "COLOUR",   0xfb, TOK_MID                     },
-    { "CALL",     0xd6, TOK_MID                     },
-    { "CHAIN",    0xd7, TOK_MID                     },
-    { "CHR$",     0xbd, 0                           },
-    { "CLEAR",    0xd8, TOK_COND                    },
-    { "CLOSE",    0xd9, TOK_MID|TOK_COND            },
-    { "CLG",      0xda, TOK_COND                    },
-    { "CLS",      0xdb, TOK_COND                    },
-    { "COS",      0x9b, 0                           },
-    { "COUNT",    0x9c, TOK_COND                    },
-    { "DATA",     0xdc, TOK_REM                     },
-    { "DEG",      0x9d, 0                           },
-    { "DEF",      0xdd, 0                           },
-    { "DELETE",   0xc7, TOK_LINENO                  },
-    { "DIV",      0x81, 0                           },
-    { "DIM",      0xde, TOK_MID                     },
-    { "DRAW",     0xdf, TOK_MID                     },
-    { "ENDPROC",  0xe1, TOK_COND                    },
-    { "END",      0xe0, TOK_COND                    },
-    { "ENVELOPE", 0xe2, TOK_MID                     },
-    { "ELSE",     0x8b, TOK_LINENO|TOK_START        },
-    { "EVAL",     0xa0, 0                           },
-    { "ERL",      0x9e, TOK_COND                    },
-    { "ERROR",    0x85, TOK_START                   },
-    { "EOF",      0xc5, TOK_COND                    },
-    { "EOR",      0x82, 0                           },
-    { "ERR",      0x9f, TOK_COND                    },
-    { "EXP",      0xa1, 0                           },
-    { "EXT",      0xa2, TOK_COND                    },
-    { "FOR",      0xe3, TOK_MID                     },
-    { "FALSE",    0xa3, TOK_COND                    },
-    { "FN",       0xa4, TOK_FNPROC                  },
-    { "GOTO",     0xe5, TOK_LINENO|TOK_MID          },
-    { "GET$",     0xbe, 0                           },
-    { "GET",      0xa5, 0                           },
-    { "GOSUB",    0xe4, TOK_LINENO|TOK_MID          },
-    { "GCOL",     0xe6, TOK_MID                     },
-    { "HIMEM",    0x93, TOK_PSEUDO|TOK_MID|TOK_COND },
-    { "INPUT",    0xe8, TOK_MID                     },
-    { "IF",       0xe7, TOK_MID                     },
-    { "INKEY$",   0xbf, 0                           },
-    { "INKEY",    0xa6, 0                           },
-    { "INT",      0xa8, 0                           },
-    { "INSTR(",   0xa7, 0                           },
-    { "LIST",     0xc9, TOK_LINENO                  },
-    { "LINE",     0x86, 0                           },
-    { "LOAD",     0xc8, TOK_MID                     },
-    { "LOMEM",    0x92, TOK_PSEUDO|TOK_MID|TOK_COND },
-    { "LOCAL",    0xea, TOK_MID                     },
-    { "LEFT$(",   0xc0, 0                           },
-    { "LEN",      0xa9, 0                           },
-    { "LET",      0xe9, TOK_START                   },
-    { "LOG",      0xab, 0                           },
-    { "LN",       0xaa, 0                           },
-    { "MID$(",    0xc1, 0                           },
-    { "MODE",     0xeb, TOK_MID                     },
-    { "MOD",      0x83, 0                           },
-    { "MOVE",     0xec, TOK_MID                     },
-    { "NEXT",     0xed, TOK_MID                     },
-    { "NEW",      0xca, TOK_COND                    },
-    { "NOT",      0xac, 0                           },
-    { "OLD",      0xcb, TOK_COND                    },
-    { "ON",       0xee, TOK_MID                     },
-    { "OFF",      0x87, 0                           },
-    { "OR",       0x84, 0                           },
-    { "OPENIN",   0x8e, 0                           },
-    { "OPENOUT",  0xae, 0                           },
-    { "OPENUP",   0xad, 0                           },
-    { "OSCLI",    0xff, TOK_MID                     },
-    { "PRINT",    0xf1, TOK_MID                     },
-    { "PAGE",     0x90, TOK_PSEUDO|TOK_MID|TOK_COND },
-    { "PTR",      0x8f, TOK_PSEUDO|TOK_MID|TOK_COND },
-    { "PI",       0xaf, TOK_COND                    },
-    { "PLOT",     0xf0, TOK_MID                     },
-    { "POINT(",   0xb0, 0                           },
-    { "PROC",     0xf2, TOK_FNPROC|TOK_MID          },
-    { "POS",      0xb1, TOK_COND                    },
-    { "RETURN",   0xf8, TOK_COND                    },
-    { "REPEAT",   0xf5, 0                           },
-    { "REPORT",   0xf6, TOK_COND                    },
-    { "READ",     0xf3, TOK_MID                     },
-    { "REM",      0xf4, TOK_REM                     },
-    { "RUN",      0xf9, TOK_COND                    },
-    { "RAD",      0xb2, 0                           },
-    { "RESTORE",  0xf7, TOK_LINENO|TOK_MID          },
-    { "RIGHT$(",  0xc2, 0                           },
-    { "RND",      0xb3, TOK_COND                    },
-    { "RENUMBER", 0xcc, TOK_LINENO                  },
-    { "STEP",     0x88, 0                           },
-    { "SAVE",     0xcd, TOK_MID                     },
-    { "SGN",      0xb4, 0                           },
-    { "SIN",      0xb5, 0                           },
-    { "SQR",      0xb6, 0                           },
-    { "SPC",      0x89, 0                           },
-    { "STR$",     0xc3, 0                           },
-    { "STRING$(", 0xc4, 0                           },
-    { "SOUND",    0xd4, TOK_MID                     },
-    { "STOP",     0xfa, TOK_COND                    },
-    { "TAN",      0xb7, 0                           },
-    { "THEN",     0x8c, TOK_LINENO|TOK_START        },
-    { "TO",       0xb8, 0                           },
-    { "TAB(",     0x8a, 0                           },
-    { "TRACE",    0xfc, TOK_LINENO|TOK_MID          },
-    { "TIME",     0x91, TOK_PSEUDO|TOK_MID|TOK_COND },
-    { "TRUE",     0xb9, TOK_COND                    },
-    { "UNTIL",    0xfd, TOK_MID                     },
-    { "USR",      0xba, 0                           },
-    { "VDU",      0xef, TOK_MID                     },
-    { "VAL",      0xbb, 0                           },
-    { "VPOS",     0xbc, TOK_COND                    },
-    { "WIDTH",    0xfe, TOK_MID                     }
-};
+#include <sys/stat.h>
 
 static unsigned char endmark[2] = { 0x0d, 0xff };
-static unsigned lineno = 0;
 
 static inline bool is_space(int ch)
 {
@@ -180,210 +45,467 @@ static inline bool is_alnum(int ch)
     return is_digit(ch) || is_alpha(ch);
 }
 
-static int txt2bas(const char *fn, FILE *in_fp, FILE *out_fp)
+/* With --stats the statistics of the run, otherwise NULL. */
+
+static bbcutil_stats *stats;
+static int stats_mode;
+static uint64_t tokens_emitted;
+
+static inline uint64_t stats_mark(void)
+{
+    return stats ? bbcutil_clock() : 0;
+}
+
+static inline uint64_t stats_lap(bbcutil_phase phase, uint64_t mark)
+{
+    return stats ? bbcutil_stats_lap(stats, phase, mark) : 0;
+}
+
+/* Tokenise the text of one line, after any line number, into a record
+ * in basline, returning its length.  This depends only on the text and
+ * the line number so a record can be re-used while neither changes. */
+
+static size_t tokenise(const char *txtptr, unsigned lineno, char *basline)
 {
-    char txtline[256], basline[256];
+    char *basptr = basline + 4;
+    int ch = *txtptr++;
     basline[0] = 0x0d;
-    while (fgets(txtline, sizeof(txtline), in_fp)) {
-        const char *txtptr = txtline;
-        char *basptr = basline + 4;
-        int ch = *txtptr++;
-        while (is_space(ch))
+    basline[1] = (lineno >> 8);
+    basline[2] = lineno;
+    bool start = true;
+    bool toklno = false;
+    while (ch && ch != '\n') {
+        if (is_space(ch))
             ch = *txtptr++;
-        if (is_digit(ch)) {
-            unsigned value = 0;
+        else if (ch == '&') {
             do {
-                lineno = lineno * 10 + ch - '0';
+                *basptr++ = ch;
                 ch = *txtptr++;
-            } while (is_digit(ch));
-            lineno = value;
+            } while (is_xdigit(ch));
         }
-        else
-            ++lineno;
-        basline[1] = (lineno >> 8);
-        basline[2] = lineno;
-        bool start = true;
-        bool toklno = false;
-        while (ch && ch != '\n') {
-            if (is_space(ch))
+        else if (ch == '"') {
+            do {
+                *basptr++ = ch;
                 ch = *txtptr++;
-            else if (ch == '&') {
+            } while (ch && ch != '"');
+            *basptr++ = ch;
+            ch = *txtptr++;
+            BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_STRING);
+        }
+        else if (ch == ':') {
+            *basptr++ = ch;
+            ch = *txtptr++;
+            start = true;
+            toklno = true;
+        }
+        else if (ch == ',') {
+            *basptr++ = ch;
+            ch = *txtptr++;
+        }
+        else if (ch == '*') {
+            if (start) {
                 do {
                     *basptr++ = ch;
                     ch = *txtptr++;
-                } while (is_xdigit(ch));
+                } while (ch && ch != '\r' && ch != '\n');
+            }
+            else {
+                *basptr++ = ch;
+                ch = *txtptr++;
+            }
+        }
+        else if (is_digit(ch)) {
+            if (toklno) {
+                unsigned target = 0;
+                do {
+                    target = target * 10 + ch - '0';
+                    ch = *txtptr++;
+                } while (is_digit(ch));
+                *basptr++ = 0x8d;
+                bbcutil_lineno_encode((unsigned char *)basptr, target);
+                basptr += 3;
+                toklno = false;
+                start = false;
+                tokens_emitted++;
+                BBCUTIL_COUNT_TOKEN(BBCUTIL_TC_LINEREF);
             }
-            else if (ch == '"') {
+            else {
                 do {
                     *basptr++ = ch;
                     ch = *txtptr++;
-                } while (ch && ch != '"');
-                *basptr++ = ch;
-                ch = *txtptr++;
+                } while (is_digit(ch) || ch == '.' || ch == 'E' || ch == 'e');
             }
-            else if (ch == ':') {
+        }
+        else if (ch == '.') {
+            do {
                 *basptr++ = ch;
                 ch = *txtptr++;
-                start = true;
-                toklno = true;
-            }
-            else if (ch == ',') {
+            } while (is_digit(ch) || ch == 'E' || ch == 'e');
+        }
+        else if (is_lower(ch) || (ch >= 'X' && ch <= 'Z')) {
+            do {
                 *basptr++ = ch;
                 ch = *txtptr++;
-            }
-            else if (ch == '*') {
-                if (start) {
-                    do {
-                        *basptr++ = ch;
-                        ch = *txtptr++;
-                    } while (ch && ch != '\r' && ch != '\n');
+            } while (is_upper(ch) || is_lower(ch) || ch == '%' || ch == '$');
+        }
+        else if (ch >= 'A' && ch <= 'W') {
+            const bbcutil_dialect *d = &bbcutil_basic_dialect;
+            const bbcutil_match *ptr = d->match + d->starts[ch];
+            const bbcutil_match *end = d->match + d->starts[ch + 1];
+            bool found = false;
+            toklno = false;
+            while (ptr < end) {
+                int tok_ch = ch;
+                int ix = 0;
+                int txt_ch = ch;
+                while (txt_ch == tok_ch) {
+                    txt_ch = txtptr[ix++];
+                    tok_ch = ptr->text[ix];
                 }
-                else {
-                    *basptr++ = ch;
-                    ch = *txtptr++;
+                if (txt_ch == '.') {
+                    txtptr += ix;
+                    found = true;
+                    break;
                 }
+                if (!tok_ch && (!(ptr->flags & BBCUTIL_MT_COND) || !is_alnum(txt_ch))) {
+                    txtptr += ix - 1;
+                    found = true;
+                    break;
+                }
+                ptr++;
             }
-            else if (is_digit(ch)) {
-                if (toklno) {
-                    lineno = 0;
-                    do {
-                        lineno = lineno * 10 + ch - '0';
-                        ch = *txtptr++;
-                    } while (is_digit(ch));
-                    *basptr++ = 0x8d;
-                    *basptr++ = (((lineno & 0xc0) ^ 0x40) >> 2) | (((lineno & 0xc000) ^ 0x4000) >> 12) | 0x40;
-                    *basptr++ = (lineno & 0x3f) | 0x40;
-                    *basptr++ = ((lineno >> 8) & 0x3f) | 0x40;
-                    toklno = false;
+            if (found) {
+                unsigned token = ptr->token;
+                unsigned flags = ptr->flags;
+                if (start && flags & BBCUTIL_MT_PSEUDO)
+                    token += 0x40;
+                *basptr++ = token;
+                tokens_emitted++;
+                BBCUTIL_COUNT_TOKEN(flags & BBCUTIL_MT_REM ? BBCUTIL_TC_TAIL : BBCUTIL_TC_KEYWORD);
+                if (flags & BBCUTIL_MT_MID)
                     start = false;
+                if (flags & BBCUTIL_MT_START)
+                    start = true;
+                ch = *txtptr++;
+                if (flags & BBCUTIL_MT_FNPROC) {
+                    while (is_alpha(ch)) {
+                        *basptr++ = ch;
+                        ch = *txtptr++;
+                    }
                 }
-                else {
+                if (flags & BBCUTIL_MT_LINENO)
+                    toklno = true;
+                if (flags & BBCUTIL_MT_REM) {
                     do {
                         *basptr++ = ch;
                         ch = *txtptr++;
-                    } while (is_digit(ch) || ch == '.' || ch == 'E' || ch == 'e');
+                    } while (ch && ch != '\r' && ch != '\n');
                 }
             }
-            else if (ch == '.') {
-                do {
-                    *basptr++ = ch;
-                    ch = *txtptr++;
-                } while (is_digit(ch) || ch == 'E' || ch == 'e');
-            }
-            else if (is_lower(ch) || (ch >= 'X' && ch <= 'Z')) {
+            else {
                 do {
                     *basptr++ = ch;
                     ch = *txtptr++;
                 } while (is_upper(ch) || is_lower(ch) || ch == '%' || ch == '$');
             }
-            else if (ch >= 'A' && ch <= 'W') {
-                const struct token *ptr = tokens;
-                const struct token *end = tokens + sizeof(tokens)/sizeof(struct token);
-                bool found = false;
-                toklno = false;
-                while (ptr < end) {
-                    int tok_ch = ptr->text[0];
-                    if (ch < tok_ch)
-                        break;
-                    int ix = 0;
-                    int txt_ch = ch;
-                    while (txt_ch == tok_ch) {
-                        txt_ch = txtptr[ix++];
-                        tok_ch = ptr->text[ix];
-                    }
-                    if (txt_ch == '.') {
-                        txtptr += ix;
-                        found = true;
-                        break;
-                    }
-                    if (!tok_ch && (!(ptr->flags & TOK_COND) || !is_alnum(txt_ch))) {
-                        txtptr += ix - 1;
-                        found = true;
-                        break;
-                    }
-                    ptr++;
-                }
-                if (found) {
-                    unsigned token = ptr->token;
-                    unsigned flags = ptr->flags;
-                    if (start && flags & TOK_PSEUDO)
-                        token += 0x40;
-                    *basptr++ = token;
-                    if (flags & TOK_MID)
-                        start = false;
-                    if (flags & TOK_START)
-                        start = true;
-                    ch = *txtptr++;
-                    if (flags & TOK_FNPROC) {
-                        while (is_alpha(ch)) {
-                            *basptr++ = ch;
-                            ch = *txtptr++;
-                        }
-                    }
-                    if (flags & TOK_LINENO)
-                        toklno = true;
-                    if (flags & TOK_REM) {
-                        do {
-                            *basptr++ = ch;
-                            ch = *txtptr++;
-                        } while (ch && ch != '\r' && ch != '\n');
-                    }
-                }
-                else {
-                    do {
-                        *basptr++ = ch;
-                        ch = *txtptr++;
-                    } while (is_upper(ch) || is_lower(ch) || ch == '%' || ch == '$');
+        }
+        else {
+            toklno = false;
+            *basptr++ = ch;
+            ch = *txtptr++;
+        }
+    }
+    size_t len = basptr - basline;
+    basline[3] = len;
+    return len;
+}
+
+/* For an update the line hashes of the previous run are kept in a
+ * sidecar file beside the program, one per record in program order.
+ * Like the bas2txt line index it is a cache in native byte order and is
+ * only trusted while the program has the size and modification time
+ * it had when the sidecar was written. */
+
+struct lhs_header {
+    char magic[4];
+    uint32_t count;
+    uint64_t size;
+    int64_t mtime;
+};
+
+struct lhs_entry {
+    uint64_t hash;
+    uint32_t lineno;
+    uint32_t spare;
+};
+
+static const char lhs_magic[4] = { 'T', '2', 'B', 'H' };
+
+struct slot {
+    const unsigned char *rec;
+    uint64_t hash;
+};
+
+struct update {
+    struct slot *slots;
+    struct lhs_entry *entries;
+    size_t count;
+    size_t size;
+    unsigned reused;
+};
+
+static unsigned lineno = 0;
+
+static int txt2bas(const char *fn, FILE *in_fp, FILE *out_fp, struct update *upd)
+{
+    char txtline[256], basline[1024];
+    int status = 0;
+    uint64_t mark = stats_mark();
+    while (fgets(txtline, sizeof(txtline), in_fp)) {
+        if (stats) {
+            mark = bbcutil_stats_lap(stats, BBCUTIL_PH_LOAD, mark);
+            stats->bytes_in += strlen(txtline);
+            stats->lines++;
+        }
+        const char *txtptr = txtline;
+        while (is_space(*txtptr))
+            txtptr++;
+        if (is_digit(*txtptr)) {
+            lineno = 0;
+            do
+                lineno = lineno * 10 + *txtptr++ - '0';
+            while (is_digit(*txtptr));
+        }
+        else
+            ++lineno;
+        uint64_t hash = 0;
+        if (upd) {
+            hash = bbcutil_hash(txtptr, strlen(txtptr), lineno);
+            if (upd->count == upd->size) {
+                size_t size = upd->size ? upd->size * 2 : 1024;
+                struct lhs_entry *entries = realloc(upd->entries, size * sizeof(struct lhs_entry));
+                if (!entries) {
+                    fputs("txt2bas: out of memory\n", stderr);
+                    return 2;
                 }
+                upd->entries = entries;
+                upd->size = size;
             }
-            else {
-                toklno = false;
-                *basptr++ = ch;
-                ch = *txtptr++;
+            const struct slot *slot = upd->slots + (lineno & 0xffff);
+            if (slot->rec && slot->hash == hash) {
+                fwrite(slot->rec, slot->rec[3], 1, out_fp);
+                if (stats) {
+                    mark = bbcutil_stats_lap(stats, BBCUTIL_PH_WRITE, mark);
+                    stats->bytes_out += slot->rec[3];
+                }
+                upd->entries[upd->count].hash = hash;
+                upd->entries[upd->count++].lineno = lineno;
+                upd->reused++;
+                continue;
             }
         }
-        size_t len = basptr - basline;
-        basline[3] = len;
+        size_t len = tokenise(txtptr, lineno, basline);
+        mark = stats_lap(BBCUTIL_PH_DECODE, mark);
+        if (len > 255) {
+            fprintf(stderr, "txt2bas: %s: line %u is too long when tokenised\n", fn, lineno);
+            status = 1;
+            continue;
+        }
         fwrite(basline, len, 1, out_fp);
+        if (stats) {
+            mark = bbcutil_stats_lap(stats, BBCUTIL_PH_WRITE, mark);
+            stats->bytes_out += len;
+        }
+        if (upd) {
+            upd->entries[upd->count].hash = hash;
+            upd->entries[upd->count++].lineno = lineno;
+        }
     }
-    return 0;
+    if (stats) {
+        bbcutil_stats_lap(stats, BBCUTIL_PH_LOAD, mark);
+        stats->files++;
+    }
+    return status;
 }
 
+static int txt2bas_files(char **names, unsigned count, FILE *out_fp, struct update *upd)
+{
+    if (!count)
+        return txt2bas("stdin", stdin, out_fp, upd);
+    int status = 0;
+    while (count--) {
+        const char *in_fn = *names++;
+        FILE *in_fp = fopen(in_fn, "r");
+        if (in_fp) {
+            int fstatus = txt2bas(in_fn, in_fp, out_fp, upd);
+            if (fstatus > status)
+                status = fstatus;
+            fclose(in_fp);
+        }
+        else {
+            fprintf(stderr, "txt2bas: unable to open '%s': %s\n", in_fn, strerror(errno));
+            if (!status)
+                status = 1;
+        }
+    }
+    return status;
+}
+
+/* The records of the previous program are matched with the sidecar
+ * entries in order.  Anything out of step means the sidecar is stale
+ * and every line is tokenised again. */
+
+static unsigned char *load_previous(const char *bas_fn, const char *lhs_fn, struct update *upd)
+{
+    struct stat stb;
+    if (stat(bas_fn, &stb) || !stb.st_size)
+        return NULL;
+    FILE *fp = fopen(lhs_fn, "rb");
+    if (!fp)
+        return NULL;
+    struct lhs_header hdr;
+    struct lhs_entry *entries = NULL;
+    unsigned char *data = NULL;
+    unsigned char *end;
+    int64_t mtime = stb.st_mtim.tv_sec * 1000000000LL + stb.st_mtim.tv_nsec;
+    if (fread(&hdr, sizeof(hdr), 1, fp) == 1 && !memcmp(hdr.magic, lhs_magic, sizeof(lhs_magic))
+        && hdr.size == stb.st_size && hdr.mtime == mtime
+        && (entries = malloc(hdr.count * sizeof(struct lhs_entry) + 1))
+        && fread(entries, sizeof(struct lhs_entry), hdr.count, fp) == hdr.count
+        && (data = bbcutil_load("txt2bas", bas_fn, &end))) {
+        bbcutil_lines lines;
+        bbcutil_line line;
+        unsigned ix = 0;
+        bbcutil_lines_init(&lines, data, end, BBCUTIL_WILSON);
+        while (ix < hdr.count && bbcutil_lines_next(&lines, &line) && line.lineno == (entries[ix].lineno & 0xffff)) {
+            struct slot *slot = upd->slots + line.lineno;
+            slot->rec = line.start;
+            slot->hash = entries[ix++].hash;
+        }
+        if (ix < hdr.count || lines.ptr + 2 > end || lines.ptr[0] != 0x0d || lines.ptr[1] != 0xff) {
+            memset(upd->slots, 0, 0x10000 * sizeof(struct slot));
+            free(data);
+            data = NULL;
+        }
+    }
+    free(entries);
+    fclose(fp);
+    return data;
+}
+
+static bool save_hashes(const char *fn, const struct update *upd, const struct stat *stb)
+{
+    struct lhs_header hdr;
+    memcpy(hdr.magic, lhs_magic, sizeof(lhs_magic));
+    hdr.count = upd->count;
+    hdr.size = stb->st_size;
+    hdr.mtime = stb->st_mtim.tv_sec * 1000000000LL + stb->st_mtim.tv_nsec;
+    FILE *fp = fopen(fn, "wb");
+    if (!fp)
+        return false;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(upd->entries, sizeof(struct lhs_entry), upd->count, fp);
+    return !fclose(fp);
+}
+
+/* Only lines whose text or line number changed since the last update
+ * are tokenised, the rest are copied from the previous program.  The
+ * program and sidecar are written to temporary files and renamed over
+ * the old ones so an interrupted update leaves the previous program. */
+
+static int update(const char *bas_fn, char **names, unsigned count)
+{
+    char *lhs_fn = NULL, *bas_tmp = NULL, *lhs_tmp = NULL;
+    struct update upd;
+    memset(&upd, 0, sizeof(upd));
+    if (asprintf(&lhs_fn, "%s.lhs", bas_fn) < 0 || asprintf(&bas_tmp, "%s.tmp", bas_fn) < 0
+        || asprintf(&lhs_tmp, "%s.tmp", lhs_fn) < 0 || !(upd.slots = calloc(0x10000, sizeof(struct slot)))) {
+        fputs("txt2bas: out of memory\n", stderr);
+        return 2;
+    }
+    int status = 0;
+    uint64_t mark = stats_mark();
+    unsigned char *prev = load_previous(bas_fn, lhs_fn, &upd);
+    stats_lap(BBCUTIL_PH_LOAD, mark);
+    FILE *out_fp = fopen(bas_tmp, "wb");
+    if (out_fp) {
+        status = txt2bas_files(names, count, out_fp, &upd);
+        fwrite(endmark, 2, 1, out_fp);
+        mark = stats_mark();
+        if (fclose(out_fp) && !status) {
+            fprintf(stderr, "txt2bas: write error on '%s': %s\n", bas_tmp, strerror(errno));
+            status = 2;
+        }
+        stats_lap(BBCUTIL_PH_WRITE, mark);
+        struct stat stb;
+        if (status)
+            remove(bas_tmp);
+        else if (stat(bas_tmp, &stb) || rename(bas_tmp, bas_fn)) {
+            fprintf(stderr, "txt2bas: unable to replace '%s': %s\n", bas_fn, strerror(errno));
+            remove(bas_tmp);
+            status = 2;
+        }
+        else if (!save_hashes(lhs_tmp, &upd, &stb) || rename(lhs_tmp, lhs_fn)) {
+            fprintf(stderr, "txt2bas: unable to write line hashes '%s': %s\n", lhs_fn, strerror(errno));
+            remove(lhs_tmp);
+        }
+    }
+    else {
+        fprintf(stderr, "txt2bas: unable to open output file '%s': %s\n", bas_tmp, strerror(errno));
+        status = 2;
+    }
+    free(prev);
+    free(upd.entries);
+    free(upd.slots);
+    free(lhs_tmp);
+    free(bas_tmp);
+    free(lhs_fn);
+    return status;
+}
+
+static const char usage[] = "Usage: txt2bas [--stats[=json]] [ <text-in> ... ] <bas-out>\n"
+                            "       txt2bas [--stats[=json]] -u|--update <bas-file> [ <text-in> ... ]\n";
+
 int main(int argc, char **argv)
 {
     int status = 0;
+    bbcutil_stats run_stats;
+    if (argc > 1 && (stats_mode = bbcutil_stats_option(argv[1]))) {
+        bbcutil_stats_init(&run_stats);
+        stats = &run_stats;
+        argv++;
+        argc--;
+    }
     if (argc == 1) {
-        fputs("Usage: txt2bas [ <text-in> ... ] <bas-out>\n", stderr);
+        fputs(usage, stderr);
         status = 1;
     }
+    else if (!strcmp(argv[1], "-u") || !strcmp(argv[1], "--update")) {
+        if (argc == 2) {
+            fprintf(stderr, "txt2bas: missing program to update\n%s", usage);
+            status = 1;
+        }
+        else
+            status = update(argv[2], argv + 3, argc - 3);
+    }
     else {
         const char *out_fn = argv[--argc];
         FILE *out_fp = fopen(out_fn, "wb");
         if (out_fp) {
-            if (--argc) {
-                do {
-                    const char *in_fn = *++argv;
-                    FILE *in_fp = fopen(in_fn, "r");
-                    if (in_fp) {
-                        if (txt2bas(in_fn, in_fp, out_fp))
-                            status = 1;
-                        fclose(in_fp);
-                    }
-                    else {
-                        fprintf(stderr, "txt2bas: unable to open '%s': %s", in_fn, strerror(errno));
-                        status = 1;
-                    }
-                } while (--argc);
-            }
-            else
-                status = txt2bas("stdin", stdin, out_fp);
+            status = txt2bas_files(argv + 1, argc - 1, out_fp, NULL);
             fwrite(endmark, 2, 1, out_fp);
+            uint64_t mark = stats_mark();
             fclose(out_fp);
+            stats_lap(BBCUTIL_PH_WRITE, mark);
         }
         else {
             fprintf(stderr, "txt2bas: unable to open output file '%s': %s\n", out_fn, strerror(errno));
             status = 2;
         }
     }
+    if (stats) {
+        stats->tokens = tokens_emitted;
+        bbcutil_stats_report("txt2bas", stats, stats_mode, stderr);
+    }
     return status;
 }
@@ -0,0 +1,250 @@
+#include "bbcutil.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Text is tokenised from a listing as comal2txt produces: a line number,
+ * the indent as two spaces a level, then the statement.  Keywords are
+ * matched from the generated COMAL tables, where those with the same
+ * first character are longest first so that the longest one wins, as
+ * READ ONLY over READ and INKEY$ over INKEY.  A space that comal2txt
+ * would put back when listing is dropped, any other is kept, so listing
+ * the result gives back the text. */
+
+static unsigned char endmark[2] = { 0x0d, 0xff };
+
+static inline bool is_space(int ch)
+{
+    return (ch == ' ' || ch == '\t' || ch == '\r');
+}
+
+static inline bool is_alpha(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+}
+
+static inline bool is_digit(int ch)
+{
+    return (ch >= '0' && ch <= '9');
+}
+
+static inline bool is_alnum(int ch)
+{
+    return is_digit(ch) || is_alpha(ch);
+}
+
+static inline bool is_word(int ch)
+{
+    return is_alnum(ch) || ch == '_' || ch == '\'';
+}
+
+static inline bool is_eol(int ch)
+{
+    return !ch || ch == '\n' || ch == '\r';
+}
+
+static const bbcutil_match *match(const char *txtptr)
+{
+    const bbcutil_dialect *d = &bbcutil_comal_dialect;
+    unsigned ch = (unsigned char)*txtptr;
+    if (ch >= 128)
+        return NULL;
+    for (const bbcutil_match *m = d->match + d->starts[ch]; m < d->match + d->starts[ch + 1]; m++)
+        if (!strncmp(txtptr, m->text, m->len) && !(is_alnum(m->text[m->len - 1]) && is_word(txtptr[m->len])))
+            return m;
+    return NULL;
+}
+
+/* The spacing state of comal2txt as the line is written, so as to know
+ * which spaces it would put back. */
+
+struct spacing {
+    bool did_space;
+    bool need_space;
+};
+
+static inline bool would_space(const struct spacing *sp, const char *next)
+{
+    const bbcutil_match *m = match(next);
+    if (m)
+        return !sp->did_space && (sp->need_space || (bbcutil_comal_dialect.keywords[m->token].flags & BBCUTIL_KW_SPC_BEFORE));
+    return sp->need_space && *next != '"' && *next != ':';
+}
+
+static inline void put_char(struct spacing *sp, int ch, unsigned char **ptr)
+{
+    if (ch == '"')
+        sp->need_space = false;
+    else if (ch == ' ' || ch == ':') {
+        sp->did_space = true;
+        sp->need_space = false;
+    }
+    else
+        sp->did_space = false;
+    if (sp->need_space && !sp->did_space) {
+        sp->need_space = false;
+        sp->did_space = true;
+    }
+    *(*ptr)++ = ch;
+}
+
+static size_t tokenise(const char *txtptr, unsigned lineno, unsigned indent, unsigned char *comline)
+{
+    unsigned char *comptr = comline + 5;
+    struct spacing sp = { true, false };
+    comline[0] = 0x0d;
+    comline[1] = (lineno >> 8);
+    comline[2] = lineno;
+    comline[4] = indent;
+    while (!is_eol(*txtptr)) {
+        int ch = *txtptr;
+        const bbcutil_match *m;
+        if (ch == ' ') {
+            const char *after = txtptr;
+            while (*after == ' ')
+                after++;
+            if (after - txtptr == 1 && !is_eol(*after) && would_space(&sp, after))
+                txtptr++;
+            else
+                while (txtptr < after)
+                    put_char(&sp, *txtptr++, &comptr);
+        }
+        else if (ch == '"') {
+            do
+                *comptr++ = *txtptr++;
+            while (!is_eol(*txtptr) && *txtptr != '"');
+            if (*txtptr == '"')
+                *comptr++ = *txtptr++;
+            sp.need_space = false;
+        }
+        else if ((m = match(txtptr))) {
+            unsigned flags = bbcutil_comal_dialect.keywords[m->token].flags;
+            *comptr++ = m->token;
+            txtptr += m->len;
+            if (flags & BBCUTIL_KW_SKIP_EOL) {
+                while (!is_eol(*txtptr))
+                    *comptr++ = *txtptr++;
+                break;
+            }
+            if (flags & BBCUTIL_KW_SKIP_TWO) {
+                *comptr++ = 0;
+                *comptr++ = 0;
+            }
+            sp.did_space = false;
+            sp.need_space = flags & BBCUTIL_KW_SPC_AFTER;
+        }
+        else if (is_alpha(ch)) {
+            do
+                put_char(&sp, *txtptr++, &comptr);
+            while (is_word(*txtptr));
+            if (*txtptr == '$' || *txtptr == '#')
+                put_char(&sp, *txtptr++, &comptr);
+        }
+        else if (ch == '$') {
+            do
+                put_char(&sp, *txtptr++, &comptr);
+            while (is_alnum(*txtptr));
+        }
+        else if (is_digit(ch) || ch == '.') {
+            do
+                put_char(&sp, *txtptr++, &comptr);
+            while (is_digit(*txtptr) || *txtptr == '.');
+            if ((*txtptr == 'E' || *txtptr == 'e')
+                && (is_digit(txtptr[1]) || ((txtptr[1] == '-' || txtptr[1] == '+') && is_digit(txtptr[2])))) {
+                do
+                    put_char(&sp, *txtptr++, &comptr);
+                while (is_digit(*txtptr));
+            }
+        }
+        else
+            put_char(&sp, *txtptr++, &comptr);
+        if (comptr - comline > 255)
+            break;
+    }
+    size_t len = comptr - comline;
+    comline[3] = len;
+    return len;
+}
+
+static unsigned lineno = 0;
+
+static int txt2comal(const char *fn, FILE *in_fp, FILE *out_fp)
+{
+    char txtline[1024];
+    unsigned char comline[sizeof(txtline) + 256];
+    int status = 0;
+    while (fgets(txtline, sizeof(txtline), in_fp)) {
+        const char *txtptr = txtline;
+        while (is_space(*txtptr))
+            txtptr++;
+        if (is_digit(*txtptr)) {
+            lineno = 0;
+            do
+                lineno = lineno * 10 + *txtptr++ - '0';
+            while (is_digit(*txtptr));
+            if (*txtptr == ' ')
+                txtptr++;
+        }
+        else {
+            ++lineno;
+            txtptr = txtline;
+        }
+        unsigned spaces = 0;
+        while (txtptr[spaces] == ' ')
+            spaces++;
+        txtptr += spaces & ~1u;
+        size_t len = tokenise(txtptr, lineno, spaces / 2, comline);
+        if (len > 255) {
+            fprintf(stderr, "txt2comal: %s: line %u is too long when tokenised\n", fn, lineno);
+            status = 1;
+            continue;
+        }
+        fwrite(comline, len, 1, out_fp);
+    }
+    return status;
+}
+
+static const char usage[] = "Usage: txt2comal [ <text-in> ... ] <comal-out>\n";
+
+int main(int argc, char **argv)
+{
+    if (argc == 1) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    const char *out_fn = argv[--argc];
+    FILE *out_fp = fopen(out_fn, "wb");
+    if (!out_fp) {
+        fprintf(stderr, "txt2comal: unable to open output file '%s': %s\n", out_fn, strerror(errno));
+        return 2;
+    }
+    int status = 0;
+    if (argc == 1)
+        status = txt2comal("stdin", stdin, out_fp);
+    else {
+        for (int i = 1; i < argc; i++) {
+            const char *in_fn = argv[i];
+            FILE *in_fp = fopen(in_fn, "r");
+            if (in_fp) {
+                int fstatus = txt2comal(in_fn, in_fp, out_fp);
+                if (fstatus > status)
+                    status = fstatus;
+                fclose(in_fp);
+            }
+            else {
+                fprintf(stderr, "txt2comal: unable to open '%s': %s\n", in_fn, strerror(errno));
+                if (!status)
+                    status = 1;
+            }
+        }
+    }
+    fwrite(endmark, 2, 1, out_fp);
+    if (fclose(out_fp) && !status) {
+        fprintf(stderr, "txt2comal: write error on '%s': %s\n", out_fn, strerror(errno));
+        status = 2;
+    }
+    return status;
+}